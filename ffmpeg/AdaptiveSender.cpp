@@ -0,0 +1,273 @@
+#include <cmath>
+#include <algorithm>
+#include "AdaptiveSender.h"
+
+namespace media {
+
+    AdaptiveSender::AdaptiveSender()
+        : switcher_(nullptr)
+        , output_(nullptr)
+        , topPreset_(-1)
+        , topBitrate_(0)
+        , maxLevel_(0)
+        , dropLevel_(false)
+        , level_(0)
+        , dropDisposable_(false)
+        , pkt_(nullptr)
+        , error_(0)
+        , lastTime_(0)
+        , bytesIn_(0)
+        , lastBytesIn_(0)
+        , congestedWindows_(0)
+        , clearWindows_(0) {
+    }
+
+    AdaptiveSender::~AdaptiveSender() {
+        reset();
+    }
+
+    int AdaptiveSender::open(EncoderSwitcher* switcher,
+                             MediaOutput* output,
+                             int preset,
+                             const AdaptivePolicy& policy) {
+        if (!switcher || !switcher->encoder() || !output || !output->videoStream()) {
+            return AVERROR(EINVAL);
+        }
+
+        const int count = static_cast<int>(sizeof(Resolution_Preset) / sizeof(Resolution_Preset[0]));
+        if (preset < 0 || preset >= count || Resolution_Preset[preset].width <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (policy.windowUs <= 0 || policy.bitrateSteps < 0 || policy.bitrateFactor <= 0.0 || policy.bitrateFactor >= 1.0) {
+            return AVERROR(EINVAL);
+        }
+
+        reset();
+
+        pkt_ = av_packet_alloc();
+        if (!pkt_) {
+            return AVERROR(ENOMEM);
+        }
+
+        switcher_ = switcher;
+        output_ = output;
+        policy_ = policy;
+        topPreset_ = preset;
+        topBitrate_ = switcher->encoder()->videoEncoder()->bit_rate;
+        if (topBitrate_ <= 0) {
+            topBitrate_ = Resolution_Preset[preset].bitrate;
+        }
+
+        // Level 0 is untouched, every preset from the top one down adds bitrateSteps + 1 levels;
+        // without B-frames there is no disposable packet and the first, drop only, level goes away
+        dropLevel_ = switcher->encoder()->videoEncoder()->max_b_frames > 0;
+        maxLevel_ = (topPreset_ + 1) * (policy_.bitrateSteps + 1) - (dropLevel_ ? 0 : 1);
+
+        lastTime_ = av_gettime_relative();
+        lastMux_ = output_->stats();
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        stats_ = LinkStats();
+        stats_.preset = topPreset_;
+        stats_.bitrate = topBitrate_;
+        return 0;
+    }
+
+    int AdaptiveSender::sendVideoFrame(const AVFrame* frame) {
+        if (!switcher_) {
+            return AVERROR(EINVAL);
+        }
+
+        if (error_ < 0) {
+            return error_;
+        }
+
+        // Decisions are taken and applied here, on the encode thread, never inside the packet callback
+        int64_t now = av_gettime_relative();
+        if (now - lastTime_ >= policy_.windowUs) {
+            evaluate(now);
+        }
+
+        int ret = switcher_->encodeFrame(frame, [this](AVPacket* pkt) {
+            writeVideo(pkt);
+            });
+
+        return ret < 0 ? ret : error_;
+    }
+
+    int AdaptiveSender::flush() {
+        if (!switcher_) {
+            return AVERROR(EINVAL);
+        }
+
+        int ret = switcher_->flush([this](AVPacket* pkt) {
+            writeVideo(pkt);
+            });
+
+        return ret < 0 ? ret : error_;
+    }
+
+    void AdaptiveSender::reset() {
+        av_packet_free(&pkt_);
+
+        switcher_ = nullptr;
+        output_ = nullptr;
+        topPreset_ = -1;
+        topBitrate_ = 0;
+        maxLevel_ = 0;
+        dropLevel_ = false;
+        level_ = 0;
+        dropDisposable_ = false;
+        error_ = 0;
+        bytesIn_ = 0;
+        lastBytesIn_ = 0;
+        congestedWindows_ = 0;
+        clearWindows_ = 0;
+    }
+
+    LinkStats AdaptiveSender::linkStats() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return stats_;
+    }
+
+    AdaptiveSender::Level AdaptiveSender::levelAt(int level) const {
+        Level l;
+        l.preset = topPreset_;
+
+        if (level > 0) {
+            int steps = policy_.bitrateSteps + 1;
+            int index = dropLevel_ ? level - 1 : level;
+            l.preset = topPreset_ - index / steps;
+            l.bitrateStep = index % steps;
+            l.drop = dropLevel_;
+        }
+
+        return l;
+    }
+
+    int64_t AdaptiveSender::bitrateAt(const Level& level) const {
+        int64_t base = level.preset == topPreset_ ? topBitrate_ : Resolution_Preset[level.preset].bitrate;
+        return static_cast<int64_t>(base * std::pow(policy_.bitrateFactor, level.bitrateStep));
+    }
+
+    void AdaptiveSender::evaluate(int64_t now) {
+        MuxStats mux = output_->stats();
+        int64_t elapsed = std::max<int64_t>(1, now - lastTime_);
+
+        int64_t packets = mux.packets - lastMux_.packets;
+        int64_t bytes = mux.bytes - lastMux_.bytes;
+        int64_t writeUs = mux.writeUs - lastMux_.writeUs;
+        int64_t blockedUs = mux.blockedUs - lastMux_.blockedUs;
+
+        int64_t latency = packets > 0 ? writeUs / packets : 0;
+        // Nothing written for a whole window with data queued means the link is stalled
+        int64_t backlog = packets > 0
+            ? static_cast<int64_t>(mux.queueDepth) * elapsed / packets
+            : (mux.queueDepth > 0 ? elapsed : 0);
+
+        // In sync mode every write counts as blocked time, only a full async queue is a signal
+        bool blocked = output_->isAsync() && blockedUs > elapsed / 10;
+
+        bool congested = backlog > policy_.maxBacklogUs || latency > policy_.maxWriteLatencyUs || blocked;
+        bool clear = backlog <= policy_.minBacklogUs && latency <= policy_.maxWriteLatencyUs / 2 && !blocked;
+
+        if (congested) {
+            clearWindows_ = 0;
+            if (++congestedWindows_ >= policy_.downWindows) {
+                congestedWindows_ = 0;
+                applyLevel(std::min(level_ + 1, maxLevel_));
+            }
+        }
+        else if (clear) {
+            congestedWindows_ = 0;
+            if (++clearWindows_ >= policy_.upWindows) {
+                clearWindows_ = 0;
+                applyLevel(std::max(level_ - 1, 0));
+            }
+        }
+        else {
+            congestedWindows_ = 0;
+            clearWindows_ = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            stats_.queueDepth = mux.queueDepth;
+            stats_.backlogUs = backlog;
+            stats_.writeLatencyUs = latency;
+            stats_.inputBps = (bytesIn_ - lastBytesIn_) * 8000000.0 / elapsed;
+            stats_.throughputBps = bytes * 8000000.0 / elapsed;
+        }
+
+        lastTime_ = now;
+        lastMux_ = mux;
+        lastBytesIn_ = bytesIn_;
+    }
+
+    void AdaptiveSender::applyLevel(int level) {
+        if (level == level_) {
+            return;
+        }
+
+        Level from = levelAt(level_);
+        Level to = levelAt(level);
+        int64_t bitrate = bitrateAt(to);
+
+        if (to.preset != from.preset) {
+            // A switch still opening keeps the current level, the next window retries
+            const Resolution& res = Resolution_Preset[to.preset];
+            if (switcher_->isSwitching() || switcher_->switchTo(res.width, res.height, bitrate) < 0) {
+                return;
+            }
+        }
+        else if (to.bitrateStep != from.bitrateStep) {
+            switcher_->encoder()->setVideoBitrate(bitrate);
+        }
+
+        dropDisposable_ = to.drop;
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (level > level_) {
+            ++stats_.downgrades;
+        }
+        else {
+            ++stats_.upgrades;
+        }
+        stats_.level = level;
+        stats_.preset = to.preset;
+        stats_.bitrate = bitrate;
+        level_ = level;
+    }
+
+    void AdaptiveSender::writeVideo(AVPacket* pkt) {
+        if (error_ < 0) {
+            return;
+        }
+
+        // Disposable packets (non-reference B-frames) are referenced by nothing else
+        if (dropDisposable_ && (pkt->flags & AV_PKT_FLAG_DISPOSABLE)) {
+            std::lock_guard<std::mutex> locker(mutex_);
+            ++stats_.droppedPackets;
+            return;
+        }
+
+        int ret = av_packet_ref(pkt_, pkt);
+        if (ret < 0) {
+            error_ = ret;
+            return;
+        }
+
+        AVStream* stream = output_->videoStream();
+        av_packet_rescale_ts(pkt_, switcher_->timebase(), stream->time_base);
+        pkt_->stream_index = stream->index;
+
+        bytesIn_ += pkt_->size;
+
+        ret = output_->writePacket(pkt_);
+        if (ret < 0) {
+            error_ = ret;
+        }
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <mutex>
+#include "FFmpeg.h"
+#include "MediaOutput.h"
+#include "EncoderSwitcher.h"
+
+namespace media {
+
+    struct AdaptivePolicy {
+        // Length of one measurement window
+        int64_t windowUs = 1000000;
+        // Congested above maxBacklogUs of queued data or maxWriteLatencyUs per write, clear below minBacklogUs
+        int64_t maxBacklogUs = 500000;
+        int64_t minBacklogUs = 100000;
+        int64_t maxWriteLatencyUs = 50000;
+        // Consecutive windows before stepping down / back up (recovery is deliberately slower)
+        int downWindows = 2;
+        int upWindows = 10;
+        // Bitrate steps per resolution, each multiplies the bitrate by bitrateFactor
+        int bitrateSteps = 2;
+        double bitrateFactor = 0.75;
+    };
+
+    struct LinkStats {
+        size_t queueDepth = 0;
+        // Queued data expressed in time at the current send rate
+        int64_t backlogUs = 0;
+        // Average write time per packet
+        int64_t writeLatencyUs = 0;
+        // Bits per second offered by the encoder and actually written to the link
+        double inputBps = 0.0;
+        double throughputBps = 0.0;
+        // Current downgrade level (0 = none), the Resolution_Preset and bitrate it maps to
+        int level = 0;
+        int preset = -1;
+        int64_t bitrate = 0;
+        int64_t droppedPackets = 0;
+        int64_t downgrades = 0;
+        int64_t upgrades = 0;
+    };
+
+    class AdaptiveSender {
+    public:
+        AdaptiveSender(const AdaptiveSender&) = delete;
+        AdaptiveSender& operator=(const AdaptiveSender&) = delete;
+        AdaptiveSender(AdaptiveSender&&) = delete;
+        AdaptiveSender& operator=(AdaptiveSender&&) = delete;
+
+        AdaptiveSender();
+        ~AdaptiveSender();
+
+        // Open sender (switcher, output, preset, policy) >= 0
+        // switcher is open at Resolution_Preset[preset]; output was opened (writeNetwork) with its
+        // encoder and should run startAsync(), the mux queue is the main congestion signal
+        // Levels step down: drop disposable frames, lower the bitrate, then the next lower preset;
+        // the drop level is skipped when the encoder has no B-frames, nothing would be disposable
+        int open(EncoderSwitcher* switcher,
+                 MediaOutput* output,
+                 int preset,
+                 const AdaptivePolicy& policy = AdaptivePolicy());
+
+        // Encode and send video frame (frame) >= 0, measures the link and applies the level first
+        // Audio keeps going to MediaOutput::writePacket directly and is never degraded
+        int sendVideoFrame(const AVFrame* frame);
+        // Flush encoder >= 0, sends the remaining packets
+        int flush();
+
+        // Reset sender, the switcher and output are left open
+        void reset();
+
+        LinkStats linkStats() const;
+
+    private:
+        struct Level {
+            int preset = -1;
+            int bitrateStep = 0;
+            bool drop = false;
+        };
+
+        Level levelAt(int level) const;
+        int64_t bitrateAt(const Level& level) const;
+        void evaluate(int64_t now);
+        void applyLevel(int level);
+        void writeVideo(AVPacket* pkt);
+
+    private:
+        EncoderSwitcher* switcher_;
+        MediaOutput* output_;
+        AdaptivePolicy policy_;
+        int topPreset_;
+        int64_t topBitrate_;
+        int maxLevel_;
+        bool dropLevel_;
+        int level_;
+        bool dropDisposable_;
+        AVPacket* pkt_;
+        int error_;
+
+        int64_t lastTime_;
+        MuxStats lastMux_;
+        int64_t bytesIn_;
+        int64_t lastBytesIn_;
+        int congestedWindows_;
+        int clearWindows_;
+
+        mutable std::mutex mutex_;
+        LinkStats stats_;
+    };
+
+} // namespace media
\ No newline at end of file
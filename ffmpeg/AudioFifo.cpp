@@ -0,0 +1,199 @@
+#include "AudioFifo.h"
+
+namespace media {
+
+    AudioFifo::AudioFifo()
+        : framesize_(0)
+        , samplerate_(0)
+        , timebase_({ 0, 0 })
+        , chlayout_(AV_CHANNEL_LAYOUT_STEREO)
+        , samplefmt_(AV_SAMPLE_FMT_NONE)
+        , inited_(false)
+        , flushing_(false)
+        , startPts_(AV_NOPTS_VALUE)
+        , samples_(0)
+        , fifo_(nullptr) {
+    }
+
+    AudioFifo::~AudioFifo() {
+        reset();
+    }
+
+    int AudioFifo::init(int framesize,
+                        int samplerate,
+                        AVRational timebase,
+                        const AVChannelLayout& chlayout,
+                        AVSampleFormat samplefmt) {
+        if (framesize <= 0 || samplerate <= 0 || samplefmt == AV_SAMPLE_FMT_NONE) {
+            return AVERROR(EINVAL);
+        }
+
+        if (timebase.num <= 0 || timebase.den <= 0) {
+            timebase = { 1, samplerate };
+        }
+
+        reset();
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        int ret = av_channel_layout_copy(&chlayout_, &chlayout);
+        if (ret < 0) {
+            return ret;
+        }
+
+        // Room for a few frames up front, av_audio_fifo_write grows it when needed
+        fifo_ = av_audio_fifo_alloc(samplefmt, chlayout.nb_channels, framesize * 4);
+        if (!fifo_) {
+            return AVERROR(ENOMEM);
+        }
+
+        framesize_ = framesize;
+        samplerate_ = samplerate;
+        timebase_ = timebase;
+        samplefmt_ = samplefmt;
+        inited_ = true;
+        return 0;
+    }
+
+    int AudioFifo::addFrame(const AVFrame* srcFrame) {
+        if (!srcFrame || srcFrame->nb_samples <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (!inited_ || flushing_) {
+            return AVERROR(EINVAL);
+        }
+
+        if (srcFrame->format != samplefmt_ || srcFrame->ch_layout.nb_channels != chlayout_.nb_channels) {
+            return AVERROR(EINVAL);
+        }
+
+        // Output pts run on from the first timestamped input, and resync whenever the
+        // fifo has drained so upstream gaps are not smeared over later frames
+        if (srcFrame->pts != AV_NOPTS_VALUE && (startPts_ == AV_NOPTS_VALUE || av_audio_fifo_size(fifo_) == 0)) {
+            startPts_ = srcFrame->pts;
+            samples_ = 0;
+        }
+
+        int ret = av_audio_fifo_write(fifo_, reinterpret_cast<void* const*>(srcFrame->extended_data), srcFrame->nb_samples);
+        if (ret < 0) {
+            return ret;
+        }
+
+        return ret < srcFrame->nb_samples ? AVERROR(ENOMEM) : 0;
+    }
+
+    int AudioFifo::getFrame(AVFrame* dstFrame) {
+        if (!dstFrame) {
+            return AVERROR(EINVAL);
+        }
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (!inited_) {
+            return AVERROR(EINVAL);
+        }
+
+        int available = av_audio_fifo_size(fifo_);
+        if (available <= 0) {
+            return flushing_ ? AVERROR_EOF : AVERROR(EAGAIN);
+        }
+
+        if (available < framesize_ && !flushing_) {
+            return AVERROR(EAGAIN);
+        }
+
+        int ret = prepareFrame(dstFrame);
+        if (ret < 0) {
+            return ret;
+        }
+
+        int count = available < framesize_ ? available : framesize_;
+        ret = av_audio_fifo_read(fifo_, reinterpret_cast<void* const*>(dstFrame->extended_data), count);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (count < framesize_) {
+            av_samples_set_silence(dstFrame->extended_data, count, framesize_ - count,
+                                   chlayout_.nb_channels, samplefmt_);
+        }
+
+        AVRational sampleTb = { 1, samplerate_ };
+        if (startPts_ != AV_NOPTS_VALUE) {
+            dstFrame->pts = startPts_ + av_rescale_q(samples_, sampleTb, timebase_);
+        }
+        else {
+            dstFrame->pts = av_rescale_q(samples_, sampleTb, timebase_);
+        }
+        // Duration covers the real samples only, padding is not media time
+        dstFrame->duration = av_rescale_q(count, sampleTb, timebase_);
+        dstFrame->time_base = timebase_;
+        samples_ += count;
+
+        return 0;
+    }
+
+    void AudioFifo::flush() {
+        std::lock_guard<std::mutex> locker(mutex_);
+        flushing_ = true;
+    }
+
+    void AudioFifo::reset() {
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (fifo_) {
+            av_audio_fifo_free(fifo_);
+            fifo_ = nullptr;
+        }
+
+        av_channel_layout_uninit(&chlayout_);
+        framesize_ = 0;
+        samplerate_ = 0;
+        timebase_ = { 0, 0 };
+        samplefmt_ = AV_SAMPLE_FMT_NONE;
+        inited_ = false;
+        flushing_ = false;
+        startPts_ = AV_NOPTS_VALUE;
+        samples_ = 0;
+    }
+
+    int AudioFifo::size() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return fifo_ ? av_audio_fifo_size(fifo_) : 0;
+    }
+
+    bool AudioFifo::isInited() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return inited_;
+    }
+
+    int AudioFifo::prepareFrame(AVFrame* frame) {
+        bool reusable = frame->buf[0]
+            && frame->format == samplefmt_
+            && frame->nb_samples == framesize_
+            && frame->sample_rate == samplerate_
+            && av_channel_layout_compare(&frame->ch_layout, &chlayout_) == 0
+            && av_frame_is_writable(frame);
+
+        if (reusable) {
+            return 0;
+        }
+
+        av_frame_unref(frame);
+
+        frame->format = samplefmt_;
+        frame->nb_samples = framesize_;
+        frame->sample_rate = samplerate_;
+
+        int ret = av_channel_layout_copy(&frame->ch_layout, &chlayout_);
+        if (ret < 0) {
+            return ret;
+        }
+
+        return av_frame_get_buffer(frame, 0);
+    }
+
+} // namespace media
\ No newline at end of file
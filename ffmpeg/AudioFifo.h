@@ -0,0 +1,63 @@
+#pragma once
+
+#include <mutex>
+#include "FFmpeg.h"
+
+namespace media {
+
+    class AudioFifo {
+    public:
+        AudioFifo(const AudioFifo&) = delete;
+        AudioFifo& operator=(const AudioFifo&) = delete;
+        AudioFifo(AudioFifo&&) = delete;
+        AudioFifo& operator=(AudioFifo&&) = delete;
+
+        AudioFifo();
+        ~AudioFifo();
+
+        // Init audio fifo (framesize, samplerate, timebase, chlayout, samplefmt) >= 0
+        // framesize is the encoder frame_size, timebase is used for input and output pts
+        int init(int framesize,
+                 int samplerate,
+                 AVRational timebase,
+                 const AVChannelLayout& chlayout,
+                 AVSampleFormat samplefmt);
+
+        // Add Frame (srcFrame) >= 0, any number of samples
+        int addFrame(const AVFrame* srcFrame);
+        // Get Frame (dstFrame) >= 0, exactly framesize samples
+        // AVERROR(EAGAIN) until enough samples are buffered, AVERROR_EOF once flushed and empty
+        // dstFrame buffers are reused when still writable, pass the same frame back after the
+        // encoder has consumed it to stay allocation free
+        int getFrame(AVFrame* dstFrame);
+
+        // Flush audio fifo, the last frame is padded with silence
+        void flush();
+        // Reset audio fifo
+        void reset();
+
+        int size() const;
+        bool isInited() const;
+
+    private:
+        int prepareFrame(AVFrame* frame);
+
+    private:
+        mutable std::mutex mutex_;
+
+        int framesize_;
+        int samplerate_;
+        AVRational timebase_;
+        AVChannelLayout chlayout_;
+        AVSampleFormat samplefmt_;
+
+        bool inited_;
+        bool flushing_;
+        // pts of the first buffered sample is startPts_ + samples_ (in 1/samplerate)
+        int64_t startPts_;
+        int64_t samples_;
+
+        AVAudioFifo* fifo_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,474 @@
+#include <thread>
+#include <algorithm>
+#include "MediaInput.h"
+#include "MediaResampler.h"
+#include "ChunkedTranscoder.h"
+
+namespace media {
+
+    ChunkedTranscoder::ChunkedTranscoder()
+        : stopped_(false)
+        , chunkCount_(0)
+        , chunksWritten_(0)
+        , packetCount_(0)
+        , lastDts_(AV_NOPTS_VALUE)
+        , audioPkt_(nullptr)
+        , audioPending_(false) {
+    }
+
+    ChunkedTranscoder::~ChunkedTranscoder() {
+        stop();
+        closeAudio();
+    }
+
+    int ChunkedTranscoder::transcodeFile(const std::string& input,
+                                         const std::string& output,
+                                         const std::string& format,
+                                         AVCodecID codecid,
+                                         int width,
+                                         int height,
+                                         int64_t bitrate,
+                                         unsigned int workers) {
+        if (input.empty() || output.empty() || codecid == AV_CODEC_ID_NONE) {
+            return AVERROR(EINVAL);
+        }
+
+        stopped_.store(false);
+        chunkCount_.store(0);
+        chunksWritten_.store(0);
+        packetCount_.store(0);
+        lastDts_ = AV_NOPTS_VALUE;
+
+        Settings settings;
+        std::vector<int64_t> keyframes;
+        bool hasAudio = false;
+        {
+            MediaInput source;
+            int ret = source.openFileStream(input);
+            if (ret < 0) {
+                return ret;
+            }
+
+            if (!source.hasVideoStream()) {
+                return AVERROR_STREAM_NOT_FOUND;
+            }
+
+            ret = source.videoKeyframes(keyframes);
+            if (ret < 0) {
+                return ret;
+            }
+
+            const VideoParams& p = source.videoParams();
+            settings.codecid = codecid;
+            settings.srcW = p.width;
+            settings.srcH = p.height;
+            settings.srcFmt = p.pixfmt;
+            settings.width = width > 0 ? width : p.width;
+            settings.height = height > 0 ? height : p.height;
+            settings.bitrate = bitrate > 0 ? bitrate : p.bitrate;
+            settings.timebase = p.timebase;
+            settings.framerate = p.framerate.num > 0 && p.framerate.den > 0 ? p.framerate : AVRational{ 25, 1 };
+            hasAudio = source.hasAudioStream();
+        }
+
+        if (settings.bitrate <= 0) {
+            // Smallest preset that covers the output height
+            settings.bitrate = Resolution_Preset[3].bitrate;
+            for (int i = 0; i < 4; ++i) {
+                if (Resolution_Preset[i].height >= settings.height) {
+                    settings.bitrate = Resolution_Preset[i].bitrate;
+                    break;
+                }
+            }
+        }
+
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        if (workers == 0) {
+            workers = cores;
+        }
+
+        // Every chunk restarts with an IDR, two chunks per worker is enough to balance load
+        std::vector<ParallelDecoder::Segment> segments = ParallelDecoder::splitSegments(keyframes, static_cast<size_t>(workers) * 2);
+        chunkCount_.store(static_cast<int>(segments.size()));
+
+        workers = std::min(workers, static_cast<unsigned int>(segments.size()));
+        settings.threads = std::max(1u, cores / workers);
+
+        if (hasAudio) {
+            int ret = openAudio(input);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        // The muxer is initialized from a reference encoder, chunk encoders use identical
+        // settings so their global headers match it; the source audio is stream copied
+        MediaOutput muxer;
+        {
+            MediaEncoder reference;
+            int ret = openEncoder(reference, settings);
+
+            AVCodecParameters* videoParams = nullptr;
+            if (ret >= 0) {
+                videoParams = avcodec_parameters_alloc();
+                ret = videoParams ? avcodec_parameters_from_context(videoParams, reference.videoEncoder()) : AVERROR(ENOMEM);
+            }
+
+            if (ret >= 0) {
+                AVStream* audio = audioPkt_ ? audio_.inputContext()->streams[audio_.audioParams().index] : nullptr;
+                ret = muxer.writeFile(output, format, videoParams, reference.videoEncoder()->time_base,
+                                      audio ? audio->codecpar : nullptr, audio ? audio->time_base : AVRational{ 0, 1 });
+            }
+            avcodec_parameters_free(&videoParams);
+
+            if (ret < 0) {
+                closeAudio();
+                return ret;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            chunks_.clear();
+            chunks_.resize(segments.size());
+        }
+
+        // Bounds the encoded packets held in memory ahead of the muxer
+        const size_t window = static_cast<size_t>(workers) * 2;
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+
+        for (unsigned int w = 0; w < workers; ++w) {
+            pool.emplace_back([this, &input, &segments, &settings, &next, window]() {
+                for (;;) {
+                    size_t i = next.fetch_add(1);
+                    if (i >= segments.size()) {
+                        break;
+                    }
+
+                    {
+                        std::unique_lock<std::mutex> locker(mutex_);
+                        cond_.wait(locker, [this, i, window]() {
+                            return stopped_.load() || i < static_cast<size_t>(chunksWritten_.load()) + window;
+                            });
+                        if (stopped_.load()) {
+                            break;
+                        }
+                    }
+
+                    int ret = encodeChunk(input, segments[i], settings, chunks_[i]);
+
+                    std::lock_guard<std::mutex> locker(mutex_);
+                    chunks_[i].done = true;
+                    chunks_[i].error = ret;
+                    cond_.notify_all();
+                }
+                });
+        }
+
+        int err = 0;
+        AVRational timebase = settings.timebase;
+
+        for (size_t i = 0; i < segments.size(); ++i) {
+            {
+                std::unique_lock<std::mutex> locker(mutex_);
+                cond_.wait(locker, [this, i]() {
+                    return stopped_.load() || chunks_[i].done;
+                    });
+                if (!chunks_[i].done) {
+                    break;
+                }
+                err = chunks_[i].error;
+            }
+
+            if (err == 0) {
+                err = writeChunk(muxer, timebase, chunks_[i]);
+            }
+
+            if (err < 0) {
+                stop();
+                break;
+            }
+
+            chunksWritten_.fetch_add(1);
+            std::lock_guard<std::mutex> locker(mutex_);
+            cond_.notify_all();
+        }
+
+        for (std::thread& t : pool) {
+            t.join();
+        }
+
+        clearChunks();
+
+        if (err == 0 && !stopped_.load()) {
+            // Audio past the last video packet
+            err = writeAudio(muxer, INT64_MAX);
+        }
+
+        closeAudio();
+
+        if (err < 0) {
+            muxer.reset();
+            return err;
+        }
+
+        if (stopped_.load()) {
+            return AVERROR_EXIT;
+        }
+
+        // Trailer is written when the muxer is released
+        muxer.reset();
+        return 0;
+    }
+
+    void ChunkedTranscoder::stop() {
+        stopped_.store(true);
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        cond_.notify_all();
+    }
+
+    int ChunkedTranscoder::openEncoder(MediaEncoder& encoder, const Settings& settings) {
+        // Closed GOPs keep every chunk decodable on its own
+        AVDictionary* opt = nullptr;
+        av_dict_set(&opt, "flags", "+cgop", 0);
+
+        int ret = encoder.openVideoEncoder(settings.codecid, settings.width, settings.height, settings.bitrate,
+                                           settings.timebase, settings.framerate, AV_PIX_FMT_YUV420P,
+                                           false, settings.threads, opt, EncodeProfile::OfflineThroughput);
+        av_dict_free(&opt);
+        return ret;
+    }
+
+    int ChunkedTranscoder::encodeChunk(const std::string& url,
+                                       const ParallelDecoder::Segment& segment,
+                                       const Settings& settings,
+                                       Chunk& chunk) {
+        MediaEncoder encoder;
+        int ret = openEncoder(encoder, settings);
+        if (ret < 0) {
+            return ret;
+        }
+
+        AVCodecContext* ctx = encoder.videoEncoder();
+
+        MediaResampler scaler;
+        bool scale = settings.srcW != ctx->width || settings.srcH != ctx->height || settings.srcFmt != ctx->pix_fmt;
+        if (scale) {
+            ret = scaler.configSwsContext(settings.srcW, settings.srcH, settings.srcFmt,
+                                          ctx->width, ctx->height, ctx->pix_fmt);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        int err = 0;
+        MediaEncoder::PacketCallback collect = [&chunk, &err](AVPacket* p) {
+            AVPacket* out = av_packet_alloc();
+            if (!out) {
+                err = AVERROR(ENOMEM);
+                return;
+            }
+            av_packet_move_ref(out, p);
+            chunk.packets.push_back(out);
+            };
+
+        auto receive = [&]() -> int {
+            for (;;) {
+                int r = encoder.receiveVideoPacket(pkt);
+                if (r == AVERROR(EAGAIN) || r == AVERROR_EOF) {
+                    return err;
+                }
+                if (r < 0) {
+                    return r;
+                }
+                collect(pkt);
+                av_packet_unref(pkt);
+            }
+            };
+
+        ret = ParallelDecoder::decodeSegment(url, segment, settings.threads, [&](AVFrame* frame) -> int {
+            AVFrame* in = frame;
+            AVFrame* scaled = nullptr;
+
+            if (scale) {
+                scaled = av_frame_alloc();
+                if (!scaled) {
+                    return AVERROR(ENOMEM);
+                }
+
+                scaled->format = ctx->pix_fmt;
+                scaled->width = ctx->width;
+                scaled->height = ctx->height;
+
+                int r = av_frame_get_buffer(scaled, 0);
+                if (r >= 0) {
+                    r = sws_scale(scaler.swsContext(), frame->data, frame->linesize, 0, frame->height,
+                                  scaled->data, scaled->linesize);
+                }
+                if (r >= 0) {
+                    r = av_frame_copy_props(scaled, frame);
+                }
+                if (r < 0) {
+                    av_frame_free(&scaled);
+                    return r;
+                }
+                in = scaled;
+            }
+
+            // Source picture types would otherwise be forced onto the encoder
+            in->pts = frame->best_effort_timestamp;
+            in->pict_type = AV_PICTURE_TYPE_NONE;
+
+            int r = encoder.sendVideoFrame(in);
+            av_frame_free(&scaled);
+            if (r < 0) {
+                return r;
+            }
+
+            return receive();
+            }, &stopped_);
+
+        if (ret >= 0 && !stopped_.load()) {
+            ret = encoder.flushVideoEncoder(collect);
+            if (ret >= 0) {
+                ret = err;
+            }
+        }
+
+        av_packet_free(&pkt);
+        return ret < 0 ? ret : 0;
+    }
+
+    int ChunkedTranscoder::writeChunk(MediaOutput& output, AVRational timebase, Chunk& chunk) {
+        AVStream* stream = output.videoStream();
+        int ret = 0;
+
+        for (AVPacket*& pkt : chunk.packets) {
+            if (ret >= 0 && pkt->dts != AV_NOPTS_VALUE) {
+                // Source audio up to this packet goes first, both share the source timeline
+                ret = writeAudio(output, av_rescale_q(pkt->dts, timebase, AV_TIME_BASE_Q));
+            }
+
+            if (ret >= 0) {
+                av_packet_rescale_ts(pkt, timebase, stream->time_base);
+                pkt->stream_index = output.videoIndex();
+
+                // B-frame reordering at the start of a chunk can pull dts back behind the
+                // previous chunk, the muxer needs it strictly increasing
+                if (pkt->dts != AV_NOPTS_VALUE) {
+                    if (lastDts_ != AV_NOPTS_VALUE && pkt->dts <= lastDts_) {
+                        pkt->dts = lastDts_ + 1;
+                        if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+                            pkt->pts = pkt->dts;
+                        }
+                    }
+                    lastDts_ = pkt->dts;
+                }
+
+                ret = output.writePacket(pkt);
+                if (ret >= 0) {
+                    packetCount_.fetch_add(1);
+                }
+            }
+
+            av_packet_free(&pkt);
+        }
+
+        chunk.packets.clear();
+        return ret < 0 ? ret : 0;
+    }
+
+    int ChunkedTranscoder::openAudio(const std::string& url) {
+        closeAudio();
+
+        // A reader of its own, the chunk workers seek their own contexts
+        int ret = audio_.openFileStream(url);
+        if (ret < 0) {
+            return ret;
+        }
+
+        AVFormatContext* ctx = audio_.inputContext();
+        for (unsigned int i = 0; i < ctx->nb_streams; ++i) {
+            if (static_cast<int>(i) != audio_.audioParams().index) {
+                ctx->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        audioPkt_ = av_packet_alloc();
+        if (!audioPkt_) {
+            audio_.reset();
+            return AVERROR(ENOMEM);
+        }
+
+        return 0;
+    }
+
+    int ChunkedTranscoder::writeAudio(MediaOutput& output, int64_t untilUs) {
+        if (!audioPkt_ || !audio_.inputContext()) {
+            return 0;
+        }
+
+        AVFormatContext* ctx = audio_.inputContext();
+        AVStream* stream = ctx->streams[audio_.audioParams().index];
+
+        for (;;) {
+            if (!audioPending_) {
+                int ret = av_read_frame(ctx, audioPkt_);
+                if (ret == AVERROR_EOF) {
+                    audio_.reset();
+                    return 0;
+                }
+                if (ret < 0) {
+                    return ret;
+                }
+
+                if (audioPkt_->stream_index != stream->index) {
+                    av_packet_unref(audioPkt_);
+                    continue;
+                }
+                audioPending_ = true;
+            }
+
+            // Held back until the video has caught up with it
+            int64_t ts = audioPkt_->dts != AV_NOPTS_VALUE ? audioPkt_->dts : audioPkt_->pts;
+            if (ts != AV_NOPTS_VALUE && av_rescale_q(ts, stream->time_base, AV_TIME_BASE_Q) > untilUs) {
+                return 0;
+            }
+
+            audioPending_ = false;
+            av_packet_rescale_ts(audioPkt_, stream->time_base, output.audioStream()->time_base);
+            audioPkt_->stream_index = output.audioIndex();
+
+            int ret = output.writePacket(audioPkt_);
+            av_packet_unref(audioPkt_);
+            if (ret < 0) {
+                return ret;
+            }
+            packetCount_.fetch_add(1);
+        }
+    }
+
+    void ChunkedTranscoder::closeAudio() {
+        av_packet_free(&audioPkt_);
+        audioPending_ = false;
+        audio_.reset();
+    }
+
+    void ChunkedTranscoder::clearChunks() {
+        std::lock_guard<std::mutex> locker(mutex_);
+        for (Chunk& chunk : chunks_) {
+            for (AVPacket*& pkt : chunk.packets) {
+                av_packet_free(&pkt);
+            }
+        }
+        chunks_.clear();
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <condition_variable>
+#include "FFmpeg.h"
+#include "MediaInput.h"
+#include "MediaOutput.h"
+#include "MediaEncoder.h"
+#include "ParallelDecoder.h"
+
+namespace media {
+
+    class ChunkedTranscoder {
+    public:
+        ChunkedTranscoder(const ChunkedTranscoder&) = delete;
+        ChunkedTranscoder& operator=(const ChunkedTranscoder&) = delete;
+        ChunkedTranscoder(ChunkedTranscoder&&) = delete;
+        ChunkedTranscoder& operator=(ChunkedTranscoder&&) = delete;
+
+        ChunkedTranscoder();
+        ~ChunkedTranscoder();
+
+        // Transcode file (input, output, format, codecid, width, height, bitrate, workers) >= 0, blocks until done
+        // The source is cut at keyframes, every chunk is decoded and encoded on its own thread with
+        // closed GOPs and identical settings, packets are muxed in chunk order with source timestamps;
+        // the source audio track is stream copied and interleaved with the video by dts
+        // width/height 0 = source size, workers 0 = one per core
+        int transcodeFile(const std::string& input,
+                          const std::string& output,
+                          const std::string& format,
+                          AVCodecID codecid,
+                          int width = 0,
+                          int height = 0,
+                          int64_t bitrate = 0,
+                          unsigned int workers = 0);
+
+        // Stop a running transcodeFile from another thread
+        void stop();
+
+        int chunkCount()      const { return chunkCount_.load(); }
+        int chunksWritten()   const { return chunksWritten_.load(); }
+        int64_t packetCount() const { return packetCount_.load(); }
+
+    private:
+        struct Settings {
+            AVCodecID codecid = AV_CODEC_ID_NONE;
+            int width = 0;
+            int height = 0;
+            int64_t bitrate = 0;
+            int srcW = 0;
+            int srcH = 0;
+            AVPixelFormat srcFmt = AV_PIX_FMT_NONE;
+            AVRational timebase = { 0, 0 };
+            AVRational framerate = { 0, 0 };
+            unsigned int threads = 1;
+        };
+
+        struct Chunk {
+            std::vector<AVPacket*> packets;
+            bool done = false;
+            int error = 0;
+        };
+
+        static int openEncoder(MediaEncoder& encoder, const Settings& settings);
+        int encodeChunk(const std::string& url, const ParallelDecoder::Segment& segment,
+                        const Settings& settings, Chunk& chunk);
+        int writeChunk(MediaOutput& output, AVRational timebase, Chunk& chunk);
+        int openAudio(const std::string& url);
+        // Copy source audio up to untilUs (source timeline) >= 0
+        int writeAudio(MediaOutput& output, int64_t untilUs);
+        void closeAudio();
+        void clearChunks();
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::atomic<bool> stopped_;
+        std::atomic<int> chunkCount_;
+        std::atomic<int> chunksWritten_;
+        std::atomic<int64_t> packetCount_;
+
+        int64_t lastDts_;
+        std::vector<Chunk> chunks_;
+
+        // Source audio reader, audioPkt_ holds the next packet while audioPending_
+        MediaInput audio_;
+        AVPacket* audioPkt_;
+        bool audioPending_;
+    };
+
+} // namespace media
\ No newline at end of file
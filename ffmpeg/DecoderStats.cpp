@@ -0,0 +1,185 @@
+#include "DecoderStats.h"
+
+namespace media {
+
+    DecoderStats::DecoderStats() {
+        reset();
+    }
+
+    DecoderStats::~DecoderStats() {}
+
+    void DecoderStats::setHW(bool requested, bool active) {
+        hwRequested_.store(requested, std::memory_order_relaxed);
+        hwActive_.store(active, std::memory_order_relaxed);
+    }
+
+    void DecoderStats::addPacket(const AVPacket* pkt) {
+        if (!pkt) {
+            return;
+        }
+
+        packets_.fetch_add(1, std::memory_order_relaxed);
+
+        if (pkt->flags & AV_PKT_FLAG_DISCARD) {
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void DecoderStats::addFrame(const AVFrame* frame, int64_t decodeUs, AVPixelFormat hwFormat) {
+        if (!frame) {
+            return;
+        }
+
+        int64_t now = av_gettime_relative();
+        int64_t expected = 0;
+        firstFrameTime_.compare_exchange_strong(expected, now, std::memory_order_relaxed);
+        lastFrameTime_.store(now, std::memory_order_relaxed);
+
+        frames_.fetch_add(1, std::memory_order_relaxed);
+
+        if (hwFormat != AV_PIX_FMT_NONE && frame->format == hwFormat) {
+            hwFrames_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (frame->flags & AV_FRAME_FLAG_DISCARD) {
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (frame->flags & AV_FRAME_FLAG_CORRUPT) {
+            corrupt_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (frame->decode_error_flags & FF_DECODE_ERROR_CONCEALMENT_ACTIVE) {
+            concealed_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (decodeUs < 0) {
+            decodeUs = 0;
+        }
+
+        totalUs_.fetch_add(decodeUs, std::memory_order_relaxed);
+        buckets_[bucketIndex(decodeUs)].fetch_add(1, std::memory_order_relaxed);
+
+        // Single writer, a plain compare is enough
+        if (decodeUs > maxUs_.load(std::memory_order_relaxed)) {
+            maxUs_.store(decodeUs, std::memory_order_relaxed);
+        }
+    }
+
+    void DecoderStats::addError() {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void DecoderStats::addDropped(int64_t count) {
+        dropped_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void DecoderStats::reset() {
+        packets_.store(0);
+        frames_.store(0);
+        hwFrames_.store(0);
+        dropped_.store(0);
+        skipped_.store(0);
+        errors_.store(0);
+        corrupt_.store(0);
+        concealed_.store(0);
+        hwRequested_.store(false);
+        hwActive_.store(false);
+        firstFrameTime_.store(0);
+        lastFrameTime_.store(0);
+        totalUs_.store(0);
+        maxUs_.store(0);
+
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            buckets_[i].store(0);
+        }
+    }
+
+    DecoderStatsSnapshot DecoderStats::snapshot() const {
+        DecoderStatsSnapshot s;
+        s.packets = packets_.load(std::memory_order_relaxed);
+        s.frames = frames_.load(std::memory_order_relaxed);
+        s.hwFrames = hwFrames_.load(std::memory_order_relaxed);
+        s.dropped = dropped_.load(std::memory_order_relaxed);
+        s.skipped = skipped_.load(std::memory_order_relaxed);
+        s.errors = errors_.load(std::memory_order_relaxed);
+        s.corrupt = corrupt_.load(std::memory_order_relaxed);
+        s.concealed = concealed_.load(std::memory_order_relaxed);
+        s.hwRequested = hwRequested_.load(std::memory_order_relaxed);
+        s.hwActive = hwActive_.load(std::memory_order_relaxed);
+
+        int64_t first = firstFrameTime_.load(std::memory_order_relaxed);
+        int64_t last = lastFrameTime_.load(std::memory_order_relaxed);
+        if (s.frames > 1 && last > first) {
+            s.fps = (s.frames - 1) * 1000000.0 / (last - first);
+        }
+
+        if (s.frames > 0) {
+            s.meanUs = static_cast<double>(totalUs_.load(std::memory_order_relaxed)) / s.frames;
+        }
+
+        s.p50Us = percentile(50.0);
+        s.p90Us = percentile(90.0);
+        s.p99Us = percentile(99.0);
+        s.maxUs = maxUs_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    int64_t DecoderStats::percentile(double p) const {
+        int64_t total = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            total += buckets_[i].load(std::memory_order_relaxed);
+        }
+
+        if (total == 0) {
+            return 0;
+        }
+
+        int64_t target = static_cast<int64_t>(total * p / 100.0 + 0.5);
+        if (target < 1) {
+            target = 1;
+        }
+
+        int64_t count = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            count += buckets_[i].load(std::memory_order_relaxed);
+            if (count >= target) {
+                return bucketValue(i);
+            }
+        }
+
+        return bucketValue(BUCKET_COUNT - 1);
+    }
+
+    int DecoderStats::bucketIndex(int64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<int>(value);
+        }
+
+        int magnitude = SUB_BUCKET_BITS;
+        while (magnitude < MAX_MAGNITUDE && (value >> (magnitude + 1)) != 0) {
+            ++magnitude;
+        }
+
+        if ((value >> (magnitude + 1)) != 0) {
+            return BUCKET_COUNT - 1;
+        }
+
+        int shift = magnitude - SUB_BUCKET_BITS;
+        int sub = static_cast<int>(value >> shift) - SUB_BUCKETS;
+        return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    int64_t DecoderStats::bucketValue(int index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+
+        int shift = index / SUB_BUCKETS - 1;
+        int64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+
+        // Middle of the bucket
+        return (sub << shift) + ((int64_t(1) << shift) >> 1);
+    }
+
+} // namespace media
\ No newline at end of file
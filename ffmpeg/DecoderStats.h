@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include "FFmpeg.h"
+
+namespace media {
+
+    struct DecoderStatsSnapshot {
+        int64_t packets = 0;
+        int64_t frames = 0;
+        // Frames decoded on the HW device (frame format == HW pixel format)
+        int64_t hwFrames = 0;
+        // Frames the consumer dropped (addDropped)
+        int64_t dropped = 0;
+        // Discarded packets and frames flagged AV_FRAME_FLAG_DISCARD
+        int64_t skipped = 0;
+        // avcodec_send_packet/avcodec_receive_frame failures
+        int64_t errors = 0;
+        // Frames flagged AV_FRAME_FLAG_CORRUPT
+        int64_t corrupt = 0;
+        // Frames with error concealment applied
+        int64_t concealed = 0;
+
+        bool hwRequested = false;
+        bool hwActive = false;
+
+        // Frames per second over the wall time between the first and the last frame
+        double fps = 0.0;
+
+        // Per-frame decode time in microseconds (time spent in libavcodec between two output frames)
+        double meanUs = 0.0;
+        int64_t p50Us = 0;
+        int64_t p90Us = 0;
+        int64_t p99Us = 0;
+        int64_t maxUs = 0;
+    };
+
+    class DecoderStats {
+    public:
+        DecoderStats(const DecoderStats&) = delete;
+        DecoderStats& operator=(const DecoderStats&) = delete;
+        DecoderStats(DecoderStats&&) = delete;
+        DecoderStats& operator=(DecoderStats&&) = delete;
+
+        // Log-linear histogram: 32 linear sub-buckets per power of two (~3% precision), up to 2^30 us
+        static constexpr int SUB_BUCKET_BITS = 5;
+        static constexpr int SUB_BUCKETS     = 1 << SUB_BUCKET_BITS;
+        static constexpr int MAX_MAGNITUDE   = 30;
+        static constexpr int BUCKET_COUNT    = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+        DecoderStats();
+        ~DecoderStats();
+
+        // Called by the decoding thread
+        void setHW(bool requested, bool active);
+        void addPacket(const AVPacket* pkt);
+        void addFrame(const AVFrame* frame, int64_t decodeUs, AVPixelFormat hwFormat);
+        void addError();
+
+        // Called by consumers that drop decoded frames (late, queue full)
+        void addDropped(int64_t count = 1);
+
+        // Reset all counters (not concurrent with the decoding thread)
+        void reset();
+
+        // Safe from any thread
+        DecoderStatsSnapshot snapshot() const;
+        int64_t percentile(double p) const;
+
+    private:
+        static int bucketIndex(int64_t value);
+        static int64_t bucketValue(int index);
+
+    private:
+        std::atomic<int64_t> packets_;
+        std::atomic<int64_t> frames_;
+        std::atomic<int64_t> hwFrames_;
+        std::atomic<int64_t> dropped_;
+        std::atomic<int64_t> skipped_;
+        std::atomic<int64_t> errors_;
+        std::atomic<int64_t> corrupt_;
+        std::atomic<int64_t> concealed_;
+
+        std::atomic<bool> hwRequested_;
+        std::atomic<bool> hwActive_;
+
+        std::atomic<int64_t> firstFrameTime_;
+        std::atomic<int64_t> lastFrameTime_;
+
+        std::atomic<int64_t> totalUs_;
+        std::atomic<int64_t> maxUs_;
+        std::atomic<int64_t> buckets_[BUCKET_COUNT];
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "EncodeStage.h"
+
+namespace media {
+
+    EncodeStage::EncodeStage()
+        : encoder_(nullptr)
+        , video_(true)
+        , input_(nullptr)
+        , output_(nullptr)
+        , timebase_({ 0, 0 })
+        , index_(-1)
+        , pkt_(nullptr)
+        , running_(false)
+        , frames_(0)
+        , packets_(0)
+        , bytes_(0)
+        , startTime_(0)
+        , lastTime_(0)
+        , firstPts_(AV_NOPTS_VALUE)
+        , lastPts_(AV_NOPTS_VALUE)
+        , error_(0) {
+    }
+
+    EncodeStage::~EncodeStage() {
+        stop();
+    }
+
+    int EncodeStage::start(MediaEncoder* encoder,
+                           bool video,
+                           FrameQueue* input,
+                           PacketQueue* output,
+                           AVRational timebase,
+                           int index) {
+        if (!encoder || !input || !output || timebase.num <= 0 || timebase.den <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (video ? !encoder->videoEncoder() : !encoder->audioEncoder()) {
+            return AVERROR(EINVAL);
+        }
+
+        if (running_.load()) {
+            return AVERROR(EBUSY);
+        }
+
+        wait();
+
+        pkt_ = av_packet_alloc();
+        if (!pkt_) {
+            return AVERROR(ENOMEM);
+        }
+
+        encoder_ = encoder;
+        video_ = video;
+        input_ = input;
+        output_ = output;
+        timebase_ = timebase;
+        index_ = index;
+
+        frames_.store(0);
+        packets_.store(0);
+        bytes_.store(0);
+        startTime_.store(av_gettime_relative());
+        lastTime_.store(startTime_.load());
+        firstPts_.store(AV_NOPTS_VALUE);
+        lastPts_.store(AV_NOPTS_VALUE);
+        error_.store(0);
+
+        running_.store(true);
+        thread_ = std::thread(&EncodeStage::encodeThread, this);
+        return 0;
+    }
+
+    int EncodeStage::finish() {
+        if (!running_.load() || !input_) {
+            return AVERROR(EINVAL);
+        }
+
+        AVFrame* eos = av_frame_alloc();
+        if (!eos) {
+            return AVERROR(ENOMEM);
+        }
+
+        if (!input_->enqueue(eos)) {
+            av_frame_free(&eos);
+            return AVERROR(EINVAL);
+        }
+
+        return 0;
+    }
+
+    void EncodeStage::wait() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        // The queues belong to the caller and may go away once the thread is done
+        input_ = nullptr;
+        output_ = nullptr;
+
+        if (pkt_) {
+            av_packet_free(&pkt_);
+        }
+    }
+
+    void EncodeStage::stop() {
+        running_.store(false);
+
+        FrameQueue* input = input_;
+        PacketQueue* output = output_;
+
+        // Wakes the thread whether it waits for a frame or for room in a full output queue
+        if (input) {
+            input->lock();
+        }
+        if (output) {
+            output->lock();
+        }
+
+        wait();
+
+        // The input is handed back empty and usable; the output stays locked, its reader sees
+        // the end of the packets
+        if (input) {
+            while (AVFrame* frame = input->tryDequeue()) {
+                av_frame_free(&frame);
+            }
+            input->unlock();
+        }
+    }
+
+    EncodeStageStats EncodeStage::stats() const {
+        EncodeStageStats s;
+        s.frames = frames_.load();
+        s.packets = packets_.load();
+        s.bytes = bytes_.load();
+        s.error = error_.load();
+
+        int64_t elapsed = lastTime_.load() - startTime_.load();
+        if (elapsed > 0) {
+            s.fps = s.frames * 1000000.0 / elapsed;
+        }
+
+        int64_t firstPts = firstPts_.load();
+        int64_t lastPts = lastPts_.load();
+        if (firstPts != AV_NOPTS_VALUE && lastPts > firstPts && timebase_.den > 0) {
+            s.bitrate = s.bytes * 8.0 / ((lastPts - firstPts) * av_q2d(timebase_));
+        }
+
+        return s;
+    }
+
+    void EncodeStage::encodeThread() {
+        while (running_.load()) {
+            AVFrame* frame = input_->dequeue();
+            if (!frame) {
+                break;
+            }
+
+            if (isEndOfStream(frame)) {
+                av_frame_free(&frame);
+
+                MediaEncoder::PacketCallback callback = [this](AVPacket* pkt) {
+                    deliverPacket(pkt);
+                    };
+
+                int ret = video_ ? encoder_->flushVideoEncoder(callback) : encoder_->flushAudioEncoder(callback);
+                if (ret < 0) {
+                    error_.store(ret);
+                }
+                break;
+            }
+
+            int ret = sendFrame(frame);
+            av_frame_free(&frame);
+
+            if (ret < 0) {
+                error_.store(ret);
+                continue;
+            }
+
+            frames_.fetch_add(1);
+
+            ret = receivePackets();
+            if (ret < 0) {
+                error_.store(ret);
+            }
+        }
+
+        running_.store(false);
+    }
+
+    int EncodeStage::sendFrame(const AVFrame* frame) {
+        return video_ ? encoder_->sendVideoFrame(frame) : encoder_->sendAudioFrame(frame);
+    }
+
+    int EncodeStage::receivePackets() {
+        for (;;) {
+            int ret = video_ ? encoder_->receiveVideoPacket(pkt_) : encoder_->receiveAudioPacket(pkt_);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return 0;
+            }
+            if (ret < 0) {
+                return ret;
+            }
+
+            ret = deliverPacket(pkt_);
+            av_packet_unref(pkt_);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    int EncodeStage::deliverPacket(AVPacket* pkt) {
+        AVCodecContext* ctx = video_ ? encoder_->videoEncoder() : encoder_->audioEncoder();
+
+        av_packet_rescale_ts(pkt, ctx->time_base, timebase_);
+        pkt->stream_index = index_;
+
+        packets_.fetch_add(1);
+        bytes_.fetch_add(pkt->size);
+        lastTime_.store(av_gettime_relative());
+
+        // Packets leave in decode order, with B-frames pts goes back and forth
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            if (firstPts_.load() == AV_NOPTS_VALUE || pkt->pts < firstPts_.load()) {
+                firstPts_.store(pkt->pts);
+            }
+            if (lastPts_.load() == AV_NOPTS_VALUE || pkt->pts + pkt->duration > lastPts_.load()) {
+                lastPts_.store(pkt->pts + pkt->duration);
+            }
+        }
+
+        AVPacket* out = av_packet_alloc();
+        if (!out) {
+            return AVERROR(ENOMEM);
+        }
+
+        av_packet_move_ref(out, pkt);
+        if (!output_->enqueue(out)) {
+            av_packet_free(&out);
+            return AVERROR_EXIT;
+        }
+
+        return 0;
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "FFmpeg.h"
+#include "MediaEncoder.h"
+#include "../queue/MediaQueue.h"
+
+namespace media {
+
+    struct EncodeStageStats {
+        int64_t frames = 0;
+        int64_t packets = 0;
+        int64_t bytes = 0;
+        // Encoded frames per second of wall time
+        double fps = 0.0;
+        // Output bits per second of media time
+        double bitrate = 0.0;
+        // Last encoder error (0 = none)
+        int error = 0;
+    };
+
+    class EncodeStage {
+    public:
+        EncodeStage(const EncodeStage&) = delete;
+        EncodeStage& operator=(const EncodeStage&) = delete;
+        EncodeStage(EncodeStage&&) = delete;
+        EncodeStage& operator=(EncodeStage&&) = delete;
+
+        using FrameQueue = MediaQueue<AVFrame>;
+        using PacketQueue = MediaQueue<AVPacket>;
+
+        EncodeStage();
+        ~EncodeStage();
+
+        // Start encode thread (encoder, video, input, output, timebase, index) >= 0
+        // Input frames carry pts in the encoder time_base, output packets are rescaled to
+        // timebase (the muxer stream time_base) and tagged with stream index
+        int start(MediaEncoder* encoder,
+                  bool video,
+                  FrameQueue* input,
+                  PacketQueue* output,
+                  AVRational timebase,
+                  int index);
+
+        // Signal end of stream, the thread drains the encoder and exits
+        int finish();
+        // Wait for the thread to exit (after finish), the stage no longer touches the queues afterwards
+        void wait();
+        // Stop immediately, also when blocked on a full output queue; buffered input frames are
+        // dropped, the input queue is left unlocked and the output queue locked
+        void stop();
+
+        // A frame without buffers marks end of stream on the input queue
+        static bool isEndOfStream(const AVFrame* frame) { return frame && !frame->buf[0] && !frame->hw_frames_ctx; }
+
+        bool isRunning() const { return running_.load(); }
+        EncodeStageStats stats() const;
+
+    private:
+        void encodeThread();
+        int sendFrame(const AVFrame* frame);
+        int receivePackets();
+        int deliverPacket(AVPacket* pkt);
+
+    private:
+        MediaEncoder* encoder_;
+        bool video_;
+        FrameQueue* input_;
+        PacketQueue* output_;
+        AVRational timebase_;
+        int index_;
+        AVPacket* pkt_;
+
+        std::thread thread_;
+        std::atomic<bool> running_;
+
+        std::atomic<int64_t> frames_;
+        std::atomic<int64_t> packets_;
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> startTime_;
+        std::atomic<int64_t> lastTime_;
+        std::atomic<int64_t> firstPts_;
+        std::atomic<int64_t> lastPts_;
+        std::atomic<int> error_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include <cstring>
+#include "EncoderSwitcher.h"
+
+namespace media {
+
+    EncoderSwitcher::EncoderSwitcher()
+        : encoder_(nullptr)
+        , switching_(false)
+        , pending_(nullptr)
+        , pendingDone_(false)
+        , switchError_(0)
+        , switchCount_(0)
+        , scalerSrcW_(0)
+        , scalerSrcH_(0)
+        , scalerSrcFmt_(AV_PIX_FMT_NONE)
+        , scalerDstW_(0)
+        , scalerDstH_(0)
+        , pkt_(nullptr)
+        , newExtradata_(false)
+        , lastDts_(AV_NOPTS_VALUE) {
+    }
+
+    EncoderSwitcher::~EncoderSwitcher() {
+        reset();
+    }
+
+    int EncoderSwitcher::open(AVCodecID codecid,
+                              int width,
+                              int height,
+                              int64_t bitrate,
+                              AVRational timebase,
+                              AVRational framerate,
+                              AVPixelFormat pixfmt,
+                              bool useHW,
+                              unsigned int threads,
+                              EncodeProfile profile) {
+        if (codecid == AV_CODEC_ID_NONE || width <= 0 || height <= 0 || pixfmt == AV_PIX_FMT_NONE) {
+            return AVERROR(EINVAL);
+        }
+
+        reset();
+
+        settings_.codecid = codecid;
+        settings_.width = width;
+        settings_.height = height;
+        settings_.bitrate = bitrate;
+        settings_.timebase = timebase;
+        settings_.framerate = framerate;
+        settings_.pixfmt = pixfmt;
+        settings_.useHW = useHW;
+        settings_.threads = threads;
+        settings_.profile = profile;
+
+        pkt_ = av_packet_alloc();
+        if (!pkt_) {
+            return AVERROR(ENOMEM);
+        }
+
+        std::unique_ptr<MediaEncoder> encoder(new MediaEncoder());
+        int ret = openEncoder(*encoder, settings_);
+        if (ret < 0) {
+            reset();
+            return ret;
+        }
+
+        encoder_ = std::move(encoder);
+        return 0;
+    }
+
+    int EncoderSwitcher::switchTo(int width, int height, int64_t bitrate) {
+        if (!encoder_ || width <= 0 || height <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (switching_.load()) {
+            return AVERROR(EBUSY);
+        }
+
+        pendingSettings_ = settings_;
+        pendingSettings_.width = width;
+        pendingSettings_.height = height;
+        if (bitrate > 0) {
+            pendingSettings_.bitrate = bitrate;
+        }
+
+        pending_.reset(new MediaEncoder());
+        pendingDone_.store(false);
+        switchError_.store(0);
+        switching_.store(true);
+
+        // Opening can take tens of milliseconds (HW sessions, lookahead buffers), keep it
+        // off the encode thread
+        openThread_ = std::thread([this]() {
+            int ret = openEncoder(*pending_, pendingSettings_);
+            if (ret < 0) {
+                switchError_.store(ret);
+            }
+            pendingDone_.store(true);
+            });
+
+        return 0;
+    }
+
+    int EncoderSwitcher::encodeFrame(const AVFrame* frame, const PacketCallback& callback) {
+        if (!encoder_ || !frame) {
+            return AVERROR(EINVAL);
+        }
+
+        if (switching_.load() && pendingDone_.load()) {
+            int ret = completeSwitch(callback);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        AVCodecContext* ctx = encoder_->videoEncoder();
+        AVFrame* scaled = nullptr;
+        const AVFrame* in = frame;
+
+        if (frame->width != ctx->width || frame->height != ctx->height || frame->format != ctx->pix_fmt) {
+            scaled = av_frame_alloc();
+            if (!scaled) {
+                return AVERROR(ENOMEM);
+            }
+
+            int ret = scaleFrame(frame, scaled);
+            if (ret < 0) {
+                av_frame_free(&scaled);
+                return ret;
+            }
+            in = scaled;
+        }
+
+        int ret = encoder_->sendVideoFrame(in);
+        av_frame_free(&scaled);
+        if (ret < 0) {
+            return ret;
+        }
+
+        return receivePackets(callback);
+    }
+
+    int EncoderSwitcher::flush(const PacketCallback& callback) {
+        if (!encoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        return encoder_->flushVideoEncoder([this, &callback](AVPacket* pkt) {
+            deliverPacket(pkt, callback);
+            });
+    }
+
+    void EncoderSwitcher::reset() {
+        if (openThread_.joinable()) {
+            openThread_.join();
+        }
+
+        pending_.reset();
+        encoder_.reset();
+        switching_.store(false);
+        pendingDone_.store(false);
+        switchError_.store(0);
+        switchCount_.store(0);
+
+        scaler_.resetSwsContext();
+        scalerSrcW_ = 0;
+        scalerSrcH_ = 0;
+        scalerSrcFmt_ = AV_PIX_FMT_NONE;
+        scalerDstW_ = 0;
+        scalerDstH_ = 0;
+
+        if (pkt_) {
+            av_packet_free(&pkt_);
+        }
+
+        newExtradata_ = false;
+        lastDts_ = AV_NOPTS_VALUE;
+        settings_ = Settings();
+        pendingSettings_ = Settings();
+    }
+
+    int EncoderSwitcher::openEncoder(MediaEncoder& encoder, const Settings& settings) {
+        return encoder.openVideoEncoder(settings.codecid, settings.width, settings.height, settings.bitrate,
+                                        settings.timebase, settings.framerate, settings.pixfmt,
+                                        settings.useHW, settings.threads, nullptr, settings.profile);
+    }
+
+    int EncoderSwitcher::completeSwitch(const PacketCallback& callback) {
+        if (openThread_.joinable()) {
+            openThread_.join();
+        }
+
+        switching_.store(false);
+
+        if (switchError_.load() < 0) {
+            pending_.reset();
+            return 0;
+        }
+
+        // Drain the old GOP completely so the new encoder's IDR is the switch point
+        int ret = flush(callback);
+        if (ret < 0) {
+            pending_.reset();
+            return ret;
+        }
+
+        encoder_ = std::move(pending_);
+        settings_ = pendingSettings_;
+        newExtradata_ = encoder_->videoEncoder()->extradata_size > 0;
+        switchCount_.fetch_add(1);
+        return 0;
+    }
+
+    int EncoderSwitcher::scaleFrame(const AVFrame* src, AVFrame* dst) {
+        AVCodecContext* ctx = encoder_->videoEncoder();
+
+        if (!scaler_.swsContext() || scalerSrcW_ != src->width || scalerSrcH_ != src->height
+            || scalerSrcFmt_ != src->format || scalerDstW_ != ctx->width || scalerDstH_ != ctx->height) {
+            int ret = scaler_.configSwsContext(src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                               ctx->width, ctx->height, ctx->pix_fmt);
+            if (ret < 0) {
+                return ret;
+            }
+
+            scalerSrcW_ = src->width;
+            scalerSrcH_ = src->height;
+            scalerSrcFmt_ = static_cast<AVPixelFormat>(src->format);
+            scalerDstW_ = ctx->width;
+            scalerDstH_ = ctx->height;
+        }
+
+        dst->format = ctx->pix_fmt;
+        dst->width = ctx->width;
+        dst->height = ctx->height;
+
+        int ret = av_frame_get_buffer(dst, 0);
+        if (ret < 0) {
+            return ret;
+        }
+
+        ret = sws_scale(scaler_.swsContext(), src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+        if (ret < 0) {
+            return ret;
+        }
+
+        return av_frame_copy_props(dst, src);
+    }
+
+    int EncoderSwitcher::receivePackets(const PacketCallback& callback) {
+        for (;;) {
+            int ret = encoder_->receiveVideoPacket(pkt_);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return 0;
+            }
+            if (ret < 0) {
+                return ret;
+            }
+
+            deliverPacket(pkt_, callback);
+            av_packet_unref(pkt_);
+        }
+    }
+
+    void EncoderSwitcher::deliverPacket(AVPacket* pkt, const PacketCallback& callback) {
+        if (newExtradata_) {
+            AVCodecContext* ctx = encoder_->videoEncoder();
+
+            // Global-header encoders (libx264, libx265) keep SPS/PPS out of band; Annex B muxers such
+            // as mpegts only repeat the stream's original extradata, so the new sets go in band
+            if (ctx->extradata[0] == 0) {
+                AVPacket* merged = av_packet_alloc();
+                if (merged && av_new_packet(merged, ctx->extradata_size + pkt->size) >= 0
+                    && av_packet_copy_props(merged, pkt) >= 0) {
+                    std::memcpy(merged->data, ctx->extradata, ctx->extradata_size);
+                    std::memcpy(merged->data + ctx->extradata_size, pkt->data, pkt->size);
+                    av_packet_unref(pkt);
+                    av_packet_move_ref(pkt, merged);
+                }
+                av_packet_free(&merged);
+            }
+
+            // FLV and decoders pick up the new SPS/PPS from the side data
+            uint8_t* data = av_packet_new_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA, ctx->extradata_size);
+            if (data) {
+                std::memcpy(data, ctx->extradata, ctx->extradata_size);
+            }
+            newExtradata_ = false;
+        }
+
+        // The new encoder's reorder delay can pull dts behind the old encoder's last packet
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            if (lastDts_ != AV_NOPTS_VALUE && pkt->dts <= lastDts_) {
+                pkt->dts = lastDts_ + 1;
+                if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+                    pkt->pts = pkt->dts;
+                }
+            }
+            lastDts_ = pkt->dts;
+        }
+
+        if (callback) {
+            callback(pkt);
+        }
+    }
+
+} // namespace media
\ No newline at end of file
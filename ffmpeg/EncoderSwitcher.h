@@ -0,0 +1,106 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include "FFmpeg.h"
+#include "MediaEncoder.h"
+#include "MediaResampler.h"
+
+namespace media {
+
+    class EncoderSwitcher {
+    public:
+        EncoderSwitcher(const EncoderSwitcher&) = delete;
+        EncoderSwitcher& operator=(const EncoderSwitcher&) = delete;
+        EncoderSwitcher(EncoderSwitcher&&) = delete;
+        EncoderSwitcher& operator=(EncoderSwitcher&&) = delete;
+
+        using PacketCallback = MediaEncoder::PacketCallback;
+
+        EncoderSwitcher();
+        ~EncoderSwitcher();
+
+        // Open first video encoder (codecid, width, height, bitrate, timebase, framerate, pixfmt, useHW, threads, profile) >= 0
+        // Open MediaOutput with encoder()->videoEncoder(), it stays valid across switches
+        int open(AVCodecID codecid,
+                 int width,
+                 int height,
+                 int64_t bitrate,
+                 AVRational timebase,
+                 AVRational framerate,
+                 AVPixelFormat pixfmt,
+                 bool useHW = false,
+                 unsigned int threads = 0,
+                 EncodeProfile profile = EncodeProfile::Default);
+
+        // Switch encoder (width, height, bitrate = 0 keep) >= 0, opens the new encoder in the background
+        // Until it is ready frames are scaled to the current encoder, then the current one is drained
+        // and the new one starts with an IDR frame; codec, time_base and profile are kept
+        // Call on the encode thread: switchTo, encodeFrame, flush and reset are not synchronized
+        // with each other; isSwitching, switchCount and switchError can be read from any thread
+        int switchTo(int width, int height, int64_t bitrate = 0);
+
+        // Encode video frame (frame, callback) >= 0, any frame size, packets in the encoder time_base
+        // The first packet after a switch carries the new extradata as AV_PKT_DATA_NEW_EXTRADATA and,
+        // for Annex B encoders, in band in front of the IDR
+        int encodeFrame(const AVFrame* frame, const PacketCallback& callback);
+        // Flush encoder (callback) >= 0
+        int flush(const PacketCallback& callback);
+
+        // Reset switcher
+        void reset();
+
+        bool isSwitching()     const { return switching_.load(); }
+        int switchCount()      const { return switchCount_.load(); }
+        // Last failed background open (0 = none), the current encoder keeps running
+        int switchError()      const { return switchError_.load(); }
+        AVRational timebase()  const { return settings_.timebase; }
+        MediaEncoder* encoder() const { return encoder_.get(); }
+
+    private:
+        struct Settings {
+            AVCodecID codecid = AV_CODEC_ID_NONE;
+            int width = 0;
+            int height = 0;
+            int64_t bitrate = 0;
+            AVRational timebase = { 0, 0 };
+            AVRational framerate = { 0, 0 };
+            AVPixelFormat pixfmt = AV_PIX_FMT_NONE;
+            bool useHW = false;
+            unsigned int threads = 0;
+            EncodeProfile profile = EncodeProfile::Default;
+        };
+
+        static int openEncoder(MediaEncoder& encoder, const Settings& settings);
+        int completeSwitch(const PacketCallback& callback);
+        int scaleFrame(const AVFrame* src, AVFrame* dst);
+        int receivePackets(const PacketCallback& callback);
+        void deliverPacket(AVPacket* pkt, const PacketCallback& callback);
+
+    private:
+        Settings settings_;
+        std::unique_ptr<MediaEncoder> encoder_;
+
+        std::atomic<bool> switching_;
+        Settings pendingSettings_;
+        std::unique_ptr<MediaEncoder> pending_;
+        std::thread openThread_;
+        std::atomic<bool> pendingDone_;
+        std::atomic<int> switchError_;
+        std::atomic<int> switchCount_;
+
+        MediaResampler scaler_;
+        int scalerSrcW_;
+        int scalerSrcH_;
+        AVPixelFormat scalerSrcFmt_;
+        int scalerDstW_;
+        int scalerDstH_;
+
+        AVPacket* pkt_;
+        bool newExtradata_;
+        int64_t lastDts_;
+    };
+
+} // namespace media
\ No newline at end of file
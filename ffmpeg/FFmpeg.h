@@ -10,6 +10,7 @@ extern "C" {
 
 // Libavcodec
 #include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
 
 // Libswscale
 #include <libswscale/swscale.h>
@@ -26,6 +27,7 @@ extern "C" {
 #include <libavutil/opt.h>
 #include <libavutil/time.h>
 #include <libavutil/fifo.h>
+#include <libavutil/audio_fifo.h>
 #include <libavutil/error.h>
 #include <libavutil/avutil.h>
 #include <libavutil/bprint.h>
@@ -34,6 +36,7 @@ extern "C" {
 #include <libavutil/samplefmt.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
 
 }
 
@@ -0,0 +1,545 @@
+#include <cstring>
+#include <fcntl.h>
+#include <algorithm>
+#if defined(_WIN32)
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <cstdlib>
+#endif
+// io_uring is opt-in: build with -DFILESINK_USE_URING and link -luring (liburing)
+#if defined(__linux__) && defined(FILESINK_USE_URING)
+#include <liburing.h>
+#define FILESINK_HAVE_URING 1
+#endif
+#include "FileSink.h"
+
+namespace media {
+
+    // Staging size for the AVIOContext in front of the large buffers
+    static constexpr int IO_BUFFER_SIZE = 256 * 1024;
+
+    static uint8_t* sink_aligned_alloc(size_t size) {
+#if defined(_WIN32)
+        return static_cast<uint8_t*>(_aligned_malloc(size, FileSink::ALIGNMENT));
+#else
+        void* data = nullptr;
+        if (posix_memalign(&data, FileSink::ALIGNMENT, size) != 0) {
+            return nullptr;
+        }
+        return static_cast<uint8_t*>(data);
+#endif
+    }
+
+    static void sink_aligned_free(uint8_t* data) {
+#if defined(_WIN32)
+        _aligned_free(data);
+#else
+        free(data);
+#endif
+    }
+
+    FileSink::FileSink()
+        : running_(false)
+        , fd_(-1)
+        , directFd_(-1)
+        , bufferSize_(0)
+        , current_(nullptr)
+        , ring_(nullptr)
+        , position_(0)
+        , size_(0)
+        , ioCtx_(nullptr)
+        , bytes_(0)
+        , writes_(0)
+        , directWrites_(0)
+        , ringWrites_(0)
+        , writeUs_(0)
+        , waitUs_(0)
+        , error_(0) {
+    }
+
+    FileSink::~FileSink() {
+        close();
+    }
+
+    int FileSink::open(const std::string& path, size_t bufferSize, bool direct, int64_t preallocate) {
+        if (path.empty() || bufferSize == 0) {
+            return AVERROR(EINVAL);
+        }
+
+        close();
+
+        bytes_.store(0);
+        writes_.store(0);
+        directWrites_.store(0);
+        ringWrites_.store(0);
+        writeUs_.store(0);
+        waitUs_.store(0);
+        error_.store(0);
+
+#if defined(_WIN32)
+        fd_ = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd_ < 0) {
+            return AVERROR(errno);
+        }
+
+#if defined(__linux__)
+        if (direct) {
+            // Second descriptor for aligned bulk writes, header patches and the tail stay buffered
+            directFd_ = ::open(path.c_str(), O_WRONLY | O_DIRECT);
+        }
+
+        if (preallocate > 0) {
+            // Extents only, the file size still follows what is written
+            fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, preallocate);
+        }
+#else
+        (void)direct;
+        (void)preallocate;
+#endif
+
+        bufferSize_ = (bufferSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        buffers_.resize(BUFFER_COUNT);
+        for (Buffer& buffer : buffers_) {
+            buffer.data = sink_aligned_alloc(bufferSize_);
+            if (!buffer.data) {
+                close();
+                return AVERROR(ENOMEM);
+            }
+            free_.push_back(&buffer);
+        }
+
+        uint8_t* ioBuffer = static_cast<uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+        if (!ioBuffer) {
+            close();
+            return AVERROR(ENOMEM);
+        }
+
+        ioCtx_ = avio_alloc_context(ioBuffer, IO_BUFFER_SIZE, 1, this, nullptr, &FileSink::writePacket, &FileSink::seek);
+        if (!ioCtx_) {
+            av_free(ioBuffer);
+            close();
+            return AVERROR(ENOMEM);
+        }
+
+#if defined(FILESINK_HAVE_URING)
+        // Every staged buffer can be in flight at once; without a ring the thread uses pwrite
+        ring_ = new io_uring();
+        if (io_uring_queue_init(BUFFER_COUNT, ring_, 0) < 0) {
+            delete ring_;
+            ring_ = nullptr;
+        }
+#endif
+
+        running_ = true;
+        thread_ = std::thread(&FileSink::writerThread, this);
+        return 0;
+    }
+
+    int FileSink::close() {
+        if (ioCtx_) {
+            avio_flush(ioCtx_);
+        }
+
+        submit();
+
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            running_ = false;
+            cond_.notify_all();
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+#if defined(FILESINK_HAVE_URING)
+        if (ring_) {
+            io_uring_queue_exit(ring_);
+            delete ring_;
+        }
+#endif
+        ring_ = nullptr;
+
+        if (fd_ >= 0) {
+#if defined(_WIN32)
+            _chsize_s(fd_, size_);
+            _close(fd_);
+#else
+            // Drops preallocated extents past the end
+            if (ftruncate(fd_, size_) != 0) {
+                int expected = 0;
+                error_.compare_exchange_strong(expected, AVERROR(errno));
+            }
+            ::close(fd_);
+#endif
+            fd_ = -1;
+        }
+
+#if !defined(_WIN32)
+        if (directFd_ >= 0) {
+            ::close(directFd_);
+        }
+#endif
+        directFd_ = -1;
+
+        for (Buffer& buffer : buffers_) {
+            sink_aligned_free(buffer.data);
+        }
+        buffers_.clear();
+        free_.clear();
+        pending_.clear();
+        current_ = nullptr;
+
+        if (ioCtx_) {
+            av_freep(&ioCtx_->buffer);
+            avio_context_free(&ioCtx_);
+        }
+
+        position_ = 0;
+        size_ = 0;
+        bufferSize_ = 0;
+
+        return error_.load();
+    }
+
+    FileSinkStats FileSink::stats() const {
+        FileSinkStats s;
+        s.bytes = bytes_.load();
+        s.writes = writes_.load();
+        s.directWrites = directWrites_.load();
+        s.ringWrites = ringWrites_.load();
+        s.writeUs = writeUs_.load();
+        s.waitUs = waitUs_.load();
+        s.error = error_.load();
+        return s;
+    }
+
+    int FileSink::writePacket(void* opaque, const uint8_t* buf, int size) {
+        FileSink* sink = static_cast<FileSink*>(opaque);
+
+        int ret = sink->write(buf, static_cast<size_t>(size));
+        return ret < 0 ? ret : size;
+    }
+
+    int64_t FileSink::seek(void* opaque, int64_t offset, int whence) {
+        FileSink* sink = static_cast<FileSink*>(opaque);
+
+        whence &= ~AVSEEK_FORCE;
+
+        int64_t target = 0;
+        switch (whence) {
+        case AVSEEK_SIZE:
+            return sink->size_;
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = sink->position_ + offset;
+            break;
+        case SEEK_END:
+            target = sink->size_ + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+
+        if (target < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        // Buffers hold one contiguous range, start a new one at the target
+        if (target != sink->position_) {
+            int ret = sink->submit();
+            if (ret < 0) {
+                return ret;
+            }
+            sink->position_ = target;
+        }
+
+        return target;
+    }
+
+    int FileSink::write(const uint8_t* buf, size_t size) {
+        while (size > 0) {
+            int error = error_.load();
+            if (error < 0) {
+                return error;
+            }
+
+            if (!current_) {
+                int ret = acquire();
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+
+            size_t count = std::min(size, bufferSize_ - current_->size);
+            std::memcpy(current_->data + current_->size, buf, count);
+            current_->size += count;
+            buf += count;
+            size -= count;
+
+            position_ += count;
+            size_ = std::max(size_, position_);
+
+            if (current_->size == bufferSize_) {
+                int ret = submit();
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    int FileSink::submit() {
+        if (!current_) {
+            return error_.load();
+        }
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (current_->size > 0) {
+            pending_.push_back(current_);
+            cond_.notify_all();
+        }
+        else {
+            free_.push_back(current_);
+        }
+
+        current_ = nullptr;
+        return error_.load();
+    }
+
+    int FileSink::acquire() {
+        std::unique_lock<std::mutex> locker(mutex_);
+
+        if (free_.empty()) {
+            int64_t start = av_gettime_relative();
+            cond_.wait(locker, [this]() {
+                return !free_.empty() || error_.load() < 0;
+                });
+            waitUs_.fetch_add(av_gettime_relative() - start);
+        }
+
+        if (free_.empty()) {
+            return error_.load();
+        }
+
+        current_ = free_.front();
+        free_.pop_front();
+        current_->offset = position_;
+        current_->size = 0;
+        return 0;
+    }
+
+    void FileSink::writerThread() {
+        std::vector<Buffer*> batch;
+
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> locker(mutex_);
+                cond_.wait(locker, [this]() {
+                    return !pending_.empty() || !running_;
+                    });
+
+                if (pending_.empty()) {
+                    break;
+                }
+
+                // With a ring pending buffers are submitted together as long as their ranges are
+                // disjoint: completions come back in any order, so a buffer that rewrites an earlier
+                // range (a header patch after a seek) waits for the next batch
+                batch.clear();
+                for (Buffer* buffer : pending_) {
+                    if (!batch.empty() && (!ring_ || overlaps(batch, *buffer))) {
+                        break;
+                    }
+                    batch.push_back(buffer);
+                }
+                pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(batch.size()));
+            }
+
+            if (error_.load() == 0) {
+                int ret = ring_ ? writeRing(batch) : writeAt(*batch.front());
+                if (ret < 0) {
+                    int expected = 0;
+                    error_.compare_exchange_strong(expected, ret);
+                }
+            }
+
+            std::lock_guard<std::mutex> locker(mutex_);
+            for (Buffer* buffer : batch) {
+                buffer->size = 0;
+                free_.push_back(buffer);
+            }
+            cond_.notify_all();
+        }
+    }
+
+    bool FileSink::overlaps(const std::vector<Buffer*>& batch, const Buffer& buffer) {
+        int64_t end = buffer.offset + static_cast<int64_t>(buffer.size);
+        for (const Buffer* other : batch) {
+            if (buffer.offset < other->offset + static_cast<int64_t>(other->size) && other->offset < end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int FileSink::writeAt(const Buffer& buffer) {
+        int64_t start = av_gettime_relative();
+        const uint8_t* data = buffer.data;
+        size_t size = buffer.size;
+        int64_t offset = buffer.offset;
+
+#if defined(_WIN32)
+        if (_lseeki64(fd_, offset, SEEK_SET) < 0) {
+            return AVERROR(errno);
+        }
+
+        while (size > 0) {
+            int n = _write(fd_, data, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+            if (n < 0) {
+                return AVERROR(errno);
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+#else
+        // O_DIRECT needs offset, length and memory aligned to the block size
+        bool direct = directFd_ >= 0 && offset % ALIGNMENT == 0 && size % ALIGNMENT == 0;
+        int fd = direct ? directFd_ : fd_;
+
+        while (size > 0) {
+            ssize_t n = pwrite(fd, data, size, offset);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (direct && errno == EINVAL) {
+                    // Filesystem refused O_DIRECT, continue buffered
+                    fd = fd_;
+                    direct = false;
+                    continue;
+                }
+                return AVERROR(errno);
+            }
+            data += n;
+            offset += n;
+            size -= static_cast<size_t>(n);
+        }
+
+        if (direct) {
+            directWrites_.fetch_add(1);
+        }
+#endif
+
+        writes_.fetch_add(1);
+        bytes_.fetch_add(static_cast<int64_t>(buffer.size));
+        writeUs_.fetch_add(av_gettime_relative() - start);
+        return 0;
+    }
+
+    int FileSink::writeRing(const std::vector<Buffer*>& batch) {
+#if defined(FILESINK_HAVE_URING)
+        struct Request {
+            const Buffer* buffer = nullptr;
+            size_t done = 0;
+            bool direct = false;
+        };
+
+        int64_t start = av_gettime_relative();
+        std::vector<Request> requests(batch.size());
+
+        auto prepare = [this](Request& r) {
+            io_uring_sqe* sqe = io_uring_get_sqe(ring_);
+            io_uring_prep_write(sqe, r.direct ? directFd_ : fd_, r.buffer->data + r.done,
+                                static_cast<unsigned int>(r.buffer->size - r.done),
+                                static_cast<uint64_t>(r.buffer->offset) + r.done);
+            io_uring_sqe_set_data(sqe, &r);
+        };
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            Request& r = requests[i];
+            r.buffer = batch[i];
+            // O_DIRECT needs offset, length and memory aligned to the block size
+            r.direct = directFd_ >= 0 && r.buffer->offset % ALIGNMENT == 0 && r.buffer->size % ALIGNMENT == 0;
+            prepare(r);
+        }
+
+        int ret = io_uring_submit(ring_);
+        if (ret < 0) {
+            return AVERROR(-ret);
+        }
+
+        ret = 0;
+        size_t inflight = requests.size();
+        while (inflight > 0) {
+            io_uring_cqe* cqe = nullptr;
+            int wait = io_uring_wait_cqe(ring_, &cqe);
+            if (wait == -EINTR) {
+                continue;
+            }
+            if (wait < 0) {
+                // Writes may still be in flight on the buffers, nothing safe is left to do
+                return AVERROR(-wait);
+            }
+
+            Request& r = *static_cast<Request*>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(ring_, cqe);
+
+            bool resubmit = false;
+            if (res == -EINTR || res == -EAGAIN) {
+                resubmit = true;
+            }
+            else if (res == -EINVAL && r.direct) {
+                // Filesystem refused O_DIRECT, continue buffered
+                r.direct = false;
+                resubmit = true;
+            }
+            else if (res <= 0) {
+                ret = ret < 0 ? ret : (res < 0 ? AVERROR(-res) : AVERROR(EIO));
+            }
+            else {
+                r.done += static_cast<size_t>(res);
+                resubmit = r.done < r.buffer->size;
+            }
+
+            if (resubmit) {
+                prepare(r);
+                int submitted = io_uring_submit(ring_);
+                if (submitted >= 0) {
+                    continue;
+                }
+                ret = ret < 0 ? ret : AVERROR(-submitted);
+            }
+
+            --inflight;
+            if (r.done == r.buffer->size) {
+                writes_.fetch_add(1);
+                ringWrites_.fetch_add(1);
+                bytes_.fetch_add(static_cast<int64_t>(r.buffer->size));
+                if (r.direct) {
+                    directWrites_.fetch_add(1);
+                }
+            }
+        }
+
+        writeUs_.fetch_add(av_gettime_relative() - start);
+        return ret;
+#else
+        (void)batch;
+        return AVERROR(ENOSYS);
+#endif
+    }
+
+} // namespace media
\ No newline at end of file
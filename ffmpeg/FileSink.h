@@ -0,0 +1,110 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include "FFmpeg.h"
+
+struct io_uring;
+
+namespace media {
+
+    struct FileSinkStats {
+        int64_t bytes = 0;
+        int64_t writes = 0;
+        // Writes that went through O_DIRECT
+        int64_t directWrites = 0;
+        // Writes submitted through io_uring (Linux built with FILESINK_USE_URING)
+        int64_t ringWrites = 0;
+        // Time the writer thread spent in write calls
+        int64_t writeUs = 0;
+        // Time the muxer waited for a free buffer (the disk is the bottleneck)
+        int64_t waitUs = 0;
+        // First write error (0 = none)
+        int error = 0;
+    };
+
+    class FileSink {
+    public:
+        FileSink(const FileSink&) = delete;
+        FileSink& operator=(const FileSink&) = delete;
+        FileSink(FileSink&&) = delete;
+        FileSink& operator=(FileSink&&) = delete;
+
+        static constexpr size_t ALIGNMENT   = 4096;
+        static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+        static constexpr int    BUFFER_COUNT = 2;
+
+        FileSink();
+        ~FileSink();
+
+        // Open file sink (path, bufferSize, direct, preallocate) >= 0
+        // Data is staged in BUFFER_COUNT aligned buffers and written by a background thread, through
+        // io_uring on Linux when built with FILESINK_USE_URING (link -luring), pwrite otherwise;
+        // direct = O_DIRECT for aligned full buffers (Linux), preallocate = bytes reserved up front
+        int open(const std::string& path,
+                 size_t bufferSize = BUFFER_SIZE,
+                 bool direct = false,
+                 int64_t preallocate = 0);
+
+        // Close file sink >= 0, after the muxer has written its trailer (MediaOutput::reset)
+        int close();
+
+        // For MediaOutput::writeIO, seekable so classic MP4 can patch its headers
+        AVIOContext* ioContext() const { return ioCtx_; }
+        FileSinkStats stats() const;
+
+    private:
+        struct Buffer {
+            uint8_t* data = nullptr;
+            size_t size = 0;
+            int64_t offset = 0;
+        };
+
+        static int writePacket(void* opaque, const uint8_t* buf, int size);
+        static int64_t seek(void* opaque, int64_t offset, int whence);
+
+        int write(const uint8_t* buf, size_t size);
+        int submit();
+        int acquire();
+        void writerThread();
+        static bool overlaps(const std::vector<Buffer*>& batch, const Buffer& buffer);
+        int writeAt(const Buffer& buffer);
+        int writeRing(const std::vector<Buffer*>& batch);
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::thread thread_;
+        bool running_;
+
+        int fd_;
+        int directFd_;
+        size_t bufferSize_;
+        std::vector<Buffer> buffers_;
+        std::deque<Buffer*> free_;
+        std::deque<Buffer*> pending_;
+        Buffer* current_;
+        // Submission ring of the writer thread, nullptr = pwrite
+        io_uring* ring_;
+
+        // Logical write position and file size seen by the muxer
+        int64_t position_;
+        int64_t size_;
+
+        AVIOContext* ioCtx_;
+
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> writes_;
+        std::atomic<int64_t> directWrites_;
+        std::atomic<int64_t> ringWrites_;
+        std::atomic<int64_t> writeUs_;
+        std::atomic<int64_t> waitUs_;
+        std::atomic<int> error_;
+    };
+
+} // namespace media
\ No newline at end of file
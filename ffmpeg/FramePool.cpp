@@ -0,0 +1,264 @@
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+#include "FramePool.h"
+
+namespace media {
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    struct FrameSlabPool {
+        bool useHugePages;
+        std::shared_ptr<FramePool::Counters> counters;
+    };
+
+    struct FrameSlab {
+        size_t size;
+        bool huge;
+        std::shared_ptr<FramePool::Counters> counters;
+    };
+
+    static uint8_t* slab_aligned_alloc(size_t size) {
+#if defined(_WIN32)
+        return static_cast<uint8_t*>(_aligned_malloc(size, FramePool::ALIGNMENT));
+#else
+        void* data = nullptr;
+        if (posix_memalign(&data, FramePool::ALIGNMENT, size) != 0) {
+            return nullptr;
+        }
+        return static_cast<uint8_t*>(data);
+#endif
+    }
+
+    static void slab_aligned_free(uint8_t* data) {
+#if defined(_WIN32)
+        _aligned_free(data);
+#else
+        free(data);
+#endif
+    }
+
+    static void slab_free(void* opaque, uint8_t* data) {
+        FrameSlab* slab = static_cast<FrameSlab*>(opaque);
+
+#if defined(__linux__)
+        if (slab->huge) {
+            munmap(data, slab->size);
+        }
+        else {
+            slab_aligned_free(data);
+        }
+#else
+        slab_aligned_free(data);
+#endif
+
+        slab->counters->slabs -= 1;
+        slab->counters->bytes -= static_cast<int64_t>(slab->size);
+        if (slab->huge) {
+            slab->counters->hugeSlabs -= 1;
+        }
+
+        delete slab;
+    }
+
+    static AVBufferRef* slab_alloc(void* opaque, size_t size) {
+        FrameSlabPool* pool = static_cast<FrameSlabPool*>(opaque);
+
+        uint8_t* data = nullptr;
+        size_t bytes = size;
+        bool huge = false;
+
+#if defined(__linux__)
+        if (pool->useHugePages) {
+            size_t hsize = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            void* p = mmap(nullptr, hsize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<uint8_t*>(p);
+                bytes = hsize;
+                huge = true;
+            }
+        }
+#endif
+
+        if (!data) {
+            data = slab_aligned_alloc(size);
+            if (!data) {
+                return nullptr;
+            }
+        }
+
+        FrameSlab* slab = new (std::nothrow) FrameSlab{ bytes, huge, pool->counters };
+        AVBufferRef* buf = slab ? av_buffer_create(data, size, slab_free, slab, 0) : nullptr;
+        if (!buf) {
+#if defined(__linux__)
+            if (huge) {
+                munmap(data, bytes);
+            }
+            else {
+                slab_aligned_free(data);
+            }
+#else
+            slab_aligned_free(data);
+#endif
+            delete slab;
+            return nullptr;
+        }
+
+        pool->counters->slabs += 1;
+        pool->counters->bytes += static_cast<int64_t>(bytes);
+        if (huge) {
+            pool->counters->hugeSlabs += 1;
+        }
+
+        return buf;
+    }
+
+    static void slab_pool_free(void* opaque) {
+        delete static_cast<FrameSlabPool*>(opaque);
+    }
+
+    FramePool::FramePool(bool useHugePages)
+        : useHugePages_(useHugePages)
+        , counters_(std::make_shared<Counters>()) {
+    }
+
+    FramePool::~FramePool() {
+        reset();
+    }
+
+    int FramePool::getBuffer(AVCodecContext* ctx, AVFrame* frame, int flags) {
+        if (!ctx || !frame) {
+            return AVERROR(EINVAL);
+        }
+
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+
+        bool pooled = ctx->codec_type == AVMEDIA_TYPE_VIDEO &&
+                      ctx->codec && (ctx->codec->capabilities & AV_CODEC_CAP_DR1) &&
+                      !ctx->hw_frames_ctx && desc &&
+                      !(desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)) &&
+                      frame->width > 0 && frame->height > 0;
+
+        AVBufferRef* buf = nullptr;
+        Layout layout;
+
+        if (pooled) {
+            std::lock_guard<std::mutex> locker(mutex_);
+
+            Layout* found = findLayout(ctx, frame);
+            if (found) {
+                buf = av_buffer_pool_get(found->pool);
+                if (!buf) {
+                    return AVERROR(ENOMEM);
+                }
+                layout = *found;
+            }
+        }
+
+        if (!buf) {
+            counters_->fallbacks += 1;
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+
+        for (int i = 0; i < layout.planes; ++i) {
+            frame->data[i] = buf->data + layout.offset[i];
+            frame->linesize[i] = layout.linesize[i];
+        }
+
+        frame->buf[0] = buf;
+        frame->extended_data = frame->data;
+
+        counters_->frames += 1;
+        return 0;
+    }
+
+    void FramePool::reset() {
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        for (auto& it : layouts_) {
+            av_buffer_pool_uninit(&it.second.pool);
+        }
+
+        layouts_.clear();
+    }
+
+    FramePoolStats FramePool::stats() const {
+        FramePoolStats stats;
+        stats.slabs = counters_->slabs.load();
+        stats.bytes = counters_->bytes.load();
+        stats.hugeSlabs = counters_->hugeSlabs.load();
+        stats.frames = counters_->frames.load();
+        stats.fallbacks = counters_->fallbacks.load();
+        return stats;
+    }
+
+    FramePool::Layout* FramePool::findLayout(AVCodecContext* ctx, const AVFrame* frame) {
+        AVPixelFormat format = static_cast<AVPixelFormat>(frame->format);
+
+        // Padded dimensions and stride alignment depend on the codec, a pool shared between
+        // decoders keeps one layout per requirement
+        int w = frame->width;
+        int h = frame->height;
+        int align[AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2(ctx, &w, &h, align);
+
+        int strideAlign = ALIGNMENT;
+        for (int i = 0; i < 4; ++i) {
+            strideAlign = std::max(strideAlign, align[i]);
+        }
+
+        LayoutKey key(frame->format, frame->width, frame->height, w, h, strideAlign);
+
+        auto it = layouts_.find(key);
+        if (it != layouts_.end()) {
+            return &it->second;
+        }
+
+        Layout layout;
+        if (av_image_fill_linesizes(layout.linesize, format, w) < 0) {
+            return nullptr;
+        }
+
+        ptrdiff_t linesizes[4];
+        for (int i = 0; i < 4; ++i) {
+            layout.linesize[i] = FFALIGN(layout.linesize[i], strideAlign);
+            linesizes[i] = layout.linesize[i];
+        }
+
+        size_t sizes[4] = { 0, 0, 0, 0 };
+        if (av_image_fill_plane_sizes(sizes, format, h, linesizes) < 0) {
+            return nullptr;
+        }
+
+        // Extra tail per plane covers decoders writing past the last line (edge emulation)
+        for (int i = 0; i < 4 && sizes[i] > 0; ++i) {
+            layout.offset[i] = layout.size;
+            layout.size += FFALIGN(sizes[i] + 16 + ALIGNMENT - 1, static_cast<size_t>(ALIGNMENT));
+            layout.planes = i + 1;
+        }
+
+        if (layout.planes == 0) {
+            return nullptr;
+        }
+
+        FrameSlabPool* opaque = new (std::nothrow) FrameSlabPool{ useHugePages_, counters_ };
+        if (!opaque) {
+            return nullptr;
+        }
+
+        layout.pool = av_buffer_pool_init2(layout.size, opaque, slab_alloc, slab_pool_free);
+        if (!layout.pool) {
+            delete opaque;
+            return nullptr;
+        }
+
+        return &layouts_.emplace(key, layout).first->second;
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <memory>
+#include "FFmpeg.h"
+
+namespace media {
+
+    struct FramePoolStats {
+        // Slabs currently allocated (pooled or held by frames)
+        int64_t slabs = 0;
+        // Bytes currently allocated by all slabs
+        int64_t bytes = 0;
+        // Slabs backed by huge pages
+        int64_t hugeSlabs = 0;
+        // Frames served from the pool
+        int64_t frames = 0;
+        // Frames handed to the default libavcodec allocator
+        int64_t fallbacks = 0;
+    };
+
+    class FramePool {
+    public:
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+        FramePool(FramePool&&) = delete;
+        FramePool& operator=(FramePool&&) = delete;
+
+        // Plane pointers and strides are aligned for SIMD and texture upload
+        static constexpr int ALIGNMENT = 64;
+
+        struct Counters {
+            std::atomic<int64_t> slabs{ 0 };
+            std::atomic<int64_t> bytes{ 0 };
+            std::atomic<int64_t> hugeSlabs{ 0 };
+            std::atomic<int64_t> frames{ 0 };
+            std::atomic<int64_t> fallbacks{ 0 };
+        };
+
+        explicit FramePool(bool useHugePages = false);
+        ~FramePool();
+
+        // Get buffer (ctx, frame, flags) >= 0, same contract as AVCodecContext::get_buffer2
+        int getBuffer(AVCodecContext* ctx, AVFrame* frame, int flags);
+
+        // Release idle slabs (frames still referenced stay valid)
+        void reset();
+
+        FramePoolStats stats() const;
+        bool useHugePages() const { return useHugePages_; }
+
+    private:
+        struct Layout {
+            int linesize[4] = { 0, 0, 0, 0 };
+            size_t offset[4] = { 0, 0, 0, 0 };
+            int planes = 0;
+            size_t size = 0;
+            AVBufferPool* pool = nullptr;
+        };
+
+        // format, width, height, padded width, padded height, stride alignment
+        using LayoutKey = std::tuple<int, int, int, int, int, int>;
+
+        Layout* findLayout(AVCodecContext* ctx, const AVFrame* frame);
+
+    private:
+        mutable std::mutex mutex_;
+        bool useHugePages_;
+        std::shared_ptr<Counters> counters_;
+        std::map<LayoutKey, Layout> layouts_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include "LadderEncoder.h"
+
+namespace media {
+
+    LadderEncoder::LadderEncoder()
+        : gopSize_(0)
+        , frameIndex_(0) {
+    }
+
+    LadderEncoder::~LadderEncoder() {
+        reset();
+    }
+
+    int LadderEncoder::open(AVCodecID codecid,
+                            int srcW,
+                            int srcH,
+                            AVPixelFormat srcFmt,
+                            AVRational timebase,
+                            AVRational framerate,
+                            const std::vector<int>& presets,
+                            bool useHW,
+                            unsigned int threads,
+                            size_t maxPackets) {
+        if (codecid == AV_CODEC_ID_NONE || srcW <= 0 || srcH <= 0 || srcFmt == AV_PIX_FMT_NONE) {
+            return AVERROR(EINVAL);
+        }
+
+        if (presets.empty() || framerate.num <= 0 || framerate.den <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        reset();
+
+        const int count = static_cast<int>(sizeof(Resolution_Preset) / sizeof(Resolution_Preset[0]));
+
+        // One second GOPs forced on the same source frames; the encoders' own GOP limit is set past
+        // that so they never place a keyframe of their own
+        gopSize_ = std::max(1, static_cast<int>(av_q2d(framerate) + 0.5));
+
+        for (int preset : presets) {
+            if (preset < 0 || preset >= count || Resolution_Preset[preset].width <= 0) {
+                reset();
+                return AVERROR(EINVAL);
+            }
+
+            const Resolution& res = Resolution_Preset[preset];
+
+            std::unique_ptr<Rendition> r(new Rendition());
+            r->preset = preset;
+
+            int ret = r->resampler.configSwsContext(srcW, srcH, srcFmt, res.width, res.height, AV_PIX_FMT_YUV420P);
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+
+            // Forced keyframes must be IDR so every rendition can be cut at the same frame, and scene
+            // cut detection is off so no rendition starts an extra GOP on its own
+            AVDictionary* opt = nullptr;
+            av_dict_set(&opt, "forced-idr", "1", 0);
+            av_dict_set(&opt, "sc_threshold", "0", 0);
+            av_dict_set(&opt, "x265-params", "scenecut=0", 0);
+            av_dict_set(&opt, "no-scenecut", "1", 0);
+
+            r->encoder.setGopSize(gopSize_ * 2);
+            ret = r->encoder.openVideoEncoder(codecid, res.width, res.height, res.bitrate,
+                                              timebase, framerate, AV_PIX_FMT_YUV420P,
+                                              useHW, threads, opt);
+            av_dict_free(&opt);
+
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+
+            r->frames.setClearCallback([](AVFrame* frame) {
+                av_frame_free(&frame);
+                });
+            r->scaled.setClearCallback([](AVFrame* frame) {
+                av_frame_free(&frame);
+                });
+            r->packets.setLimit(0, maxPackets);
+            r->packets.setClearCallback([](AVPacket* pkt) {
+                av_packet_free(&pkt);
+                });
+
+            renditions_.push_back(std::move(r));
+        }
+
+        for (size_t i = 0; i < renditions_.size(); ++i) {
+            Rendition* r = renditions_[i].get();
+
+            int ret = r->stage.start(&r->encoder, true, &r->scaled, &r->packets,
+                                     r->encoder.videoEncoder()->time_base, static_cast<int>(i));
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+
+            r->thread = std::thread(&LadderEncoder::scaleThread, this, r);
+        }
+
+        return 0;
+    }
+
+    int LadderEncoder::addFrame(const AVFrame* frame) {
+        if (!frame || renditions_.empty()) {
+            return AVERROR(EINVAL);
+        }
+
+        bool keyframe = frameIndex_ % gopSize_ == 0;
+        ++frameIndex_;
+
+        for (auto& r : renditions_) {
+            int error = r->error.load();
+            if (error < 0) {
+                return error;
+            }
+
+            AVFrame* ref = av_frame_clone(frame);
+            if (!ref) {
+                return AVERROR(ENOMEM);
+            }
+
+            ref->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+            if (!r->frames.enqueue(ref)) {
+                av_frame_free(&ref);
+                return r->error.load() < 0 ? r->error.load() : AVERROR_EXIT;
+            }
+        }
+
+        return 0;
+    }
+
+    int LadderEncoder::finish() {
+        int ret = 0;
+
+        for (auto& r : renditions_) {
+            AVFrame* eos = av_frame_alloc();
+            if (!eos) {
+                return AVERROR(ENOMEM);
+            }
+
+            if (!r->frames.enqueue(eos)) {
+                av_frame_free(&eos);
+            }
+        }
+
+        for (auto& r : renditions_) {
+            if (r->thread.joinable()) {
+                r->thread.join();
+            }
+
+            r->stage.wait();
+
+            if (ret == 0 && r->error.load() < 0) {
+                ret = r->error.load();
+            }
+            if (ret == 0 && r->stage.stats().error < 0) {
+                ret = r->stage.stats().error;
+            }
+        }
+
+        return ret;
+    }
+
+    void LadderEncoder::reset() {
+        for (auto& r : renditions_) {
+            r->frames.lock();
+            r->scaled.lock();
+            r->packets.lock();
+
+            if (r->thread.joinable()) {
+                r->thread.join();
+            }
+
+            r->stage.stop();
+        }
+
+        renditions_.clear();
+        gopSize_ = 0;
+        frameIndex_ = 0;
+    }
+
+    void LadderEncoder::scaleThread(Rendition* r) {
+        AVCodecContext* encoder = r->encoder.videoEncoder();
+        bool finished = false;
+
+        for (;;) {
+            AVFrame* src = r->frames.dequeue();
+            if (!src) {
+                break;
+            }
+
+            if (EncodeStage::isEndOfStream(src)) {
+                av_frame_free(&src);
+                finished = r->stage.finish() >= 0;
+                break;
+            }
+
+            AVFrame* dst = av_frame_alloc();
+            if (!dst) {
+                av_frame_free(&src);
+                r->error.store(AVERROR(ENOMEM));
+                break;
+            }
+
+            dst->format = encoder->pix_fmt;
+            dst->width = encoder->width;
+            dst->height = encoder->height;
+
+            int ret = av_frame_get_buffer(dst, 0);
+            if (ret >= 0) {
+                ret = sws_scale(r->resampler.swsContext(), src->data, src->linesize, 0, src->height,
+                                dst->data, dst->linesize);
+            }
+            if (ret >= 0) {
+                ret = av_frame_copy_props(dst, src);
+            }
+
+            dst->pict_type = src->pict_type;
+            av_frame_free(&src);
+
+            if (ret < 0) {
+                av_frame_free(&dst);
+                r->error.store(ret);
+                break;
+            }
+
+            if (!r->scaled.enqueue(dst)) {
+                av_frame_free(&dst);
+                break;
+            }
+        }
+
+        // Without end of stream the encode thread would wait on the scaled queue forever and
+        // addFrame on the frame queue, lock both so finish() and addFrame() return
+        if (!finished) {
+            r->frames.lock();
+            r->scaled.lock();
+        }
+    }
+
+} // namespace media
\ No newline at end of file
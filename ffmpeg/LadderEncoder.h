@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include "FFmpeg.h"
+#include "EncodeStage.h"
+#include "MediaEncoder.h"
+#include "MediaResampler.h"
+#include "../queue/MediaQueue.h"
+
+namespace media {
+
+    class LadderEncoder {
+    public:
+        LadderEncoder(const LadderEncoder&) = delete;
+        LadderEncoder& operator=(const LadderEncoder&) = delete;
+        LadderEncoder(LadderEncoder&&) = delete;
+        LadderEncoder& operator=(LadderEncoder&&) = delete;
+
+        using FrameQueue = MediaQueue<AVFrame>;
+        using PacketQueue = MediaQueue<AVPacket>;
+
+        LadderEncoder();
+        ~LadderEncoder();
+
+        // Open ladder (codecid, srcW, srcH, srcFmt, timebase, framerate, presets, useHW, threads, maxPackets) >= 0
+        // presets are indices into Resolution_Preset; every rendition keeps the source frame rate and
+        // gets a forced keyframe on the same source frames once per second, so GOPs line up across
+        // renditions; scene cut keyframes are disabled
+        int open(AVCodecID codecid,
+                 int srcW,
+                 int srcH,
+                 AVPixelFormat srcFmt,
+                 AVRational timebase,
+                 AVRational framerate,
+                 const std::vector<int>& presets,
+                 bool useHW = false,
+                 unsigned int threads = 0,
+                 size_t maxPackets = 256);
+
+        // Add decoded frame (frame) >= 0, frame is referenced by every rendition, not copied
+        int addFrame(const AVFrame* frame);
+
+        // Finish ladder >= 0, drains every rendition into its packet queue
+        // Blocks until every rendition is encoded: renditionPackets() must be read from another
+        // thread meanwhile, a full packet queue (maxPackets) otherwise stalls the encoder for good
+        int finish();
+
+        // Reset ladder
+        void reset();
+
+        int renditionCount()                    const { return static_cast<int>(renditions_.size()); }
+        int renditionPreset(int i)              const { return renditions_[i]->preset; }
+        MediaEncoder* renditionEncoder(int i)   const { return &renditions_[i]->encoder; }
+        EncodeStageStats renditionStats(int i)  const { return renditions_[i]->stage.stats(); }
+        // Packets in the rendition encoder time_base, stream_index = rendition index
+        PacketQueue* renditionPackets(int i)    const { return &renditions_[i]->packets; }
+
+    private:
+        // Queues and encoder are declared before the stage that uses them
+        struct Rendition {
+            int preset = -1;
+            FrameQueue frames{ 0, 4 };
+            FrameQueue scaled{ 0, 4 };
+            PacketQueue packets;
+            MediaResampler resampler;
+            MediaEncoder encoder;
+            EncodeStage stage;
+            std::thread thread;
+            std::atomic<int> error{ 0 };
+        };
+
+        void scaleThread(Rendition* r);
+
+    private:
+        int gopSize_;
+        int64_t frameIndex_;
+        std::vector<std::unique_ptr<Rendition>> renditions_;
+    };
+
+} // namespace media
\ No newline at end of file
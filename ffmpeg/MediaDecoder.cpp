@@ -1,16 +1,23 @@
+#include <cstring>
+#include <utility>
 #include "MediaDecoder.h"
 
 namespace media {
 
+    struct DecoderOpaque {
+        AVPixelFormat hwFormat = AV_PIX_FMT_NONE;
+        std::shared_ptr<FramePool> framePool;
+    };
+
     static AVPixelFormat get_hw_format(AVCodecContext* ctx, const AVPixelFormat* fmt) {
-        AVPixelFormat* target_hw_format = static_cast<AVPixelFormat*>(ctx->opaque);
-        if (!target_hw_format) {
+        DecoderOpaque* opaque = static_cast<DecoderOpaque*>(ctx->opaque);
+        if (!opaque || opaque->hwFormat == AV_PIX_FMT_NONE) {
             return AV_PIX_FMT_NONE;
         }
 
         const AVPixelFormat* p = fmt;
         for (; *p != AV_PIX_FMT_NONE; ++p) {
-            if (*p == *target_hw_format) {
+            if (*p == opaque->hwFormat) {
                 return *p;
             }
         }
@@ -18,19 +25,51 @@ namespace media {
         return AV_PIX_FMT_NONE;
     }
 
+    static int get_pool_buffer(AVCodecContext* ctx, AVFrame* frame, int flags) {
+        DecoderOpaque* opaque = static_cast<DecoderOpaque*>(ctx->opaque);
+        if (!opaque || !opaque->framePool) {
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+
+        return opaque->framePool->getBuffer(ctx, frame, flags);
+    }
+
+    static bool is_annexb_extradata(const uint8_t* data, int size) {
+        if (!data || size <= 0) {
+            return true;
+        }
+
+        if (size >= 3 && data[0] == 0 && data[1] == 0 && data[2] == 1) {
+            return true;
+        }
+
+        return size >= 4 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1;
+    }
+
     MediaDecoder::MediaDecoder()
         : videoCodec_(nullptr)
         , audioCodec_(nullptr)
         , videoDecoder_(nullptr)
-        , audioDecoder_(nullptr) {
+        , audioDecoder_(nullptr)
+        , videoHW_(false)
+        , videoThreads_(0u)
+        , videoProfile_(DecodeProfile::Default)
+        , videoParams_(nullptr)
+        , framePool_(nullptr)
+        , videoHWFormat_(AV_PIX_FMT_NONE)
+        , videoPendingUs_(0)
+        , audioPendingUs_(0) {
     }
 
     MediaDecoder::~MediaDecoder() {
-        resetVideoDecoder();
+        releaseVideoDecoder();
         resetAudioDecoder();
     }
 
-    int MediaDecoder::openVideoDecoder(AVFormatContext* ctx, bool useHW, unsigned int threads) {
+    int MediaDecoder::openVideoDecoder(AVFormatContext* ctx,
+                                       bool useHW,
+                                       unsigned int threads,
+                                       DecodeProfile profile) {
         if (!ctx || !ctx->streams) {
             return AVERROR(EINVAL);
         }
@@ -47,6 +86,23 @@ namespace media {
 
         AVCodecParameters* p = s->codecpar;
 
+        videoStats_.reset();
+        videoPendingUs_ = 0;
+
+        if (canReuseVideoDecoder(p, useHW, threads, profile)) {
+            videoStats_.setHW(videoHW_, videoHWFormat_ != AV_PIX_FMT_NONE);
+            return reuseVideoDecoder(p, s->time_base);
+        }
+
+        // Then the warm context, e.g. after reset() on a stream switch
+        swapWarmVideoDecoder();
+        if (canReuseVideoDecoder(p, useHW, threads, profile)) {
+            videoStats_.setHW(videoHW_, videoHWFormat_ != AV_PIX_FMT_NONE);
+            return reuseVideoDecoder(p, s->time_base);
+        }
+
+        // Neither fits, the more recent one stays warm
+        swapWarmVideoDecoder();
         resetVideoDecoder();
 
         videoCodec_ = avcodec_find_decoder(p->codec_id);
@@ -91,30 +147,78 @@ namespace media {
         }
 
         if (hw_device_ctx) {
+            DecoderOpaque* opaque = new DecoderOpaque();
+            opaque->hwFormat = hw_format;
+
             decoder->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-            decoder->opaque = new AVPixelFormat(hw_format);
+            decoder->opaque = opaque;
             decoder->get_format = get_hw_format;
             av_buffer_unref(&hw_device_ctx);
         }
+        else if (framePool_) {
+            DecoderOpaque* opaque = new DecoderOpaque();
+            opaque->framePool = framePool_;
+
+            decoder->opaque = opaque;
+            decoder->get_buffer2 = get_pool_buffer;
+        }
 
         decoder->time_base = s->time_base;
-        decoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
-        decoder->thread_count = threads > 4u ? 4 : static_cast<int>(threads);
+
+        switch (profile) {
+        case DecodeProfile::LowLatency:
+            // Frame threading holds thread_count - 1 frames, slices decode within a frame
+            decoder->thread_type = FF_THREAD_SLICE;
+            decoder->thread_count = threads > 4u ? 4 : static_cast<int>(threads);
+            decoder->flags |= AV_CODEC_FLAG_LOW_DELAY;
+            decoder->flags2 |= AV_CODEC_FLAG2_FAST;
+            break;
+        case DecodeProfile::Throughput:
+            decoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            decoder->thread_count = threads > 16u ? 16 : static_cast<int>(threads);
+            break;
+        default:
+            decoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            decoder->thread_count = threads > 4u ? 4 : static_cast<int>(threads);
+            break;
+        }
 
         ret = avcodec_open2(decoder, videoCodec_, nullptr);
         if (ret < 0) {
             if (decoder->opaque) {
-                delete static_cast<AVPixelFormat*>(decoder->opaque);
+                delete static_cast<DecoderOpaque*>(decoder->opaque);
                 decoder->opaque = nullptr;
             }
             avcodec_free_context(&decoder);
             return ret;
         }
 
+        AVCodecParameters* params = avcodec_parameters_alloc();
+        if (!params || avcodec_parameters_copy(params, p) < 0) {
+            avcodec_parameters_free(&params);
+            if (decoder->opaque) {
+                delete static_cast<DecoderOpaque*>(decoder->opaque);
+                decoder->opaque = nullptr;
+            }
+            avcodec_free_context(&decoder);
+            return AVERROR(ENOMEM);
+        }
+
+        videoParams_ = std::shared_ptr<AVCodecParameters>(params, [](AVCodecParameters* p) {
+            if (p) {
+                avcodec_parameters_free(&p);
+            }
+            });
+
+        videoHW_ = useHW;
+        videoThreads_ = threads;
+        videoProfile_ = profile;
+        videoHWFormat_ = hw_format;
+        videoStats_.setHW(useHW, hw_format != AV_PIX_FMT_NONE);
         videoDecoder_ = std::shared_ptr<AVCodecContext>(decoder, [](AVCodecContext* p) {
             if (p) {
                 if (p->opaque) {
-                    delete static_cast<AVPixelFormat*>(p->opaque);
+                    delete static_cast<DecoderOpaque*>(p->opaque);
                     p->opaque = nullptr;
                 }
                 avcodec_free_context(&p);
@@ -143,6 +247,9 @@ namespace media {
 
         resetAudioDecoder();
 
+        audioStats_.reset();
+        audioPendingUs_ = 0;
+
         audioCodec_ = avcodec_find_decoder(p->codec_id);
         if (!audioCodec_) {
             return AVERROR_DECODER_NOT_FOUND;
@@ -178,6 +285,80 @@ namespace media {
         return 0;
     }
 
+    int MediaDecoder::sendVideoPacket(const AVPacket* pkt) {
+        if (!videoDecoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        int64_t start = av_gettime_relative();
+        int ret = avcodec_send_packet(videoDecoder_.get(), pkt);
+        videoPendingUs_ += av_gettime_relative() - start;
+
+        videoStats_.addPacket(pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            videoStats_.addError();
+        }
+
+        return ret;
+    }
+
+    int MediaDecoder::receiveVideoFrame(AVFrame* frame) {
+        if (!videoDecoder_ || !frame) {
+            return AVERROR(EINVAL);
+        }
+
+        int64_t start = av_gettime_relative();
+        int ret = avcodec_receive_frame(videoDecoder_.get(), frame);
+        videoPendingUs_ += av_gettime_relative() - start;
+
+        if (ret >= 0) {
+            videoStats_.addFrame(frame, videoPendingUs_, videoHWFormat_);
+            videoPendingUs_ = 0;
+        }
+        else if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            videoStats_.addError();
+        }
+
+        return ret;
+    }
+
+    int MediaDecoder::sendAudioPacket(const AVPacket* pkt) {
+        if (!audioDecoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        int64_t start = av_gettime_relative();
+        int ret = avcodec_send_packet(audioDecoder_.get(), pkt);
+        audioPendingUs_ += av_gettime_relative() - start;
+
+        audioStats_.addPacket(pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            audioStats_.addError();
+        }
+
+        return ret;
+    }
+
+    int MediaDecoder::receiveAudioFrame(AVFrame* frame) {
+        if (!audioDecoder_ || !frame) {
+            return AVERROR(EINVAL);
+        }
+
+        int64_t start = av_gettime_relative();
+        int ret = avcodec_receive_frame(audioDecoder_.get(), frame);
+        audioPendingUs_ += av_gettime_relative() - start;
+
+        if (ret >= 0) {
+            audioStats_.addFrame(frame, audioPendingUs_, AV_PIX_FMT_NONE);
+            audioPendingUs_ = 0;
+        }
+        else if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            audioStats_.addError();
+        }
+
+        return ret;
+    }
+
     void MediaDecoder::flushVideoDecoder() {
         if (videoDecoder_) {
             avcodec_flush_buffers(videoDecoder_.get());
@@ -190,9 +371,39 @@ namespace media {
         }
     }
 
+    void MediaDecoder::setFramePool(std::shared_ptr<FramePool> pool) {
+        framePool_ = std::move(pool);
+    }
+
     void MediaDecoder::resetVideoDecoder() {
+        if (videoDecoder_) {
+            // Park the flushed context, dropping the previous warm one
+            avcodec_flush_buffers(videoDecoder_.get());
+            swapWarmVideoDecoder();
+        }
+
         videoCodec_ = nullptr;
         videoDecoder_.reset();
+        videoParams_.reset();
+        videoHW_ = false;
+        videoThreads_ = 0u;
+        videoProfile_ = DecodeProfile::Default;
+        videoHWFormat_ = AV_PIX_FMT_NONE;
+    }
+
+    void MediaDecoder::releaseVideoDecoder() {
+        resetVideoDecoder();
+        warm_ = WarmDecoder();
+    }
+
+    void MediaDecoder::swapWarmVideoDecoder() {
+        std::swap(videoCodec_, warm_.codec);
+        std::swap(videoDecoder_, warm_.decoder);
+        std::swap(videoParams_, warm_.params);
+        std::swap(videoHW_, warm_.hw);
+        std::swap(videoThreads_, warm_.threads);
+        std::swap(videoProfile_, warm_.profile);
+        std::swap(videoHWFormat_, warm_.hwFormat);
     }
 
     void MediaDecoder::resetAudioDecoder() {
@@ -217,4 +428,76 @@ namespace media {
         return AV_PIX_FMT_NONE;
     }
 
+    bool MediaDecoder::canReuseVideoDecoder(const AVCodecParameters* p,
+                                            bool useHW,
+                                            unsigned int threads,
+                                            DecodeProfile profile) const {
+        if (!videoDecoder_ || !videoParams_) {
+            return false;
+        }
+
+        if (useHW != videoHW_ || threads != videoThreads_ || profile != videoProfile_) {
+            return false;
+        }
+
+        DecoderOpaque* opaque = static_cast<DecoderOpaque*>(videoDecoder_->opaque);
+        if (!videoDecoder_->hw_device_ctx && (opaque ? opaque->framePool : nullptr) != framePool_) {
+            return false;
+        }
+
+        const AVCodecParameters* cur = videoParams_.get();
+        if (p->codec_id != cur->codec_id ||
+            p->width != cur->width ||
+            p->height != cur->height ||
+            p->format != cur->format) {
+            return false;
+        }
+
+        if (p->extradata_size == cur->extradata_size &&
+            (p->extradata_size == 0 || memcmp(p->extradata, cur->extradata, p->extradata_size) == 0)) {
+            return true;
+        }
+
+        // H.264/HEVC in Annex-B carry SPS/PPS in-band, so differing extradata is picked up by the decoder itself
+        if (p->codec_id == AV_CODEC_ID_H264 || p->codec_id == AV_CODEC_ID_HEVC) {
+            return is_annexb_extradata(p->extradata, p->extradata_size) &&
+                   is_annexb_extradata(cur->extradata, cur->extradata_size);
+        }
+
+        return false;
+    }
+
+    int MediaDecoder::reuseVideoDecoder(const AVCodecParameters* p, AVRational timebase) {
+        AVCodecContext* decoder = videoDecoder_.get();
+
+        avcodec_flush_buffers(decoder);
+
+        if (p->extradata_size != decoder->extradata_size ||
+            (p->extradata_size > 0 && memcmp(p->extradata, decoder->extradata, p->extradata_size) != 0)) {
+            av_freep(&decoder->extradata);
+            decoder->extradata_size = 0;
+
+            if (p->extradata_size > 0) {
+                decoder->extradata = static_cast<uint8_t*>(av_mallocz(p->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE));
+                if (!decoder->extradata) {
+                    releaseVideoDecoder();
+                    return AVERROR(ENOMEM);
+                }
+
+                memcpy(decoder->extradata, p->extradata, p->extradata_size);
+                decoder->extradata_size = p->extradata_size;
+            }
+        }
+
+        decoder->time_base = timebase;
+
+        int ret = avcodec_parameters_copy(videoParams_.get(), p);
+        if (ret < 0) {
+            releaseVideoDecoder();
+            return ret;
+        }
+
+        return 0;
+    }
+
 } // namespace media
\ No newline at end of file
@@ -2,9 +2,20 @@
 
 #include <memory>
 #include "FFmpeg.h"
+#include "FramePool.h"
+#include "DecoderStats.h"
 
 namespace media {
 
+    enum class DecodeProfile {
+        // Frame + slice threading, at most 4 threads
+        Default,
+        // Slice threading only, no frame reordering delay (live sources)
+        LowLatency,
+        // Frame + slice threading, up to 16 threads (offline/batch jobs)
+        Throughput
+    };
+
     class MediaDecoder {
     public:
         MediaDecoder(const MediaDecoder&) = delete;
@@ -15,8 +26,12 @@ namespace media {
         MediaDecoder();
         ~MediaDecoder();
 
-        // Open video decoder (ctx, useHW, threads) >= 0
-        int openVideoDecoder(AVFormatContext* ctx, bool useHW = false, unsigned int threads = 0);
+        // Open video decoder (ctx, useHW, threads, profile) >= 0
+        // Reuses the current or the last reset context when the new stream is decoder-compatible (warm switch)
+        int openVideoDecoder(AVFormatContext* ctx,
+                             bool useHW = false,
+                             unsigned int threads = 0,
+                             DecodeProfile profile = DecodeProfile::Default);
         // Open audio decoder (ctx, threads) >= 0
         int openAudioDecoder(AVFormatContext* ctx, unsigned int threads = 0);
 
@@ -25,22 +40,70 @@ namespace media {
         // Flush audio decoder
         void flushAudioDecoder();
 
-        // Reset video decoder
+        // Send video packet (pkt, nullptr = drain) >= 0, updates videoStats()
+        int sendVideoPacket(const AVPacket* pkt);
+        // Receive video frame (frame) >= 0, AVERROR(EAGAIN)/AVERROR_EOF when no frame is ready
+        int receiveVideoFrame(AVFrame* frame);
+        // Send audio packet (pkt, nullptr = drain) >= 0, updates audioStats()
+        int sendAudioPacket(const AVPacket* pkt);
+        // Receive audio frame (frame) >= 0, AVERROR(EAGAIN)/AVERROR_EOF when no frame is ready
+        int receiveAudioFrame(AVFrame* frame);
+
+        // Set frame pool used as get_buffer2 by the next software video decoder (nullptr = libavcodec default)
+        void setFramePool(std::shared_ptr<FramePool> pool);
+
+        // Reset video decoder, the context is flushed and kept warm for the next compatible openVideoDecoder
         void resetVideoDecoder();
+        // Release video decoder, also frees the warm context (and its hardware device)
+        void releaseVideoDecoder();
         // Reset audio decoder
         void resetAudioDecoder();
 
         AVCodecContext* videoDecoder() const { return videoDecoder_.get(); }
         AVCodecContext* audioDecoder() const { return audioDecoder_.get(); }
+        FramePool* framePool()         const { return framePool_.get(); }
+
+        // Counters can be snapshotted from any thread
+        const DecoderStats& videoStats() const { return videoStats_; }
+        DecoderStats& videoStats()             { return videoStats_; }
+        const DecoderStats& audioStats() const { return audioStats_; }
+        DecoderStats& audioStats()             { return audioStats_; }
 
     private:
         AVPixelFormat findHWFormat(const AVCodec* codec, AVHWDeviceType type);
+        bool canReuseVideoDecoder(const AVCodecParameters* p, bool useHW, unsigned int threads, DecodeProfile profile) const;
+        int reuseVideoDecoder(const AVCodecParameters* p, AVRational timebase);
+        void swapWarmVideoDecoder();
 
     private:
         const AVCodec* videoCodec_;
         const AVCodec* audioCodec_;
         std::shared_ptr<AVCodecContext> videoDecoder_;
         std::shared_ptr<AVCodecContext> audioDecoder_;
+
+        bool videoHW_;
+        unsigned int videoThreads_;
+        DecodeProfile videoProfile_;
+        std::shared_ptr<AVCodecParameters> videoParams_;
+        std::shared_ptr<FramePool> framePool_;
+
+        // Last reset video decoder and the settings it was opened with
+        struct WarmDecoder {
+            const AVCodec* codec = nullptr;
+            std::shared_ptr<AVCodecContext> decoder;
+            std::shared_ptr<AVCodecParameters> params;
+            bool hw = false;
+            unsigned int threads = 0u;
+            DecodeProfile profile = DecodeProfile::Default;
+            AVPixelFormat hwFormat = AV_PIX_FMT_NONE;
+        };
+        WarmDecoder warm_;
+
+        AVPixelFormat videoHWFormat_;
+        int64_t videoPendingUs_;
+        int64_t audioPendingUs_;
+        DecoderStats videoStats_;
+        DecoderStats audioStats_;
     };
 
 } // namespace media
\ No newline at end of file
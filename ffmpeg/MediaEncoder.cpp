@@ -2,11 +2,79 @@
 
 namespace media {
 
+    static void setOption(AVDictionary** options, const char* key, const char* value) {
+        // Caller supplied options win over profile defaults
+        av_dict_set(options, key, value, AV_DICT_DONT_OVERWRITE);
+    }
+
+    static void setProfileOptions(const AVCodec* codec, EncodeProfile profile, AVDictionary** options) {
+        if (profile == EncodeProfile::Default) {
+            return;
+        }
+
+        const std::string name = codec->name;
+        const bool realtime = profile == EncodeProfile::RealtimeLowLatency;
+        const bool offline = profile == EncodeProfile::OfflineThroughput;
+
+        if (name == "libx264" || name == "libx265") {
+            setOption(options, "preset", realtime ? "superfast" : offline ? "medium" : "veryfast");
+            if (realtime) {
+                // No lookahead, no B-frames, sliced threads
+                setOption(options, "tune", "zerolatency");
+            }
+            else if (name == "libx264") {
+                setOption(options, "rc-lookahead", offline ? "40" : "10");
+            }
+        }
+        else if (name.find("_nvenc") != std::string::npos) {
+            setOption(options, "preset", realtime ? "p1" : offline ? "p6" : "p4");
+            setOption(options, "tune", realtime ? "ull" : offline ? "hq" : "ll");
+            setOption(options, "rc-lookahead", realtime ? "0" : offline ? "20" : "8");
+            if (realtime) {
+                setOption(options, "zerolatency", "1");
+                setOption(options, "delay", "0");
+            }
+        }
+        else if (name.find("_qsv") != std::string::npos) {
+            setOption(options, "preset", realtime ? "veryfast" : offline ? "slower" : "faster");
+            setOption(options, "async_depth", realtime ? "1" : "4");
+            if (!realtime) {
+                setOption(options, "look_ahead_depth", offline ? "40" : "10");
+            }
+        }
+        else if (name.find("_vaapi") != std::string::npos) {
+            setOption(options, "async_depth", realtime ? "1" : "4");
+        }
+        else if (name.find("_videotoolbox") != std::string::npos) {
+            setOption(options, "realtime", realtime ? "1" : "0");
+        }
+        else if (name == "libvpx-vp9" || name == "libvpx") {
+            setOption(options, "deadline", realtime ? "realtime" : "good");
+            setOption(options, "cpu-used", realtime ? "8" : offline ? "2" : "5");
+            setOption(options, "lag-in-frames", realtime ? "0" : offline ? "25" : "8");
+            setOption(options, "row-mt", "1");
+        }
+        else if (name == "libsvtav1") {
+            setOption(options, "preset", realtime ? "12" : offline ? "6" : "9");
+        }
+        else if (name == "libaom-av1") {
+            setOption(options, "usage", realtime ? "realtime" : "good");
+            setOption(options, "cpu-used", realtime ? "8" : offline ? "4" : "6");
+            setOption(options, "lag-in-frames", realtime ? "0" : offline ? "35" : "10");
+            setOption(options, "row-mt", "1");
+        }
+    }
+
     MediaEncoder::MediaEncoder()
         : videoCodec_(nullptr)
         , audioCodec_(nullptr)
         , videoEncoder_(nullptr)
-        , audioEncoder_(nullptr) {
+        , audioEncoder_(nullptr)
+        , gopSize_(-1)
+        , maxBFrames_(-1)
+        , videoProfile_(EncodeProfile::Default)
+        , pendingBitrate_(0)
+        , forceKeyframe_(false) {
     }
 
     MediaEncoder::~MediaEncoder() {
@@ -23,7 +91,8 @@ namespace media {
                                        AVPixelFormat pixfmt,
                                        bool useHW,
                                        unsigned int threads,
-                                       AVDictionary* opt) {
+                                       AVDictionary* opt,
+                                       EncodeProfile profile) {
         if (codecid == AV_CODEC_ID_NONE) {
             return AVERROR(EINVAL);
         }
@@ -44,6 +113,18 @@ namespace media {
             }
         }
 
+        if (!videoCodec_ && !videoEncoderName_.empty()) {
+            videoCodec_ = avcodec_find_encoder_by_name(videoEncoderName_.c_str());
+            if (!videoCodec_) {
+                return AVERROR_ENCODER_NOT_FOUND;
+            }
+
+            if (videoCodec_->id != codecid) {
+                videoCodec_ = nullptr;
+                return AVERROR(EINVAL);
+            }
+        }
+
         if (!videoCodec_) {
             videoCodec_ = avcodec_find_encoder(codecid);
         }
@@ -65,16 +146,57 @@ namespace media {
         encoder->framerate = framerate;
         encoder->bit_rate = bitrate;
         encoder->rc_max_rate = bitrate;
-        encoder->rc_buffer_size = bitrate / 2;
-        encoder->gop_size = static_cast<int>(av_q2d(framerate));
-        encoder->max_b_frames = 0;
         encoder->pix_fmt = pixfmt;
-        encoder->thread_count = threads > 4u ? 4 : static_cast<int>(threads);
-        encoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
-        encoder->flags |= AV_CODEC_FLAG_LOW_DELAY;
         encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-        int ret = avcodec_open2(encoder, videoCodec_, &opt);
+        int gopSize = static_cast<int>(av_q2d(framerate));
+        int maxBFrames = 0;
+
+        switch (profile) {
+        case EncodeProfile::RealtimeLowLatency:
+            // Frame threading delays output by thread_count frames, one slice per thread instead
+            encoder->rc_buffer_size = static_cast<int>(bitrate / 2);
+            encoder->thread_type = FF_THREAD_SLICE;
+            encoder->thread_count = threads > 4u ? 4 : static_cast<int>(threads);
+            encoder->slices = encoder->thread_count > 0 ? encoder->thread_count : 4;
+            break;
+        case EncodeProfile::LiveBalanced:
+            encoder->rc_buffer_size = static_cast<int>(bitrate);
+            encoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            encoder->thread_count = threads > 8u ? 8 : static_cast<int>(threads);
+            // Frame threads carry the parallelism, a single slice keeps prediction across the frame
+            encoder->slices = 1;
+            maxBFrames = 2;
+            break;
+        case EncodeProfile::OfflineThroughput:
+            encoder->rc_buffer_size = static_cast<int>(bitrate * 2);
+            encoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            encoder->thread_count = static_cast<int>(threads);
+            encoder->slices = 1;
+            gopSize *= 2;
+            maxBFrames = 3;
+            break;
+        default:
+            encoder->rc_buffer_size = static_cast<int>(bitrate / 2);
+            encoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            encoder->thread_count = threads > 4u ? 4 : static_cast<int>(threads);
+            break;
+        }
+
+        encoder->gop_size = gopSize_ > 0 ? gopSize_ : gopSize;
+        encoder->max_b_frames = maxBFrames_ >= 0 ? maxBFrames_ : maxBFrames;
+
+        if (encoder->max_b_frames == 0) {
+            encoder->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        }
+
+        // The caller keeps ownership of opt
+        AVDictionary* options = nullptr;
+        av_dict_copy(&options, opt, 0);
+        setProfileOptions(videoCodec_, profile, &options);
+
+        int ret = avcodec_open2(encoder, videoCodec_, &options);
+        av_dict_free(&options);
         if (ret < 0) {
             avcodec_free_context(&encoder);
             return ret;
@@ -86,6 +208,10 @@ namespace media {
             }
             });
 
+        videoProfile_ = profile;
+        pendingBitrate_.store(0);
+        forceKeyframe_.store(false);
+
         return 0;
     }
 
@@ -129,7 +255,12 @@ namespace media {
             av_channel_layout_default(&encoder->ch_layout, 2);
         }
 
-        int ret = avcodec_open2(encoder, audioCodec_, &opt);
+        // The caller keeps ownership of opt
+        AVDictionary* options = nullptr;
+        av_dict_copy(&options, opt, 0);
+
+        int ret = avcodec_open2(encoder, audioCodec_, &options);
+        av_dict_free(&options);
         if (ret < 0) {
             avcodec_free_context(&encoder);
             return ret;
@@ -144,21 +275,102 @@ namespace media {
         return 0;
     }
 
-    void MediaEncoder::flushVideoEncoder() {
-        if (videoEncoder_) {
-            avcodec_flush_buffers(videoEncoder_.get());
+    int MediaEncoder::sendVideoFrame(const AVFrame* frame) {
+        if (!videoEncoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        AVCodecContext* encoder = videoEncoder_.get();
+
+        // Rate control fields are re-read by reconfiguring encoders before each frame
+        int64_t bitrate = pendingBitrate_.exchange(0);
+        if (bitrate > 0) {
+            // Keep the profile's VBV size relative to the bitrate
+            int64_t previous = encoder->bit_rate;
+            encoder->rc_buffer_size = previous > 0
+                ? static_cast<int>(av_rescale(encoder->rc_buffer_size, bitrate, previous))
+                : static_cast<int>(bitrate / 2);
+            encoder->bit_rate = bitrate;
+            encoder->rc_max_rate = bitrate;
         }
+
+        if (frame && forceKeyframe_.exchange(false)) {
+            AVFrame* key = av_frame_clone(frame);
+            if (!key) {
+                forceKeyframe_.store(true);
+                return AVERROR(ENOMEM);
+            }
+
+            key->pict_type = AV_PICTURE_TYPE_I;
+            int ret = avcodec_send_frame(encoder, key);
+            av_frame_free(&key);
+
+            if (ret < 0) {
+                forceKeyframe_.store(true);
+            }
+            return ret;
+        }
+
+        return avcodec_send_frame(encoder, frame);
+    }
+
+    int MediaEncoder::receiveVideoPacket(AVPacket* pkt) {
+        if (!videoEncoder_ || !pkt) {
+            return AVERROR(EINVAL);
+        }
+
+        return avcodec_receive_packet(videoEncoder_.get(), pkt);
+    }
+
+    int MediaEncoder::sendAudioFrame(const AVFrame* frame) {
+        if (!audioEncoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        return avcodec_send_frame(audioEncoder_.get(), frame);
+    }
+
+    int MediaEncoder::receiveAudioPacket(AVPacket* pkt) {
+        if (!audioEncoder_ || !pkt) {
+            return AVERROR(EINVAL);
+        }
+
+        return avcodec_receive_packet(audioEncoder_.get(), pkt);
+    }
+
+    int MediaEncoder::flushVideoEncoder(const PacketCallback& callback) {
+        if (!videoEncoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        return drainEncoder(videoEncoder_.get(), callback);
+    }
+
+    int MediaEncoder::flushAudioEncoder(const PacketCallback& callback) {
+        if (!audioEncoder_) {
+            return AVERROR(EINVAL);
+        }
+
+        return drainEncoder(audioEncoder_.get(), callback);
     }
 
-    void MediaEncoder::flushAudioEncoder() {
-        if (audioEncoder_) {
-            avcodec_flush_buffers(audioEncoder_.get());
+    int MediaEncoder::setVideoBitrate(int64_t bitrate) {
+        if (bitrate <= 0) {
+            return AVERROR(EINVAL);
         }
+
+        pendingBitrate_.store(bitrate);
+        return 0;
+    }
+
+    void MediaEncoder::forceKeyframe() {
+        forceKeyframe_.store(true);
     }
 
     void MediaEncoder::resetVideoEncoder() {
         videoCodec_ = nullptr;
         videoEncoder_.reset();
+        videoProfile_ = EncodeProfile::Default;
     }
 
     void MediaEncoder::resetAudioEncoder() {
@@ -166,6 +378,39 @@ namespace media {
         audioEncoder_.reset();
     }
 
+    int MediaEncoder::drainEncoder(AVCodecContext* encoder, const PacketCallback& callback) {
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        int ret = avcodec_send_frame(encoder, nullptr);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            av_packet_free(&pkt);
+            return ret;
+        }
+
+        while ((ret = avcodec_receive_packet(encoder, pkt)) >= 0) {
+            if (callback) {
+                callback(pkt);
+            }
+            av_packet_unref(pkt);
+        }
+
+        av_packet_free(&pkt);
+
+        if (ret != AVERROR_EOF) {
+            return ret;
+        }
+
+        // Leave the encoder ready for new frames when the codec supports it
+        if (encoder->codec && (encoder->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+            avcodec_flush_buffers(encoder);
+        }
+
+        return 0;
+    }
+
     std::string MediaEncoder::getHWEncoderName(AVCodecID codecid, AVHWDeviceType type) const {
         std::string prefix;
 
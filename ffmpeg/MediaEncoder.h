@@ -1,11 +1,25 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <memory>
+#include <functional>
 #include "FFmpeg.h"
 
 namespace media {
 
+    enum class EncodeProfile {
+        // 1 s GOP, no B-frames, frame + slice threading, at most 4 threads
+        Default,
+        // Zero-latency tuning: no lookahead or B-frames, slice threading with one slice per thread,
+        // tight VBV (WebRTC/RTMP)
+        RealtimeLowLatency,
+        // Fast presets with a short lookahead and B-frames, one slice per frame (live streaming to HLS/FLV)
+        LiveBalanced,
+        // Slower presets, full lookahead and B-frames, 2 s GOP, one slice per frame, no thread cap (VOD/batch)
+        OfflineThroughput
+    };
+
     class MediaEncoder {
     public:
         MediaEncoder(const MediaEncoder&) = delete;
@@ -13,10 +27,14 @@ namespace media {
         MediaEncoder(MediaEncoder&&) = delete;
         MediaEncoder& operator=(MediaEncoder&&) = delete;
 
+        // Packet is only valid during the call, av_packet_ref() it to keep it
+        using PacketCallback = std::function<void(AVPacket* pkt)>;
+
         MediaEncoder();
         ~MediaEncoder();
 
-        // Open video encoder (codecid, width, height, bitrate, timebase, framerate, pixfmt, useHW, threads, opt) >= 0
+        // Open video encoder (codecid, width, height, bitrate, timebase, framerate, pixfmt, useHW, threads, opt, profile) >= 0
+        // The profile's codec options (preset, tune, lookahead, slices, ...) never override entries in opt
         int openVideoEncoder(AVCodecID codecid,
                              int width,
                              int height,
@@ -26,7 +44,8 @@ namespace media {
                              AVPixelFormat pixfmt,
                              bool useHW = false,
                              unsigned int threads = 0,
-                             AVDictionary* opt = nullptr);
+                             AVDictionary* opt = nullptr,
+                             EncodeProfile profile = EncodeProfile::Default);
 
         // Open audio encoder (codecid, framesize, samplerate, bitrate, timebase, chlayout, samplefmt, threads, opt) >= 0
         int openAudioEncoder(AVCodecID codecid,
@@ -39,10 +58,34 @@ namespace media {
                              unsigned int threads = 0,
                              AVDictionary* opt = nullptr);
 
-        // Flush video encoder
-        void flushVideoEncoder();
-        // Flush audio encoder
-        void flushAudioEncoder();
+        // Send video frame (frame, nullptr = drain) >= 0
+        int sendVideoFrame(const AVFrame* frame);
+        // Receive video packet (pkt) >= 0, AVERROR(EAGAIN)/AVERROR_EOF when no packet is ready
+        int receiveVideoPacket(AVPacket* pkt);
+        // Send audio frame (frame, nullptr = drain) >= 0
+        int sendAudioFrame(const AVFrame* frame);
+        // Receive audio packet (pkt) >= 0, AVERROR(EAGAIN)/AVERROR_EOF when no packet is ready
+        int receiveAudioPacket(AVPacket* pkt);
+
+        // Flush video encoder (callback) >= 0, drains buffered packets into callback
+        // Encoders without AV_CODEC_CAP_ENCODER_FLUSH must be reopened afterwards
+        int flushVideoEncoder(const PacketCallback& callback = nullptr);
+        // Flush audio encoder (callback) >= 0, drains buffered packets into callback
+        int flushAudioEncoder(const PacketCallback& callback = nullptr);
+
+        // Change video bitrate (bitrate) >= 0, safe from any thread, applied on the next sent frame
+        // Takes effect without a reopen on encoders that reconfigure at runtime (libx264, nvenc),
+        // others keep the open bitrate until reopened
+        int setVideoBitrate(int64_t bitrate);
+        // Encode the next sent video frame as a keyframe, safe from any thread
+        void forceKeyframe();
+        // GOP length in frames and max B-frames, used by the next openVideoEncoder
+        // Negative values restore the profile default
+        void setGopSize(int frames)     { gopSize_ = frames > 0 ? frames : -1; }
+        void setMaxBFrames(int frames)  { maxBFrames_ = frames >= 0 ? frames : -1; }
+        // Software encoder by name (libaom-av1, libsvtav1, ...) used by the next openVideoEncoder
+        // instead of the codec id default, empty restores the default
+        void setVideoEncoderName(const std::string& name) { videoEncoderName_ = name; }
 
         // Reset video encoder
         void resetVideoEncoder();
@@ -51,15 +94,27 @@ namespace media {
 
         AVCodecContext* videoEncoder() const { return videoEncoder_.get(); }
         AVCodecContext* audioEncoder() const { return audioEncoder_.get(); }
+        EncodeProfile videoProfile()    const { return videoProfile_; }
+        // GOP length and max B-frames set for the next open, -1 = profile default
+        int gopSize()                   const { return gopSize_; }
+        int maxBFrames()                const { return maxBFrames_; }
 
     private:
         std::string getHWEncoderName(AVCodecID codecid, AVHWDeviceType type) const;
+        static int drainEncoder(AVCodecContext* encoder, const PacketCallback& callback);
 
     private:
         const AVCodec* videoCodec_;
         const AVCodec* audioCodec_;
         std::shared_ptr<AVCodecContext> videoEncoder_;
         std::shared_ptr<AVCodecContext> audioEncoder_;
+
+        int gopSize_;
+        int maxBFrames_;
+        std::string videoEncoderName_;
+        EncodeProfile videoProfile_;
+        std::atomic<int64_t> pendingBitrate_;
+        std::atomic<bool> forceKeyframe_;
     };
 
 } // namespace media
\ No newline at end of file
@@ -193,6 +193,50 @@ namespace media {
         return 0;
     }
 
+    int MediaInput::videoKeyframes(std::vector<int64_t>& keyframes) {
+        keyframes.clear();
+
+        if (!inputCtx_ || videoParams_.index < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        AVStream* s = inputCtx_->streams[videoParams_.index];
+
+        int count = avformat_index_get_entries_count(s);
+        for (int i = 0; i < count; ++i) {
+            const AVIndexEntry* entry = avformat_index_get_entry(s, i);
+            if (entry && (entry->flags & AVINDEX_KEYFRAME)) {
+                keyframes.push_back(entry->timestamp);
+            }
+        }
+
+        if (!keyframes.empty()) {
+            return 0;
+        }
+
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        int ret = 0;
+        while ((ret = av_read_frame(inputCtx_.get(), pkt)) >= 0) {
+            if (pkt->stream_index == videoParams_.index && (pkt->flags & AV_PKT_FLAG_KEY)) {
+                keyframes.push_back(pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts);
+            }
+            av_packet_unref(pkt);
+        }
+
+        av_packet_free(&pkt);
+
+        if (ret != AVERROR_EOF) {
+            return ret;
+        }
+
+        int64_t start = inputCtx_->start_time != AV_NOPTS_VALUE ? inputCtx_->start_time : 0;
+        return av_seek_frame(inputCtx_.get(), -1, start, AVSEEK_FLAG_BACKWARD);
+    }
+
     void MediaInput::reset() {
         duration_ = 0;
         videoParams_ = VideoParams();
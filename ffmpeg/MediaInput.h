@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <memory>
 #include "FFmpeg.h"
 
@@ -55,6 +56,10 @@ namespace media {
         // Open network stream (RTSP/RTMP/HTTP/..., opt) >= 0
         int openNetworkStream(const std::string& url, AVDictionary* opt = nullptr);
 
+        // Get video keyframe timestamps in stream time_base (dts when known, else pts) >= 0
+        // Uses the demuxer index when present, otherwise scans packets and rewinds to the start
+        int videoKeyframes(std::vector<int64_t>& keyframes);
+
         // Reset current stream
         void reset();
 
@@ -1,13 +1,61 @@
+#include <cstdio>
 #include "MediaOutput.h"
+#include "SegmentStore.h"
 
 namespace media {
 
+    static void setDuration(AVDictionary** options, const char* key, int64_t us) {
+        // Duration options take seconds
+        char value[32];
+        std::snprintf(value, sizeof(value), "%.3f", us / 1000000.0);
+        av_dict_set(options, key, value, AV_DICT_DONT_OVERWRITE);
+    }
+
+    static void closeOutputIO(AVFormatContext* ctx) {
+        if (!ctx->pb || (ctx->flags & AVFMT_FLAG_CUSTOM_IO)) {
+            return;
+        }
+
+        if (SegmentStore::isAttached(ctx)) {
+            ctx->io_close2(ctx, ctx->pb);
+            ctx->pb = nullptr;
+        }
+        else {
+            avio_closep(&ctx->pb);
+        }
+    }
+
+    // A copied tag belongs to the source container (e.g. FLV) unless this muxer maps it to the same
+    // codec; a tag the caller picked on purpose (avc3, hev1) is kept, anything else the muxer chooses
+    static void checkCodecTag(const AVFormatContext* ctx, AVCodecParameters* par) {
+        if (par->codec_tag == 0) {
+            return;
+        }
+
+        if (!ctx->oformat->codec_tag || av_codec_get_id(ctx->oformat->codec_tag, par->codec_tag) != par->codec_id) {
+            par->codec_tag = 0;
+        }
+    }
+
     MediaOutput::MediaOutput()
         : videoIndex_(-1)
         , audioIndex_(-1)
         , videoStream_(nullptr)
         , audioStream_(nullptr)
-        , outputCtx_(nullptr) {
+        , outputCtx_(nullptr)
+        , async_(false)
+        , queue_(nullptr)
+        , flushIntervalMs_(100)
+        , packets_(0)
+        , bytes_(0)
+        , flushes_(0)
+        , maxQueueDepth_(0)
+        , blockedUs_(0)
+        , writeUs_(0)
+        , error_(0)
+        , ioStartUs_(0)
+        , ioTimeoutUs_(0)
+        , interrupted_(false) {
     }
 
     MediaOutput::~MediaOutput() {
@@ -26,88 +74,200 @@ namespace media {
             return AVERROR(EINVAL);
         }
 
-        reset();
+        return openOutput(url, format, nullptr, nullptr, videoEncoder, audioEncoder, nullptr);
+    }
 
-        AVFormatContext* ctx = nullptr;
-        int ret = avformat_alloc_output_context2(&ctx, nullptr, format.c_str(), url.c_str());
-        if (ret < 0) {
-            return ret;
+    int MediaOutput::writeFile(const std::string& url,
+                               const std::string& format,
+                               const AVCodecParameters* videoParams,
+                               AVRational videoTimebase,
+                               const AVCodecParameters* audioParams,
+                               AVRational audioTimebase) {
+        if (url.empty()) {
+            return AVERROR(EINVAL);
         }
 
-        if (videoEncoder) {
-            videoStream_ = avformat_new_stream(ctx, nullptr);
-            if (!videoStream_) {
-                avformat_free_context(ctx);
-                return AVERROR(ENOMEM);
-            }
-
-            ret = avcodec_parameters_from_context(videoStream_->codecpar, videoEncoder);
-            if (ret < 0) {
-                avformat_free_context(ctx);
-                return ret;
-            }
-
-            videoStream_->time_base = videoEncoder->time_base;
-            videoIndex_ = videoStream_->index;
+        if (!videoParams && !audioParams) {
+            return AVERROR(EINVAL);
         }
 
-        if (audioEncoder) {
-            audioStream_ = avformat_new_stream(ctx, nullptr);
-            if (!audioStream_) {
-                avformat_free_context(ctx);
-                return AVERROR(ENOMEM);
-            }
+        if ((videoParams && (videoTimebase.num <= 0 || videoTimebase.den <= 0)) ||
+            (audioParams && (audioTimebase.num <= 0 || audioTimebase.den <= 0))) {
+            return AVERROR(EINVAL);
+        }
 
-            ret = avcodec_parameters_from_context(audioStream_->codecpar, audioEncoder);
-            if (ret < 0) {
-                avformat_free_context(ctx);
-                return ret;
-            }
+        return openOutput(url, format, nullptr, nullptr, videoParams, videoTimebase, audioParams, audioTimebase, nullptr);
+    }
 
-            audioStream_->time_base = audioEncoder->time_base;
-            audioIndex_ = audioStream_->index;
+    int MediaOutput::writeNetwork(const std::string& url,
+                                  const std::string& format,
+                                  AVCodecContext* videoEncoder,
+                                  AVCodecContext* audioEncoder,
+                                  AVDictionary* opt) {
+        if (url.empty() || format.empty()) {
+            return AVERROR(EINVAL);
         }
 
-        if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
-            ret = avio_open(&ctx->pb, url.c_str(), AVIO_FLAG_WRITE);
-            if (ret < 0) {
-                avformat_free_context(ctx);
-                return ret;
-            }
+        if (format == "mpegts" || format == "rtsp") {
+            return writeNetwork(url, format, videoEncoder, audioEncoder, PacingOptions(), opt);
         }
 
-        ret = avformat_write_header(ctx, nullptr);
-        if (ret < 0) {
-            if (ctx->pb) {
-                avio_closep(&ctx->pb);
-            }
-            avformat_free_context(ctx);
-            return ret;
+        if (format != "flv" && format != "hls") {
+            return AVERROR(EINVAL);
         }
 
-        outputCtx_ = std::shared_ptr<AVFormatContext>(ctx, [](AVFormatContext* p) {
-            if (p) {
-                av_write_trailer(p);
-                if (p->pb) {
-                    avio_closep(&p->pb);
-                }
-                avformat_free_context(p);
-            }
-            });
+        if (!videoEncoder && !audioEncoder) {
+            return AVERROR(EINVAL);
+        }
 
-        return 0;
+        return openOutput(url, format, nullptr, nullptr, videoEncoder, audioEncoder, opt);
     }
 
     int MediaOutput::writeNetwork(const std::string& url,
                                   const std::string& format,
                                   AVCodecContext* videoEncoder,
                                   AVCodecContext* audioEncoder,
+                                  const PacingOptions& pacing,
                                   AVDictionary* opt) {
         if (url.empty() || format.empty()) {
             return AVERROR(EINVAL);
         }
 
-        if (format != "flv" && format != "hls") {
+        if (format != "flv" && format != "hls" && format != "mpegts" && format != "rtsp") {
+            return AVERROR(EINVAL);
+        }
+
+        if (pacing.packetSize < 0 || pacing.muxrate < 0 || pacing.burstBits < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (format == "mpegts" && pacing.packetSize % 188 != 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (!videoEncoder && !audioEncoder) {
+            return AVERROR(EINVAL);
+        }
+
+        // Caller options win over the defaults below
+        AVDictionary* options = nullptr;
+        av_dict_copy(&options, opt, 0);
+
+        const bool srt = url.compare(0, 6, "srt://") == 0;
+        const bool udp = url.compare(0, 6, "udp://") == 0;
+
+        if (format == "mpegts" || format == "rtsp") {
+            if (pacing.packetSize > 0) {
+                av_dict_set_int(&options, srt ? "payload_size" : "pkt_size", pacing.packetSize, AV_DICT_DONT_OVERWRITE);
+            }
+        }
+
+        // Pacing belongs to the socket protocols; RTSP runs its own RTP sockets and takes neither option
+        int64_t bitrate = pacing.bitrate;
+        if (bitrate == 0) {
+            // Encoder rate plus room for container overhead and VBR peaks, unknown rates leave pacing off
+            int64_t encoded = (videoEncoder ? videoEncoder->bit_rate : 0) + (audioEncoder ? audioEncoder->bit_rate : 0);
+            bitrate = encoded > 0 ? encoded + encoded / 4 : 0;
+        }
+
+        if (bitrate > 0 && (srt || udp)) {
+            if (srt) {
+                // SRT paces by itself, maxbw is in bytes per second
+                av_dict_set_int(&options, "maxbw", bitrate / 8, AV_DICT_DONT_OVERWRITE);
+            }
+            else {
+                // The UDP protocol then sends from its own thread at this rate, a keyframe no
+                // longer leaves as one burst
+                av_dict_set_int(&options, "bitrate", bitrate, AV_DICT_DONT_OVERWRITE);
+                if (pacing.burstBits > 0) {
+                    av_dict_set_int(&options, "burst_bits", pacing.burstBits, AV_DICT_DONT_OVERWRITE);
+                }
+            }
+        }
+
+        if (format == "mpegts" && pacing.muxrate > 0) {
+            av_dict_set_int(&options, "muxrate", pacing.muxrate, AV_DICT_DONT_OVERWRITE);
+        }
+
+        if (pacing.flushPackets) {
+            av_dict_set(&options, "flush_packets", "1", AV_DICT_DONT_OVERWRITE);
+        }
+
+        int ret = openOutput(url, format, nullptr, nullptr, videoEncoder, audioEncoder, options);
+        av_dict_free(&options);
+        return ret;
+    }
+
+    int MediaOutput::writeFragmented(const std::string& url,
+                                     const std::string& format,
+                                     AVCodecContext* videoEncoder,
+                                     AVCodecContext* audioEncoder,
+                                     const FragmentOptions& fragment,
+                                     AVDictionary* opt) {
+        if (url.empty() || fragment.fragmentUs <= 0 || fragment.partUs < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (format != "mp4" && format != "dash" && format != "hls") {
+            return AVERROR(EINVAL);
+        }
+
+        if (format == "hls" && fragment.partUs > 0) {
+            return AVERROR(ENOSYS);
+        }
+
+        if (!videoEncoder && !audioEncoder) {
+            return AVERROR(EINVAL);
+        }
+
+        // Caller options win over the defaults below
+        AVDictionary* options = nullptr;
+        av_dict_copy(&options, opt, 0);
+
+        const bool chunked = fragment.partUs > 0;
+
+        if (format == "mp4") {
+            // moov up front, a moof per fragment: a crash loses at most the open fragment
+            av_dict_set(&options, "movflags", "+frag_keyframe+empty_moov+default_base_moof+cmaf", AV_DICT_DONT_OVERWRITE);
+            if (chunked) {
+                av_dict_set_int(&options, "frag_duration", fragment.partUs, AV_DICT_DONT_OVERWRITE);
+            }
+            else {
+                av_dict_set_int(&options, "min_frag_duration", fragment.fragmentUs, AV_DICT_DONT_OVERWRITE);
+            }
+        }
+        else if (format == "dash") {
+            setDuration(&options, "seg_duration", fragment.fragmentUs);
+            av_dict_set(&options, "dash_segment_type", "mp4", AV_DICT_DONT_OVERWRITE);
+            av_dict_set(&options, "use_template", "1", AV_DICT_DONT_OVERWRITE);
+            av_dict_set(&options, "use_timeline", "0", AV_DICT_DONT_OVERWRITE);
+            av_dict_set(&options, "hls_playlist", "1", AV_DICT_DONT_OVERWRITE);
+            if (chunked) {
+                // Chunks are pushed as they are produced, players start one chunk behind live
+                av_dict_set(&options, "streaming", "1", AV_DICT_DONT_OVERWRITE);
+                av_dict_set(&options, "ldash", "1", AV_DICT_DONT_OVERWRITE);
+                av_dict_set(&options, "lhls", "1", AV_DICT_DONT_OVERWRITE);
+                av_dict_set(&options, "frag_type", "duration", AV_DICT_DONT_OVERWRITE);
+                setDuration(&options, "frag_duration", fragment.partUs);
+            }
+        }
+        else {
+            setDuration(&options, "hls_time", fragment.fragmentUs);
+            av_dict_set(&options, "hls_segment_type", "fmp4", AV_DICT_DONT_OVERWRITE);
+            av_dict_set(&options, "hls_flags", "independent_segments", AV_DICT_DONT_OVERWRITE);
+        }
+
+        int ret = openOutput(url, format, nullptr, nullptr, videoEncoder, audioEncoder, options);
+        av_dict_free(&options);
+        return ret;
+    }
+
+    int MediaOutput::writeIO(AVIOContext* io,
+                             const std::string& format,
+                             AVCodecContext* videoEncoder,
+                             AVCodecContext* audioEncoder,
+                             AVDictionary* opt) {
+        if (!io || format.empty()) {
             return AVERROR(EINVAL);
         }
 
@@ -115,61 +275,171 @@ namespace media {
             return AVERROR(EINVAL);
         }
 
+        return openOutput("", format, io, nullptr, videoEncoder, audioEncoder, opt);
+    }
+
+    int MediaOutput::writeStore(SegmentStore* store,
+                                const std::string& url,
+                                const std::string& format,
+                                AVCodecContext* videoEncoder,
+                                AVCodecContext* audioEncoder,
+                                AVDictionary* opt) {
+        if (!store || url.empty() || format.empty()) {
+            return AVERROR(EINVAL);
+        }
+
+        if (!videoEncoder && !audioEncoder) {
+            return AVERROR(EINVAL);
+        }
+
+        return openOutput(url, format, nullptr, store, videoEncoder, audioEncoder, opt);
+    }
+
+    int MediaOutput::openOutput(const std::string& url,
+                                const std::string& format,
+                                AVIOContext* io,
+                                SegmentStore* store,
+                                AVCodecContext* videoEncoder,
+                                AVCodecContext* audioEncoder,
+                                AVDictionary* opt) {
+        auto freeParams = [](AVCodecParameters* p) {
+            avcodec_parameters_free(&p);
+            };
+
+        std::unique_ptr<AVCodecParameters, decltype(freeParams)> videoParams(nullptr, freeParams);
+        std::unique_ptr<AVCodecParameters, decltype(freeParams)> audioParams(nullptr, freeParams);
+        AVRational videoTimebase = { 0, 1 };
+        AVRational audioTimebase = { 0, 1 };
+
+        if (videoEncoder) {
+            videoParams.reset(avcodec_parameters_alloc());
+            if (!videoParams) {
+                return AVERROR(ENOMEM);
+            }
+
+            int ret = avcodec_parameters_from_context(videoParams.get(), videoEncoder);
+            if (ret < 0) {
+                return ret;
+            }
+
+            videoTimebase = videoEncoder->time_base;
+        }
+
+        if (audioEncoder) {
+            audioParams.reset(avcodec_parameters_alloc());
+            if (!audioParams) {
+                return AVERROR(ENOMEM);
+            }
+
+            int ret = avcodec_parameters_from_context(audioParams.get(), audioEncoder);
+            if (ret < 0) {
+                return ret;
+            }
+
+            audioTimebase = audioEncoder->time_base;
+        }
+
+        return openOutput(url, format, io, store, videoParams.get(), videoTimebase, audioParams.get(), audioTimebase, opt);
+    }
+
+    int MediaOutput::openOutput(const std::string& url,
+                                const std::string& format,
+                                AVIOContext* io,
+                                SegmentStore* store,
+                                const AVCodecParameters* videoParams,
+                                AVRational videoTimebase,
+                                const AVCodecParameters* audioParams,
+                                AVRational audioTimebase,
+                                AVDictionary* opt) {
         reset();
+        interrupted_.store(false);
 
         AVFormatContext* ctx = nullptr;
-        int ret = avformat_alloc_output_context2(&ctx, nullptr, format.c_str(), url.c_str());
+        int ret = avformat_alloc_output_context2(&ctx, nullptr,
+                                                 format.empty() ? nullptr : format.c_str(),
+                                                 url.empty() ? nullptr : url.c_str());
         if (ret < 0) {
             return ret;
         }
 
-        if (videoEncoder) {
+        // Network protocols poll this while they wait, muxers that connect themselves (rtsp) too
+        ctx->interrupt_callback.callback = &MediaOutput::interruptCallback;
+        ctx->interrupt_callback.opaque = this;
+
+        if (videoParams) {
             videoStream_ = avformat_new_stream(ctx, nullptr);
             if (!videoStream_) {
                 avformat_free_context(ctx);
                 return AVERROR(ENOMEM);
             }
 
-            ret = avcodec_parameters_from_context(videoStream_->codecpar, videoEncoder);
+            ret = avcodec_parameters_copy(videoStream_->codecpar, videoParams);
             if (ret < 0) {
                 avformat_free_context(ctx);
                 return ret;
             }
 
-            videoStream_->time_base = videoEncoder->time_base;
+            checkCodecTag(ctx, videoStream_->codecpar);
+            videoStream_->time_base = videoTimebase;
             videoIndex_ = videoStream_->index;
         }
 
-        if (audioEncoder) {
+        if (audioParams) {
             audioStream_ = avformat_new_stream(ctx, nullptr);
             if (!audioStream_) {
                 avformat_free_context(ctx);
                 return AVERROR(ENOMEM);
             }
 
-            ret = avcodec_parameters_from_context(audioStream_->codecpar, audioEncoder);
+            ret = avcodec_parameters_copy(audioStream_->codecpar, audioParams);
             if (ret < 0) {
                 avformat_free_context(ctx);
                 return ret;
             }
 
-            audioStream_->time_base = audioEncoder->time_base;
+            checkCodecTag(ctx, audioStream_->codecpar);
+            audioStream_->time_base = audioTimebase;
             audioIndex_ = audioStream_->index;
         }
 
-        if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
-            ret = avio_open(&ctx->pb, url.c_str(), AVIO_FLAG_WRITE);
+        if (io) {
+            ctx->pb = io;
+            ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+        else if (store) {
+            // Segmenting muxers open their files through io_open themselves
+            ret = store->attach(ctx);
+            if (ret >= 0 && !(ctx->oformat->flags & AVFMT_NOFILE)) {
+                ret = ctx->io_open(ctx, &ctx->pb, url.c_str(), AVIO_FLAG_WRITE, nullptr);
+            }
+            if (ret < 0) {
+                avformat_free_context(ctx);
+                return ret;
+            }
+        }
+
+        // The caller keeps ownership of opt
+        AVDictionary* options = nullptr;
+        av_dict_copy(&options, opt, 0);
+
+        if (!io && !store && !(ctx->oformat->flags & AVFMT_NOFILE)) {
+            // Protocol options (pkt_size, bitrate, latency, ...) are taken here, the rest by the muxer
+            ioStartUs_.store(av_gettime_relative());
+            ret = avio_open2(&ctx->pb, url.c_str(), AVIO_FLAG_WRITE, &ctx->interrupt_callback, &options);
+            ioStartUs_.store(0);
             if (ret < 0) {
+                av_dict_free(&options);
                 avformat_free_context(ctx);
                 return ret;
             }
         }
 
-        ret = avformat_write_header(ctx, &opt);
+        ioStartUs_.store(av_gettime_relative());
+        ret = avformat_write_header(ctx, &options);
+        ioStartUs_.store(0);
+        av_dict_free(&options);
         if (ret < 0) {
-            if (ctx->pb) {
-                avio_closep(&ctx->pb);
-            }
+            closeOutputIO(ctx);
             avformat_free_context(ctx);
             return ret;
         }
@@ -177,9 +447,7 @@ namespace media {
         outputCtx_ = std::shared_ptr<AVFormatContext>(ctx, [](AVFormatContext* p) {
             if (p) {
                 av_write_trailer(p);
-                if (p->pb) {
-                    avio_closep(&p->pb);
-                }
+                closeOutputIO(p);
                 avformat_free_context(p);
             }
             });
@@ -187,12 +455,245 @@ namespace media {
         return 0;
     }
 
+    int MediaOutput::startAsync(size_t maxPackets, int flushIntervalMs) {
+        if (!outputCtx_) {
+            return AVERROR(EINVAL);
+        }
+
+        if (async_.load()) {
+            return AVERROR(EBUSY);
+        }
+
+        queue_.reset(new PacketQueue(0, std::max<size_t>(1, maxPackets)));
+        queue_->setClearCallback([](AVPacket* pkt) {
+            av_packet_free(&pkt);
+            });
+
+        flushIntervalMs_ = std::max(0, flushIntervalMs);
+
+        // Flushes are batched by the mux thread instead of after every packet
+        outputCtx_->flush_packets = 0;
+
+        async_.store(true);
+        thread_ = std::thread(&MediaOutput::muxThread, this);
+        return 0;
+    }
+
+    void MediaOutput::stopAsync() {
+        if (!async_.load()) {
+            return;
+        }
+
+        // A packet without data tells the mux thread to drain and exit
+        AVPacket* eos = av_packet_alloc();
+        if (!eos || !queue_->enqueue(eos)) {
+            av_packet_free(&eos);
+            queue_->lock();
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        queue_->lock();
+        queue_->clear();
+        async_.store(false);
+    }
+
+    int MediaOutput::writePacket(AVPacket* pkt) {
+        if (!pkt || !outputCtx_) {
+            return AVERROR(EINVAL);
+        }
+
+        int error = error_.load();
+        if (error < 0) {
+            av_packet_unref(pkt);
+            return error;
+        }
+
+        int64_t start = av_gettime_relative();
+
+        if (!async_.load()) {
+            int ret = writeInterleaved(pkt);
+            blockedUs_.fetch_add(av_gettime_relative() - start);
+            return ret;
+        }
+
+        if (!pkt->data && !pkt->side_data_elems) {
+            return 0;
+        }
+
+        AVPacket* queued = av_packet_alloc();
+        if (!queued) {
+            av_packet_unref(pkt);
+            return AVERROR(ENOMEM);
+        }
+
+        av_packet_move_ref(queued, pkt);
+
+        bool full = queue_->full();
+        if (!queue_->enqueue(queued)) {
+            av_packet_free(&queued);
+            return error_.load() < 0 ? error_.load() : AVERROR_EXIT;
+        }
+
+        if (full) {
+            blockedUs_.fetch_add(av_gettime_relative() - start);
+        }
+
+        size_t depth = queue_->size();
+        size_t peak = maxQueueDepth_.load();
+        while (depth > peak && !maxQueueDepth_.compare_exchange_weak(peak, depth)) {
+        }
+
+        return 0;
+    }
+
+    MuxStats MediaOutput::stats() const {
+        MuxStats s;
+        s.packets = packets_.load();
+        s.bytes = bytes_.load();
+        s.flushes = flushes_.load();
+        s.queueDepth = async_.load() && queue_ ? queue_->size() : 0;
+        s.maxQueueDepth = maxQueueDepth_.load();
+        s.blockedUs = blockedUs_.load();
+        s.writeUs = writeUs_.load();
+        s.error = error_.load();
+        return s;
+    }
+
+    int MediaOutput::writeInterleaved(AVPacket* pkt) {
+        std::lock_guard<std::mutex> locker(writeMutex_);
+
+        int size = pkt->size;
+        int64_t start = av_gettime_relative();
+
+        ioStartUs_.store(start);
+        int ret = av_interleaved_write_frame(outputCtx_.get(), pkt);
+        ioStartUs_.store(0);
+        writeUs_.fetch_add(av_gettime_relative() - start);
+
+        if (ret < 0) {
+            int expected = 0;
+            error_.compare_exchange_strong(expected, ret);
+            return ret;
+        }
+
+        packets_.fetch_add(1);
+        bytes_.fetch_add(size);
+        return 0;
+    }
+
+    void MediaOutput::muxThread() {
+        AVFormatContext* ctx = outputCtx_.get();
+        int64_t lastFlush = av_gettime_relative();
+        bool dirty = false;
+
+        for (;;) {
+            AVPacket* pkt = queue_->dequeue();
+            if (!pkt) {
+                break;
+            }
+
+            bool eos = !pkt->data && !pkt->side_data_elems;
+            if (!eos && error_.load() == 0) {
+                writeInterleaved(pkt);
+                dirty = true;
+            }
+            av_packet_free(&pkt);
+
+            // Flush when the queue runs dry or the interval expires, not per packet
+            int64_t now = av_gettime_relative();
+            bool idle = queue_->empty();
+            if (dirty && ctx->pb && (eos || idle || now - lastFlush >= flushIntervalMs_ * 1000LL)) {
+                std::lock_guard<std::mutex> locker(writeMutex_);
+                ioStartUs_.store(now);
+                avio_flush(ctx->pb);
+                ioStartUs_.store(0);
+                flushes_.fetch_add(1);
+                lastFlush = now;
+                dirty = false;
+            }
+
+            if (eos) {
+                break;
+            }
+        }
+    }
+
     void MediaOutput::reset() {
+        stopAsync();
+
         videoIndex_ = -1;
         audioIndex_ = -1;
         videoStream_ = nullptr;
         audioStream_ = nullptr;
+
+        // The trailer write is bounded by the IO timeout as well
+        ioStartUs_.store(outputCtx_ ? av_gettime_relative() : 0);
         outputCtx_.reset();
+        ioStartUs_.store(0);
+        queue_.reset();
+
+        packets_.store(0);
+        bytes_.store(0);
+        flushes_.store(0);
+        maxQueueDepth_.store(0);
+        blockedUs_.store(0);
+        writeUs_.store(0);
+        error_.store(0);
+    }
+
+    int MediaOutput::interruptCallback(void* opaque) {
+        MediaOutput* output = static_cast<MediaOutput*>(opaque);
+        if (output->interrupted_.load()) {
+            return 1;
+        }
+
+        int64_t timeout = output->ioTimeoutUs_.load();
+        int64_t start = output->ioStartUs_.load();
+        return timeout > 0 && start > 0 && av_gettime_relative() - start > timeout ? 1 : 0;
+    }
+
+    int MediaOutput::copyEncoderContext(const AVCodecContext* src, std::shared_ptr<AVCodecContext>& dst) {
+        dst.reset();
+
+        if (!src) {
+            return 0;
+        }
+
+        AVCodecParameters* par = avcodec_parameters_alloc();
+        if (!par) {
+            return AVERROR(ENOMEM);
+        }
+
+        AVCodecContext* ctx = avcodec_alloc_context3(nullptr);
+        if (!ctx) {
+            avcodec_parameters_free(&par);
+            return AVERROR(ENOMEM);
+        }
+
+        int ret = avcodec_parameters_from_context(par, src);
+        if (ret >= 0) {
+            ret = avcodec_parameters_to_context(ctx, par);
+        }
+        avcodec_parameters_free(&par);
+
+        if (ret < 0) {
+            avcodec_free_context(&ctx);
+            return ret;
+        }
+
+        ctx->time_base = src->time_base;
+        ctx->framerate = src->framerate;
+
+        dst = std::shared_ptr<AVCodecContext>(ctx, [](AVCodecContext* p) {
+            if (p) {
+                avcodec_free_context(&p);
+            }
+            });
+
+        return 0;
     }
 
 } // namespace media
\ No newline at end of file
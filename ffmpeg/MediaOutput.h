@@ -1,11 +1,54 @@
 #pragma once
 
+#include <mutex>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <memory>
 #include "FFmpeg.h"
+#include "../queue/MediaQueue.h"
 
 namespace media {
 
+    class SegmentStore;
+
+    struct MuxStats {
+        int64_t packets = 0;
+        int64_t bytes = 0;
+        int64_t flushes = 0;
+        // Packets waiting for the mux thread, and the highest depth seen
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+        // Time callers spent blocked in writePacket (full queue, or the write itself in sync mode)
+        int64_t blockedUs = 0;
+        // Time spent inside av_interleaved_write_frame
+        int64_t writeUs = 0;
+        // First write error (0 = none)
+        int error = 0;
+    };
+
+    struct FragmentOptions {
+        // Fragment (segment) duration, cut on the first keyframe after it, keep the encoder GOP a divisor
+        int64_t fragmentUs = 2000000;
+        // Chunk duration inside a fragment (CMAF chunk / low latency part), 0 = whole fragments only
+        int64_t partUs = 0;
+    };
+
+    struct PacingOptions {
+        // Network payload per datagram (UDP pkt_size, SRT payload_size, RTSP pkt_size),
+        // a multiple of 188 for MPEG-TS; 0 = protocol default
+        int packetSize = 1316;
+        // MPEG-TS mux rate, > 0 pads to constant bitrate with null packets; 0 = VBR
+        int64_t muxrate = 0;
+        // Send rate the UDP socket paces datagrams to instead of bursting whole frames (SRT: maxbw),
+        // udp:// and srt:// only; 0 = the encoders' bit_rate plus a quarter headroom, < 0 = off
+        // burstBits bounds how far UDP may run ahead; 0 = protocol default
+        int64_t bitrate = 0;
+        int64_t burstBits = 0;
+        // Flush the IO after every packet, lowest latency (sync writes, startAsync batches flushes)
+        bool flushPackets = true;
+    };
+
     class MediaOutput {
     public:
         MediaOutput(const MediaOutput&) = delete;
@@ -13,6 +56,8 @@ namespace media {
         MediaOutput(MediaOutput&&) = delete;
         MediaOutput& operator=(MediaOutput&&) = delete;
 
+        using PacketQueue = MediaQueue<AVPacket>;
+
         MediaOutput();
         ~MediaOutput();
 
@@ -21,28 +66,136 @@ namespace media {
                       const std::string& format = "",
                       AVCodecContext* videoEncoder = nullptr,
                       AVCodecContext* audioEncoder = nullptr);
-        // Write Network (RTSP, HLS)/(HTTP, HLS)/(RTMP, FLV)/...+(videoEncoder, audioEncoder, opt) >= 0
+        // Write file from stream parameters (filename, mp4, videoParams, videoTimebase, audioParams, audioTimebase) >= 0
+        // For stream copy: parameters and time_base straight from MediaInput streams, no encoder needed;
+        // codec_tag is kept only when the muxer maps it to the same codec (avc3 into mp4), else cleared
+        int writeFile(const std::string& url,
+                      const std::string& format,
+                      const AVCodecParameters* videoParams,
+                      AVRational videoTimebase,
+                      const AVCodecParameters* audioParams = nullptr,
+                      AVRational audioTimebase = { 0, 1 });
+        // Write Network (RTSP, HLS)/(HTTP, HLS)/(RTMP, FLV)/(UDP/SRT, MPEGTS)/(RTSP, RTSP)/...+(videoEncoder, audioEncoder, opt) >= 0
+        // mpegts and rtsp use the default PacingOptions
         int writeNetwork(const std::string& url,
                          const std::string& format,
                          AVCodecContext* videoEncoder = nullptr,
                          AVCodecContext* audioEncoder = nullptr,
                          AVDictionary* opt = nullptr);
+        // Write Network with pacing (url, flv/hls/mpegts/rtsp, videoEncoder, audioEncoder, pacing, opt) >= 0
+        // Protocol options in opt (udp, srt, rtsp) are passed to the IO open as well as the muxer
+        int writeNetwork(const std::string& url,
+                         const std::string& format,
+                         AVCodecContext* videoEncoder,
+                         AVCodecContext* audioEncoder,
+                         const PacingOptions& pacing,
+                         AVDictionary* opt = nullptr);
+
+        // Write fragmented MP4/CMAF (url, mp4/dash/hls, videoEncoder, audioEncoder, fragment, opt) >= 0
+        // mp4: one fragmented file, playable while written; dash: segments + MPD (and an HLS playlist),
+        // chunked low latency when partUs > 0; hls: fMP4 segments, partUs is not supported
+        int writeFragmented(const std::string& url,
+                            const std::string& format,
+                            AVCodecContext* videoEncoder = nullptr,
+                            AVCodecContext* audioEncoder = nullptr,
+                            const FragmentOptions& fragment = FragmentOptions(),
+                            AVDictionary* opt = nullptr);
+
+        // Write custom IO (io, format, videoEncoder, audioEncoder, opt) >= 0, e.g. FileSink::ioContext()
+        // The caller keeps io and closes it after reset() has written the trailer
+        int writeIO(AVIOContext* io,
+                    const std::string& format,
+                    AVCodecContext* videoEncoder = nullptr,
+                    AVCodecContext* audioEncoder = nullptr,
+                    AVDictionary* opt = nullptr);
+
+        // Write into memory (store, url, hls, videoEncoder, audioEncoder, opt) >= 0
+        // Every file the muxer opens (playlist, segments, init segment) lands in store under the name
+        // the muxer gives it, nothing touches disk; the hls temp_file flag renames on disk, leave it off
+        int writeStore(SegmentStore* store,
+                       const std::string& url,
+                       const std::string& format,
+                       AVCodecContext* videoEncoder = nullptr,
+                       AVCodecContext* audioEncoder = nullptr,
+                       AVDictionary* opt = nullptr);
+
+        // Start async mux thread (maxPackets, flushIntervalMs) >= 0, after writeFile/writeNetwork
+        // writePacket then only queues, the thread interleaves, writes and flushes in batches
+        int startAsync(size_t maxPackets = 256, int flushIntervalMs = 100);
+        // Stop async mux thread, queued packets are written first
+        void stopAsync();
+
+        // Write packet (pkt) >= 0, timestamps in the output stream time_base, safe from any thread
+        // The packet reference is taken over, pkt is blank on return
+        int writePacket(AVPacket* pkt);
+
+        // Bound each blocking network IO call (open, header, packet write, flush, trailer) to timeoutUs,
+        // an expired call fails with AVERROR_EXIT; 0 = no limit, takes effect on the next call
+        void setIOTimeout(int64_t timeoutUs) { ioTimeoutUs_.store(timeoutUs > 0 ? timeoutUs : 0); }
+        // Abort blocked and further network IO, safe from any thread, cleared by the next open
+        void interrupt()                     { interrupted_.store(true); }
 
         // Reset current write
         void reset();
 
+        // Copy encoder stream settings (src, dst) >= 0, to open outputs later without the live encoder
+        static int copyEncoderContext(const AVCodecContext* src, std::shared_ptr<AVCodecContext>& dst);
+
+        bool isAsync()                   const { return async_.load(); }
+        MuxStats stats() const;
+
         int videoIndex()                 const { return videoIndex_; }
         int audioIndex()                 const { return audioIndex_; }
         AVStream* videoStream()          const { return videoStream_; }
         AVStream* audioStream()          const { return audioStream_; }
         AVFormatContext* outputContext() const { return outputCtx_.get(); }
 
+    private:
+        int openOutput(const std::string& url,
+                       const std::string& format,
+                       AVIOContext* io,
+                       SegmentStore* store,
+                       AVCodecContext* videoEncoder,
+                       AVCodecContext* audioEncoder,
+                       AVDictionary* opt);
+        int openOutput(const std::string& url,
+                       const std::string& format,
+                       AVIOContext* io,
+                       SegmentStore* store,
+                       const AVCodecParameters* videoParams,
+                       AVRational videoTimebase,
+                       const AVCodecParameters* audioParams,
+                       AVRational audioTimebase,
+                       AVDictionary* opt);
+        int writeInterleaved(AVPacket* pkt);
+        void muxThread();
+        static int interruptCallback(void* opaque);
+
     private:
         int videoIndex_;
         int audioIndex_;
         AVStream* videoStream_;
         AVStream* audioStream_;
         std::shared_ptr<AVFormatContext> outputCtx_;
+
+        std::mutex writeMutex_;
+        std::atomic<bool> async_;
+        std::thread thread_;
+        std::unique_ptr<PacketQueue> queue_;
+        int flushIntervalMs_;
+
+        std::atomic<int64_t> packets_;
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> flushes_;
+        std::atomic<size_t> maxQueueDepth_;
+        std::atomic<int64_t> blockedUs_;
+        std::atomic<int64_t> writeUs_;
+        std::atomic<int> error_;
+
+        // Start of the IO call in progress (0 = none), checked by interruptCallback
+        std::atomic<int64_t> ioStartUs_;
+        std::atomic<int64_t> ioTimeoutUs_;
+        std::atomic<bool> interrupted_;
     };
 
 } // namespace media
\ No newline at end of file
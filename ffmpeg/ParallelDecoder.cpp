@@ -0,0 +1,355 @@
+#include <thread>
+#include <algorithm>
+#include "ParallelDecoder.h"
+
+namespace media {
+
+    ParallelDecoder::ParallelDecoder()
+        : stopped_(false)
+        , segmentCount_(0)
+        , frameCount_(0)
+        , ordered_(true)
+        , callback_(nullptr) {
+    }
+
+    ParallelDecoder::~ParallelDecoder() {
+        stop();
+    }
+
+    int ParallelDecoder::decodeFile(const std::string& url,
+                                    FrameCallback callback,
+                                    unsigned int workers,
+                                    bool ordered,
+                                    size_t maxQueuedFrames) {
+        if (url.empty() || !callback) {
+            return AVERROR(EINVAL);
+        }
+
+        stopped_.store(false);
+        frameCount_.store(0);
+
+        std::vector<int64_t> keyframes;
+        {
+            MediaInput input;
+            int ret = input.openFileStream(url);
+            if (ret < 0) {
+                return ret;
+            }
+
+            if (!input.hasVideoStream()) {
+                return AVERROR_STREAM_NOT_FOUND;
+            }
+
+            ret = input.videoKeyframes(keyframes);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        if (workers == 0) {
+            workers = cores;
+        }
+
+        // A few segments per worker keeps cores busy when GOP decode times differ
+        segments_ = splitSegments(keyframes, static_cast<size_t>(workers) * 4);
+        segmentCount_.store(static_cast<int>(segments_.size()));
+
+        workers = std::min(workers, static_cast<unsigned int>(segments_.size()));
+        unsigned int threads = std::max(1u, cores / workers);
+
+        ordered_ = ordered;
+        callback_ = std::move(callback);
+
+        {
+            std::lock_guard<std::mutex> locker(queuesMutex_);
+            queues_.clear();
+
+            if (ordered_) {
+                for (size_t i = 0; i < segments_.size(); ++i) {
+                    std::unique_ptr<FrameQueue> queue(new FrameQueue(0, std::max<size_t>(1, maxQueuedFrames)));
+                    queue->setClearCallback([](AVFrame* frame) {
+                        av_frame_free(&frame);
+                        });
+                    queues_.push_back(std::move(queue));
+                }
+            }
+        }
+
+        std::atomic<size_t> next(0);
+        std::atomic<int> error(0);
+        std::vector<std::thread> pool;
+
+        for (unsigned int w = 0; w < workers; ++w) {
+            pool.emplace_back([this, &url, &next, &error, threads]() {
+                for (;;) {
+                    size_t i = next.fetch_add(1);
+                    if (i >= segments_.size() || stopped_.load()) {
+                        break;
+                    }
+
+                    int ret = decodeSegment(url, segments_[i], threads, [this, i](AVFrame* frame) {
+                        return deliverFrame(frame, static_cast<int>(i));
+                        }, &stopped_);
+
+                    if (ordered_) {
+                        // A frame without buffers marks the end of the segment
+                        AVFrame* eos = av_frame_alloc();
+                        if (eos && !queues_[i]->enqueue(eos)) {
+                            av_frame_free(&eos);
+                        }
+                    }
+
+                    if (ret < 0) {
+                        int expected = 0;
+                        error.compare_exchange_strong(expected, ret);
+                        stop();
+                        break;
+                    }
+                }
+                });
+        }
+
+        if (ordered_) {
+            for (size_t i = 0; i < queues_.size() && !stopped_.load(); ++i) {
+                for (;;) {
+                    AVFrame* frame = queues_[i]->dequeue();
+                    if (!frame) {
+                        break;
+                    }
+
+                    if (!frame->buf[0]) {
+                        av_frame_free(&frame);
+                        break;
+                    }
+
+                    callback_(frame, static_cast<int>(i));
+                    av_frame_free(&frame);
+                }
+            }
+        }
+
+        for (std::thread& t : pool) {
+            t.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(queuesMutex_);
+            for (auto& queue : queues_) {
+                queue->lock();
+                queue->clear();
+            }
+            queues_.clear();
+        }
+
+        callback_ = nullptr;
+
+        if (error.load() < 0) {
+            return error.load();
+        }
+
+        return stopped_.load() ? AVERROR_EXIT : 0;
+    }
+
+    void ParallelDecoder::stop() {
+        stopped_.store(true);
+
+        std::lock_guard<std::mutex> locker(queuesMutex_);
+        for (auto& queue : queues_) {
+            queue->lock();
+        }
+    }
+
+    int ParallelDecoder::decodeSegment(const std::string& url,
+                                       const Segment& segment,
+                                       unsigned int threads,
+                                       const SegmentCallback& callback,
+                                       const std::atomic<bool>* stopped) {
+        MediaInput input;
+        int ret = input.openFileStream(url);
+        if (ret < 0) {
+            return ret;
+        }
+
+        MediaDecoder decoder;
+        ret = decoder.openVideoDecoder(input.inputContext(), false, threads, DecodeProfile::Throughput);
+        if (ret < 0) {
+            return ret;
+        }
+
+        AVFormatContext* ctx = input.inputContext();
+        AVCodecContext* codec = decoder.videoDecoder();
+        int stream = input.videoParams().index;
+
+        if (segment.startTs != AV_NOPTS_VALUE) {
+            ret = avformat_seek_file(ctx, stream, INT64_MIN, segment.startTs, segment.startTs, 0);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        AVPacket* pkt = av_packet_alloc();
+        AVFrame* frame = av_frame_alloc();
+        if (!pkt || !frame) {
+            av_packet_free(&pkt);
+            av_frame_free(&frame);
+            return AVERROR(ENOMEM);
+        }
+
+        bool started = false;
+        size_t gops = 0;
+        int64_t startPts = AV_NOPTS_VALUE;
+        int64_t endPts = AV_NOPTS_VALUE;
+
+        // Frames before our first keyframe belong to the previous segment, frames from the
+        // next segment's keyframe on belong to the next one
+        auto receive = [&]() -> int {
+            for (;;) {
+                int r = avcodec_receive_frame(codec, frame);
+                if (r == AVERROR(EAGAIN) || r == AVERROR_EOF) {
+                    return 0;
+                }
+                if (r < 0) {
+                    return r;
+                }
+
+                int64_t pts = frame->best_effort_timestamp;
+                bool keep = true;
+                if (pts != AV_NOPTS_VALUE) {
+                    if (segment.startTs != AV_NOPTS_VALUE && startPts != AV_NOPTS_VALUE && pts < startPts) {
+                        keep = false;
+                    }
+                    if (endPts != AV_NOPTS_VALUE && pts >= endPts) {
+                        keep = false;
+                    }
+                }
+
+                r = keep ? callback(frame) : 0;
+                av_frame_unref(frame);
+                if (r < 0) {
+                    return r;
+                }
+            }
+            };
+
+        int err = 0;
+        while (!(stopped && stopped->load())) {
+            ret = av_read_frame(ctx, pkt);
+            if (ret < 0) {
+                if (ret != AVERROR_EOF) {
+                    err = ret;
+                }
+                break;
+            }
+
+            if (pkt->stream_index != stream) {
+                av_packet_unref(pkt);
+                continue;
+            }
+
+            bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+            int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+
+            if (!started) {
+                if (!key || (segment.minTs != AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE && ts < segment.minTs)) {
+                    av_packet_unref(pkt);
+                    continue;
+                }
+                started = true;
+                gops = 1;
+                startPts = pkt->pts;
+            }
+            else if (endPts != AV_NOPTS_VALUE) {
+                // Past the next keyframe only its leading pictures (open GOP) are still ours
+                if (pkt->pts == AV_NOPTS_VALUE || pkt->pts >= endPts) {
+                    av_packet_unref(pkt);
+                    break;
+                }
+            }
+            else if (key) {
+                if (segment.gops > 0 && gops >= segment.gops) {
+                    endPts = pkt->pts;
+                    if (endPts == AV_NOPTS_VALUE) {
+                        av_packet_unref(pkt);
+                        break;
+                    }
+                }
+                else {
+                    ++gops;
+                }
+            }
+
+            ret = avcodec_send_packet(codec, pkt);
+            av_packet_unref(pkt);
+            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_INVALIDDATA) {
+                err = ret;
+                break;
+            }
+
+            ret = receive();
+            if (ret < 0) {
+                err = ret;
+                break;
+            }
+        }
+
+        if (err == 0 && !(stopped && stopped->load())) {
+            ret = avcodec_send_packet(codec, nullptr);
+            if (ret >= 0) {
+                err = receive();
+            }
+        }
+
+        av_packet_free(&pkt);
+        av_frame_free(&frame);
+
+        return err;
+    }
+
+    int ParallelDecoder::deliverFrame(AVFrame* frame, int index) {
+        frameCount_.fetch_add(1);
+
+        if (ordered_) {
+            AVFrame* clone = av_frame_clone(frame);
+            if (!clone) {
+                return AVERROR(ENOMEM);
+            }
+
+            if (!queues_[index]->enqueue(clone)) {
+                av_frame_free(&clone);
+                return AVERROR_EXIT;
+            }
+
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> locker(callbackMutex_);
+        callback_(frame, index);
+        return 0;
+    }
+
+    std::vector<ParallelDecoder::Segment> ParallelDecoder::splitSegments(const std::vector<int64_t>& keyframes, size_t count) {
+        std::vector<Segment> segments;
+
+        if (keyframes.size() <= 1 || count <= 1) {
+            segments.push_back(Segment());
+            return segments;
+        }
+
+        count = std::min(keyframes.size(), count);
+        size_t per = (keyframes.size() + count - 1) / count;
+
+        for (size_t i = 0; i < keyframes.size(); i += per) {
+            Segment segment;
+            if (i > 0) {
+                segment.startTs = keyframes[i];
+                segment.minTs = keyframes[i - 1] + (keyframes[i] - keyframes[i - 1]) / 2;
+            }
+            segment.gops = i + per < keyframes.size() ? per : 0;
+            segments.push_back(segment);
+        }
+
+        return segments;
+    }
+
+} // namespace media
\ No newline at end of file
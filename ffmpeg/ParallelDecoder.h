@@ -0,0 +1,84 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "FFmpeg.h"
+#include "MediaInput.h"
+#include "MediaDecoder.h"
+#include "../queue/MediaQueue.h"
+
+namespace media {
+
+    class ParallelDecoder {
+    public:
+        ParallelDecoder(const ParallelDecoder&) = delete;
+        ParallelDecoder& operator=(const ParallelDecoder&) = delete;
+        ParallelDecoder(ParallelDecoder&&) = delete;
+        ParallelDecoder& operator=(ParallelDecoder&&) = delete;
+
+        // Frame is only valid during the call, av_frame_ref() it to keep it
+        using FrameCallback = std::function<void(AVFrame* frame, int segment)>;
+        // Same as FrameCallback for a single segment, returns < 0 to abort the segment
+        using SegmentCallback = std::function<int(AVFrame* frame)>;
+
+        struct Segment {
+            // Keyframe timestamp to seek to (stream time_base)
+            int64_t startTs = AV_NOPTS_VALUE;
+            // First key packet accepted after the seek, guards against landing on the previous GOP
+            int64_t minTs = AV_NOPTS_VALUE;
+            // GOPs in this segment, 0 = until end of file
+            size_t gops = 0;
+        };
+
+        ParallelDecoder();
+        ~ParallelDecoder();
+
+        // Decode file (url, callback, workers, ordered, maxQueuedFrames) >= 0, blocks until done
+        // Ordered: callback runs on the calling thread in presentation order, memory is bounded by
+        //          workers * maxQueuedFrames decoded frames
+        // Unordered: callback runs on the worker threads (serialized), frames carry their own pts
+        int decodeFile(const std::string& url,
+                       FrameCallback callback,
+                       unsigned int workers = 0,
+                       bool ordered = true,
+                       size_t maxQueuedFrames = 64);
+
+        // Stop a running decodeFile from another thread
+        void stop();
+
+        // Split keyframes (MediaInput::videoKeyframes) into at most count GOP-aligned segments
+        static std::vector<Segment> splitSegments(const std::vector<int64_t>& keyframes, size_t count);
+        // Decode segment (url, segment, threads, callback, stopped) >= 0 on its own input and decoder
+        // Every frame of the file is delivered by exactly one of the segments from splitSegments
+        static int decodeSegment(const std::string& url,
+                                 const Segment& segment,
+                                 unsigned int threads,
+                                 const SegmentCallback& callback,
+                                 const std::atomic<bool>* stopped = nullptr);
+
+        int segmentCount()   const { return segmentCount_.load(); }
+        int64_t frameCount() const { return frameCount_.load(); }
+
+    private:
+        using FrameQueue = MediaQueue<AVFrame>;
+
+        int deliverFrame(AVFrame* frame, int index);
+
+    private:
+        std::mutex callbackMutex_;
+        std::mutex queuesMutex_;
+        std::atomic<bool> stopped_;
+        std::atomic<int> segmentCount_;
+        std::atomic<int64_t> frameCount_;
+
+        bool ordered_;
+        FrameCallback callback_;
+        std::vector<Segment> segments_;
+        std::vector<std::unique_ptr<FrameQueue>> queues_;
+    };
+
+} // namespace media
\ No newline at end of file
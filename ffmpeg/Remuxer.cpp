@@ -0,0 +1,252 @@
+#include "Remuxer.h"
+
+namespace media {
+
+    Remuxer::Remuxer()
+        : hasVideo_(false)
+        , discont_(false)
+        , discontinuityUs_(10000000)
+        , baseUs_(AV_NOPTS_VALUE)
+        , endUs_(AV_NOPTS_VALUE)
+        , cutUs_(AV_NOPTS_VALUE)
+        , stopped_(false)
+        , packets_(0)
+        , bytes_(0)
+        , dropped_(0)
+        , discontinuities_(0)
+        , fixedTimestamps_(0)
+        , error_(0) {
+    }
+
+    Remuxer::~Remuxer() {
+        stop();
+    }
+
+    int Remuxer::remuxFile(const std::string& input,
+                           const std::string& output,
+                           const std::string& format,
+                           int64_t startUs,
+                           int64_t endUs) {
+        if (input.empty() || output.empty() || startUs < 0 || endUs < 0 || (endUs > 0 && endUs <= startUs)) {
+            return AVERROR(EINVAL);
+        }
+
+        stopped_.store(false);
+        packets_.store(0);
+        bytes_.store(0);
+        dropped_.store(0);
+        discontinuities_.store(0);
+        fixedTimestamps_.store(0);
+        error_.store(0);
+
+        int ret = input_.openFileStream(input);
+        if (ret < 0) {
+            error_.store(ret);
+            return ret;
+        }
+
+        if (!input_.hasVideoStream() && !input_.hasAudioStream()) {
+            input_.reset();
+            return AVERROR_STREAM_NOT_FOUND;
+        }
+
+        AVFormatContext* ctx = input_.inputContext();
+        AVStream* video = input_.hasVideoStream() ? ctx->streams[input_.videoParams().index] : nullptr;
+        AVStream* audio = input_.hasAudioStream() ? ctx->streams[input_.audioParams().index] : nullptr;
+
+        ret = output_.writeFile(output, format,
+                                video ? video->codecpar : nullptr, video ? video->time_base : AVRational{ 0, 1 },
+                                audio ? audio->codecpar : nullptr, audio ? audio->time_base : AVRational{ 0, 1 });
+        if (ret < 0) {
+            input_.reset();
+            error_.store(ret);
+            return ret;
+        }
+
+        Track tracks[2];
+        tracks[0].output = output_.videoStream();
+        tracks[0].timebase = video ? video->time_base : AVRational{ 0, 1 };
+        tracks[0].video = true;
+        tracks[0].done = !video;
+        tracks[1].output = output_.audioStream();
+        tracks[1].timebase = audio ? audio->time_base : AVRational{ 0, 1 };
+        tracks[1].done = !audio;
+
+        int64_t startTime = ctx->start_time != AV_NOPTS_VALUE ? ctx->start_time : 0;
+
+        hasVideo_ = video != nullptr;
+        discont_ = ctx->iformat && (ctx->iformat->flags & AVFMT_TS_DISCONT);
+        baseUs_ = AV_NOPTS_VALUE;
+        endUs_ = endUs > 0 ? startTime + endUs : AV_NOPTS_VALUE;
+        cutUs_ = hasVideo_ ? AV_NOPTS_VALUE : endUs_;
+
+        if (startUs > 0) {
+            // Land on the keyframe at or before the start, stream copy cannot cut inside a GOP
+            int64_t target = startTime + startUs;
+            ret = avformat_seek_file(ctx, -1, INT64_MIN, target, target, AVSEEK_FLAG_BACKWARD);
+            if (ret < 0) {
+                output_.reset();
+                input_.reset();
+                error_.store(ret);
+                return ret;
+            }
+        }
+
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            output_.reset();
+            input_.reset();
+            return AVERROR(ENOMEM);
+        }
+
+        ret = 0;
+        while (!stopped_.load() && !(tracks[0].done && tracks[1].done)) {
+            ret = av_read_frame(ctx, pkt);
+            if (ret < 0) {
+                if (ret == AVERROR_EOF) {
+                    ret = 0;
+                }
+                break;
+            }
+
+            Track* track = nullptr;
+            if (video && pkt->stream_index == video->index) {
+                track = &tracks[0];
+            }
+            else if (audio && pkt->stream_index == audio->index) {
+                track = &tracks[1];
+            }
+
+            if (!track || track->done) {
+                av_packet_unref(pkt);
+                continue;
+            }
+
+            ret = copyPacket(pkt, *track);
+            av_packet_unref(pkt);
+            if (ret < 0) {
+                break;
+            }
+        }
+
+        av_packet_free(&pkt);
+
+        if (ret >= 0 && stopped_.load()) {
+            ret = AVERROR_EXIT;
+        }
+
+        // The trailer is written even after a stop, the output stays playable up to there
+        output_.reset();
+        input_.reset();
+
+        if (ret < 0) {
+            int expected = 0;
+            error_.compare_exchange_strong(expected, ret);
+        }
+
+        return ret;
+    }
+
+    void Remuxer::stop() {
+        stopped_.store(true);
+    }
+
+    RemuxStats Remuxer::stats() const {
+        RemuxStats s;
+        s.packets = packets_.load();
+        s.bytes = bytes_.load();
+        s.dropped = dropped_.load();
+        s.discontinuities = discontinuities_.load();
+        s.fixedTimestamps = fixedTimestamps_.load();
+        s.error = error_.load();
+        return s;
+    }
+
+    int Remuxer::copyPacket(AVPacket* pkt, Track& track) {
+        int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (ts == AV_NOPTS_VALUE) {
+            // Nothing to place it on the timeline with, happens before the first keyframe of some streams
+            if (baseUs_ == AV_NOPTS_VALUE || track.nextDtsUs == AV_NOPTS_VALUE) {
+                dropped_.fetch_add(1);
+                return 0;
+            }
+            ts = av_rescale_q(track.nextDtsUs - track.offsetUs, AV_TIME_BASE_Q, track.timebase);
+            pkt->dts = ts;
+        }
+
+        int64_t dtsUs = av_rescale_q(ts, track.timebase, AV_TIME_BASE_Q) + track.offsetUs;
+
+        // Fold timestamp resets and wraps (concatenated or spliced TS) back into one timeline
+        if (discont_ && track.nextDtsUs != AV_NOPTS_VALUE && discontinuityUs_ > 0) {
+            int64_t delta = dtsUs - track.nextDtsUs;
+            if (delta > discontinuityUs_ || delta < -discontinuityUs_) {
+                track.offsetUs -= delta;
+                dtsUs -= delta;
+                discontinuities_.fetch_add(1);
+            }
+        }
+
+        // Output starts on the first video keyframe (or the first audio packet without video)
+        if (baseUs_ == AV_NOPTS_VALUE) {
+            bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+            if ((track.video && !key) || (!track.video && hasVideo_)) {
+                dropped_.fetch_add(1);
+                return 0;
+            }
+            baseUs_ = dtsUs;
+        }
+
+        int64_t ptsUs = pkt->pts != AV_NOPTS_VALUE ? av_rescale_q(pkt->pts, track.timebase, AV_TIME_BASE_Q) + track.offsetUs : dtsUs;
+
+        if (!track.video && ptsUs < baseUs_) {
+            dropped_.fetch_add(1);
+            return 0;
+        }
+
+        // Pictures past endUs_ are kept until the next keyframe, B-frames before it may reference them
+        if (track.video && endUs_ != AV_NOPTS_VALUE && ptsUs >= endUs_ && (pkt->flags & AV_PKT_FLAG_KEY)) {
+            cutUs_ = ptsUs;
+        }
+
+        if (cutUs_ != AV_NOPTS_VALUE && ptsUs >= cutUs_) {
+            track.done = true;
+            dropped_.fetch_add(1);
+            return 0;
+        }
+
+        int64_t duration = pkt->duration > 0 ? av_rescale_q(pkt->duration, track.timebase, AV_TIME_BASE_Q) : 0;
+        track.nextDtsUs = dtsUs + duration;
+
+        int64_t shift = av_rescale_q(track.offsetUs - baseUs_, AV_TIME_BASE_Q, track.timebase);
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts += shift;
+        }
+        pkt->dts = ts + shift;
+
+        av_packet_rescale_ts(pkt, track.timebase, track.output->time_base);
+
+        // Muxers reject non-increasing dts, nudge instead of failing the whole job
+        if (track.lastDts != AV_NOPTS_VALUE && pkt->dts <= track.lastDts) {
+            pkt->dts = track.lastDts + 1;
+            if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+                pkt->pts = pkt->dts;
+            }
+            fixedTimestamps_.fetch_add(1);
+        }
+        track.lastDts = pkt->dts;
+
+        pkt->stream_index = track.output->index;
+        pkt->pos = -1;
+
+        int size = pkt->size;
+        int ret = output_.writePacket(pkt);
+        if (ret < 0) {
+            return ret;
+        }
+
+        packets_.fetch_add(1);
+        bytes_.fetch_add(size);
+        return 0;
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "FFmpeg.h"
+#include "MediaInput.h"
+#include "MediaOutput.h"
+
+namespace media {
+
+    struct RemuxStats {
+        int64_t packets = 0;
+        int64_t bytes = 0;
+        // Packets outside the trim range
+        int64_t dropped = 0;
+        // Timestamp jumps folded back into a continuous timeline
+        int64_t discontinuities = 0;
+        // Packets whose dts was pushed forward to stay strictly increasing
+        int64_t fixedTimestamps = 0;
+        int error = 0;
+    };
+
+    class Remuxer {
+    public:
+        Remuxer(const Remuxer&) = delete;
+        Remuxer& operator=(const Remuxer&) = delete;
+        Remuxer(Remuxer&&) = delete;
+        Remuxer& operator=(Remuxer&&) = delete;
+
+        Remuxer();
+        ~Remuxer();
+
+        // Remux file (input, output, format, startUs, endUs) >= 0, packets are copied without decoding
+        // Positions are relative to the input start; a trim starts on the video keyframe at or before
+        // startUs and ends before the first video keyframe at or after endUs, so the GOP holding endUs
+        // is copied whole and no kept picture loses a reference; audio is cut at the same point
+        // endUs = 0 copies to the end, the output timeline starts at zero
+        int remuxFile(const std::string& input,
+                      const std::string& output,
+                      const std::string& format = "",
+                      int64_t startUs = 0,
+                      int64_t endUs = 0);
+
+        // Stop a running remux, remuxFile returns AVERROR_EXIT
+        void stop();
+
+        // Jump in dts treated as a discontinuity for formats that allow them (MPEG-TS), default 10 s
+        void setDiscontinuityThreshold(int64_t us) { discontinuityUs_ = us; }
+
+        RemuxStats stats() const;
+
+    private:
+        struct Track {
+            AVStream* output = nullptr;
+            AVRational timebase = { 0, 1 };
+            bool video = false;
+            bool done = false;
+            int64_t nextDtsUs = AV_NOPTS_VALUE;
+            int64_t lastDts = AV_NOPTS_VALUE;
+            // Folded discontinuities, per track: audio and video cross a splice at different packets
+            int64_t offsetUs = 0;
+        };
+
+        int copyPacket(AVPacket* pkt, Track& track);
+
+    private:
+        MediaInput input_;
+        MediaOutput output_;
+
+        bool hasVideo_;
+        bool discont_;
+        int64_t discontinuityUs_;
+        int64_t baseUs_;
+        int64_t endUs_;
+        // Where the output ends: the first video keyframe at or after endUs_ once seen, endUs_ without video
+        int64_t cutUs_;
+
+        std::atomic<bool> stopped_;
+        std::atomic<int64_t> packets_;
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> dropped_;
+        std::atomic<int64_t> discontinuities_;
+        std::atomic<int64_t> fixedTimestamps_;
+        std::atomic<int> error_;
+    };
+
+} // namespace media
\ No newline at end of file
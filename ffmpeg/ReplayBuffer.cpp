@@ -0,0 +1,256 @@
+#include "ReplayBuffer.h"
+
+namespace media {
+
+    ReplayBuffer::ReplayBuffer()
+        : maxBytes_(0)
+        , maxUs_(0)
+        , bytes_(0)
+        , dumping_(false)
+        , dumpError_(0) {
+    }
+
+    ReplayBuffer::~ReplayBuffer() {
+        reset();
+    }
+
+    int ReplayBuffer::open(AVCodecContext* videoEncoder,
+                           AVCodecContext* audioEncoder,
+                           int64_t maxBytes,
+                           int64_t maxUs) {
+        if ((!videoEncoder && !audioEncoder) || maxBytes <= 0 || maxUs <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        reset();
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        int ret = MediaOutput::copyEncoderContext(videoEncoder, videoCodec_);
+        if (ret >= 0) {
+            ret = MediaOutput::copyEncoderContext(audioEncoder, audioCodec_);
+        }
+        if (ret < 0) {
+            videoCodec_.reset();
+            return ret;
+        }
+
+        maxBytes_ = maxBytes;
+        maxUs_ = maxUs;
+        return 0;
+    }
+
+    int ReplayBuffer::addVideoPacket(const AVPacket* pkt, AVRational timebase) {
+        return addPacket(pkt, timebase, true);
+    }
+
+    int ReplayBuffer::addAudioPacket(const AVPacket* pkt, AVRational timebase) {
+        return addPacket(pkt, timebase, false);
+    }
+
+    int ReplayBuffer::dump(double seconds, const std::string& url, const std::string& format) {
+        if (seconds <= 0.0 || url.empty()) {
+            return AVERROR(EINVAL);
+        }
+
+        if (dumping_.load()) {
+            return AVERROR(EBUSY);
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        std::deque<Entry> entries;
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+
+            if (entries_.empty()) {
+                return AVERROR(EAGAIN);
+            }
+
+            int64_t endUs = entries_.back().ptsUs;
+            int64_t fromUs = endUs == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : endUs - static_cast<int64_t>(seconds * 1000000.0);
+
+            // Last keyframe at or before the requested start, else the oldest one kept
+            size_t start = 0;
+            if (videoCodec_ && fromUs != AV_NOPTS_VALUE) {
+                for (size_t i = 0; i < entries_.size(); ++i) {
+                    const Entry& e = entries_[i];
+                    if (e.video && e.key) {
+                        if (e.ptsUs != AV_NOPTS_VALUE && e.ptsUs > fromUs) {
+                            break;
+                        }
+                        start = i;
+                    }
+                }
+            }
+            else if (fromUs != AV_NOPTS_VALUE) {
+                while (start + 1 < entries_.size() && entries_[start].ptsUs < fromUs) {
+                    ++start;
+                }
+            }
+
+            // References only, the live ring keeps evicting independently
+            for (size_t i = start; i < entries_.size(); ++i) {
+                Entry e = entries_[i];
+                e.pkt = av_packet_clone(entries_[i].pkt);
+                if (!e.pkt) {
+                    freeEntries(entries);
+                    return AVERROR(ENOMEM);
+                }
+                entries.push_back(e);
+            }
+        }
+
+        dumping_.store(true);
+        dumpError_.store(0);
+        thread_ = std::thread(&ReplayBuffer::dumpThread, this, std::move(entries), url, format);
+        return 0;
+    }
+
+    void ReplayBuffer::reset() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        freeEntries(entries_);
+        bytes_ = 0;
+        videoCodec_.reset();
+        audioCodec_.reset();
+        maxBytes_ = 0;
+        maxUs_ = 0;
+    }
+
+    int64_t ReplayBuffer::bytes() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return bytes_;
+    }
+
+    int64_t ReplayBuffer::durationUs() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (entries_.size() < 2 || entries_.front().ptsUs == AV_NOPTS_VALUE || entries_.back().ptsUs == AV_NOPTS_VALUE) {
+            return 0;
+        }
+
+        return entries_.back().ptsUs - entries_.front().ptsUs;
+    }
+
+    int ReplayBuffer::addPacket(const AVPacket* pkt, AVRational timebase, bool video) {
+        if (!pkt || timebase.num <= 0 || timebase.den <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (video ? !videoCodec_ : !audioCodec_) {
+            return AVERROR(EINVAL);
+        }
+
+        Entry e;
+        e.video = video;
+        e.key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+        e.timebase = timebase;
+        e.ptsUs = pkt->pts != AV_NOPTS_VALUE ? av_rescale_q(pkt->pts, timebase, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+
+        // The ring always starts on a video keyframe
+        if (videoCodec_ && entries_.empty() && !(video && e.key)) {
+            return 0;
+        }
+
+        e.pkt = av_packet_clone(pkt);
+        if (!e.pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        entries_.push_back(e);
+        bytes_ += e.pkt->size;
+
+        evict();
+        return 0;
+    }
+
+    void ReplayBuffer::evict() {
+        auto over = [this]() {
+            int64_t span = 0;
+            if (entries_.front().ptsUs != AV_NOPTS_VALUE && entries_.back().ptsUs != AV_NOPTS_VALUE) {
+                span = entries_.back().ptsUs - entries_.front().ptsUs;
+            }
+            return bytes_ > maxBytes_ || span > maxUs_;
+            };
+
+        while (!entries_.empty() && over()) {
+            size_t count = 1;
+
+            if (videoCodec_) {
+                // Drop up to the next keyframe so the ring still starts decodable
+                while (count < entries_.size() && !(entries_[count].video && entries_[count].key)) {
+                    ++count;
+                }
+
+                if (count == entries_.size()) {
+                    // The newest GOP alone is over the byte budget: drop it all, the ring restarts
+                    // on the next keyframe instead of growing without bound
+                    if (bytes_ <= maxBytes_) {
+                        break;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                bytes_ -= entries_.front().pkt->size;
+                av_packet_free(&entries_.front().pkt);
+                entries_.pop_front();
+            }
+        }
+    }
+
+    void ReplayBuffer::dumpThread(std::deque<Entry> entries, std::string url, std::string format) {
+        MediaOutput output;
+        int ret = output.writeFile(url, format, videoCodec_.get(), audioCodec_.get());
+
+        int64_t startUs = entries.empty() ? AV_NOPTS_VALUE : entries.front().ptsUs;
+
+        for (Entry& e : entries) {
+            if (ret < 0) {
+                break;
+            }
+
+            AVStream* stream = e.video ? output.videoStream() : output.audioStream();
+            if (!stream) {
+                continue;
+            }
+
+            // The clip starts at zero
+            if (startUs != AV_NOPTS_VALUE) {
+                int64_t offset = av_rescale_q(startUs, AV_TIME_BASE_Q, e.timebase);
+                if (e.pkt->pts != AV_NOPTS_VALUE) {
+                    e.pkt->pts -= offset;
+                }
+                if (e.pkt->dts != AV_NOPTS_VALUE) {
+                    e.pkt->dts -= offset;
+                }
+            }
+
+            av_packet_rescale_ts(e.pkt, e.timebase, stream->time_base);
+            e.pkt->stream_index = stream->index;
+            ret = output.writePacket(e.pkt);
+        }
+
+        freeEntries(entries);
+        output.reset();
+
+        dumpError_.store(ret < 0 ? ret : 0);
+        dumping_.store(false);
+    }
+
+    void ReplayBuffer::freeEntries(std::deque<Entry>& entries) {
+        for (Entry& e : entries) {
+            av_packet_free(&e.pkt);
+        }
+        entries.clear();
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <memory>
+#include "FFmpeg.h"
+#include "MediaOutput.h"
+
+namespace media {
+
+    class ReplayBuffer {
+    public:
+        ReplayBuffer(const ReplayBuffer&) = delete;
+        ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+        ReplayBuffer(ReplayBuffer&&) = delete;
+        ReplayBuffer& operator=(ReplayBuffer&&) = delete;
+
+        ReplayBuffer();
+        ~ReplayBuffer();
+
+        // Open replay buffer (videoEncoder, audioEncoder, maxBytes, maxUs) >= 0
+        // Whole GOPs are evicted from the front once packet bytes exceed maxBytes or the buffered
+        // span exceeds maxUs; the newest GOP is kept unless it alone exceeds maxBytes, then the
+        // ring is emptied and restarts on the next keyframe
+        int open(AVCodecContext* videoEncoder,
+                 AVCodecContext* audioEncoder,
+                 int64_t maxBytes = 256 * 1024 * 1024,
+                 int64_t maxUs = 120000000);
+
+        // Add video packet (pkt, timebase) >= 0, pkt is referenced, not copied
+        int addVideoPacket(const AVPacket* pkt, AVRational timebase);
+        // Add audio packet (pkt, timebase) >= 0
+        int addAudioPacket(const AVPacket* pkt, AVRational timebase);
+
+        // Dump the last seconds (seconds, url, format) >= 0, returns at once
+        // Written from the keyframe at or before now - seconds through a new MediaOutput on a
+        // background thread while packets keep being added
+        int dump(double seconds, const std::string& url, const std::string& format = "");
+
+        // Reset replay buffer, waits for a running dump
+        void reset();
+
+        bool isDumping()       const { return dumping_.load(); }
+        int lastDumpError()    const { return dumpError_.load(); }
+        int64_t bytes()        const;
+        int64_t durationUs()   const;
+
+    private:
+        struct Entry {
+            AVPacket* pkt = nullptr;
+            AVRational timebase = { 0, 0 };
+            int64_t ptsUs = AV_NOPTS_VALUE;
+            bool video = false;
+            bool key = false;
+        };
+
+        int addPacket(const AVPacket* pkt, AVRational timebase, bool video);
+        void evict();
+        void dumpThread(std::deque<Entry> entries, std::string url, std::string format);
+        static void freeEntries(std::deque<Entry>& entries);
+
+    private:
+        mutable std::mutex mutex_;
+
+        std::shared_ptr<AVCodecContext> videoCodec_;
+        std::shared_ptr<AVCodecContext> audioCodec_;
+        int64_t maxBytes_;
+        int64_t maxUs_;
+
+        std::deque<Entry> entries_;
+        int64_t bytes_;
+
+        std::thread thread_;
+        std::atomic<bool> dumping_;
+        std::atomic<int> dumpError_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <new>
+#include <algorithm>
+#include "SegmentStore.h"
+
+namespace media {
+
+    static const int IO_BUFFER_SIZE = 64 * 1024;
+
+    static bool endsWith(const std::string& value, const char* suffix) {
+        size_t n = std::char_traits<char>::length(suffix);
+        return value.size() >= n && value.compare(value.size() - n, n, suffix) == 0;
+    }
+
+    SegmentStore::SegmentStore()
+        : maxFiles_(16)
+        , bytes_(0)
+        , sequence_(0)
+        , callback_(nullptr)
+        , nextListener_(0) {
+    }
+
+    SegmentStore::~SegmentStore() {
+        clear();
+    }
+
+    void SegmentStore::setMaxFiles(size_t maxFiles) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        maxFiles_ = std::max<size_t>(1, maxFiles);
+    }
+
+    void SegmentStore::setCallback(FileCallback callback) {
+        std::lock_guard<std::mutex> locker(callbackMutex_);
+        callback_ = std::move(callback);
+    }
+
+    int SegmentStore::addListener(FileCallback callback) {
+        if (!callback) {
+            return AVERROR(EINVAL);
+        }
+
+        std::lock_guard<std::mutex> locker(callbackMutex_);
+        int id = nextListener_++;
+        listeners_.emplace_back(id, std::move(callback));
+        return id;
+    }
+
+    void SegmentStore::removeListener(int id) {
+        std::lock_guard<std::mutex> locker(callbackMutex_);
+        listeners_.erase(std::remove_if(listeners_.begin(), listeners_.end(), [id](const auto& listener) {
+            return listener.first == id;
+            }), listeners_.end());
+    }
+
+    MemoryFilePtr SegmentStore::get(const std::string& name) const {
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        auto it = files_.find(name);
+        return it != files_.end() ? it->second : nullptr;
+    }
+
+    std::vector<std::string> SegmentStore::list() const {
+        std::vector<MemoryFilePtr> files;
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            for (const auto& entry : files_) {
+                files.push_back(entry.second);
+            }
+        }
+
+        std::sort(files.begin(), files.end(), [](const MemoryFilePtr& a, const MemoryFilePtr& b) {
+            return a->sequence < b->sequence;
+            });
+
+        std::vector<std::string> names;
+        for (const MemoryFilePtr& file : files) {
+            names.push_back(file->name);
+        }
+        return names;
+    }
+
+    void SegmentStore::clear() {
+        std::lock_guard<std::mutex> locker(mutex_);
+        files_.clear();
+        order_.clear();
+        bytes_ = 0;
+    }
+
+    size_t SegmentStore::fileCount() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return files_.size();
+    }
+
+    int64_t SegmentStore::bytes() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return bytes_;
+    }
+
+    int SegmentStore::attach(AVFormatContext* ctx) {
+        if (!ctx) {
+            return AVERROR(EINVAL);
+        }
+
+        ctx->opaque = this;
+        ctx->io_open = &SegmentStore::ioOpen;
+        ctx->io_close2 = &SegmentStore::ioClose;
+        return 0;
+    }
+
+    bool SegmentStore::isAttached(const AVFormatContext* ctx) {
+        return ctx && ctx->io_close2 == &SegmentStore::ioClose;
+    }
+
+    int SegmentStore::ioOpen(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options) {
+        // Protocol options do not apply to memory files
+        (void)options;
+
+        SegmentStore* store = static_cast<SegmentStore*>(s->opaque);
+        if (!store || !url || !(flags & AVIO_FLAG_WRITE)) {
+            return AVERROR(EINVAL);
+        }
+
+        Writer* writer = new (std::nothrow) Writer();
+        if (!writer) {
+            return AVERROR(ENOMEM);
+        }
+
+        writer->store = store;
+        writer->file = std::make_shared<MemoryFile>();
+        writer->file->name = url;
+
+        uint8_t* buffer = static_cast<uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+        if (!buffer) {
+            delete writer;
+            return AVERROR(ENOMEM);
+        }
+
+        *pb = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, writer, nullptr, &SegmentStore::writePacket, &SegmentStore::seek);
+        if (!*pb) {
+            av_free(buffer);
+            delete writer;
+            return AVERROR(ENOMEM);
+        }
+
+        return 0;
+    }
+
+    int SegmentStore::ioClose(AVFormatContext* s, AVIOContext* pb) {
+        (void)s;
+
+        if (!pb) {
+            return 0;
+        }
+
+        avio_flush(pb);
+        int ret = pb->error;
+
+        Writer* writer = static_cast<Writer*>(pb->opaque);
+        if (ret >= 0) {
+            writer->store->publish(writer->file);
+        }
+        delete writer;
+
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+        return ret < 0 ? ret : 0;
+    }
+
+    int SegmentStore::writePacket(void* opaque, const uint8_t* buf, int size) {
+        Writer* writer = static_cast<Writer*>(opaque);
+        std::vector<uint8_t>& data = writer->file->data;
+
+        // Muxers may seek back to patch headers, overwrite in place and grow past the end
+        size_t end = writer->position + static_cast<size_t>(size);
+        if (end > data.size()) {
+            data.resize(end);
+        }
+
+        std::copy(buf, buf + size, data.begin() + writer->position);
+        writer->position = end;
+        return size;
+    }
+
+    int64_t SegmentStore::seek(void* opaque, int64_t offset, int whence) {
+        Writer* writer = static_cast<Writer*>(opaque);
+        int64_t size = static_cast<int64_t>(writer->file->data.size());
+
+        whence &= ~AVSEEK_FORCE;
+
+        int64_t target = 0;
+        switch (whence) {
+        case AVSEEK_SIZE:
+            return size;
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = static_cast<int64_t>(writer->position) + offset;
+            break;
+        case SEEK_END:
+            target = size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+
+        if (target < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        writer->position = static_cast<size_t>(target);
+        return target;
+    }
+
+    void SegmentStore::publish(const std::shared_ptr<MemoryFile>& file) {
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+
+            file->sequence = ++sequence_;
+            file->timeUs = av_gettime();
+
+            auto it = files_.find(file->name);
+            if (it != files_.end()) {
+                bytes_ -= static_cast<int64_t>(it->second->data.size());
+                it->second = file;
+            }
+            else {
+                files_.emplace(file->name, file);
+                if (!isPersistent(file->name)) {
+                    order_.push_back(file->name);
+                }
+            }
+            bytes_ += static_cast<int64_t>(file->data.size());
+
+            // Readers still sending a dropped file keep their reference until done
+            while (order_.size() > maxFiles_) {
+                auto old = files_.find(order_.front());
+                if (old != files_.end()) {
+                    bytes_ -= static_cast<int64_t>(old->second->data.size());
+                    files_.erase(old);
+                }
+                order_.pop_front();
+            }
+        }
+
+        // Readers are not blocked by callbacks, only callback changes are
+        std::lock_guard<std::mutex> locker(callbackMutex_);
+        if (callback_) {
+            callback_(file);
+        }
+        for (const auto& listener : listeners_) {
+            listener.second(file);
+        }
+    }
+
+    bool SegmentStore::isPersistent(const std::string& name) {
+        size_t slash = name.find_last_of('/');
+        std::string base = slash == std::string::npos ? name : name.substr(slash + 1);
+
+        return endsWith(base, ".m3u8") || endsWith(base, ".mpd") || base.compare(0, 4, "init") == 0;
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include "FFmpeg.h"
+
+namespace media {
+
+    struct MemoryFile {
+        std::string name;
+        std::vector<uint8_t> data;
+        // Publish order across the store, and the wall clock time it completed
+        int64_t sequence = 0;
+        int64_t timeUs = 0;
+    };
+
+    // Published files are immutable, readers keep a reference for as long as they send it
+    using MemoryFilePtr = std::shared_ptr<const MemoryFile>;
+
+    class SegmentStore {
+    public:
+        SegmentStore(const SegmentStore&) = delete;
+        SegmentStore& operator=(const SegmentStore&) = delete;
+        SegmentStore(SegmentStore&&) = delete;
+        SegmentStore& operator=(SegmentStore&&) = delete;
+
+        // Called on the muxer thread each time a file (segment, init segment, playlist) is complete
+        using FileCallback = std::function<void(const MemoryFilePtr& file)>;
+
+        SegmentStore();
+        ~SegmentStore();
+
+        // Keep at most maxFiles media files, the oldest are dropped first
+        // Playlists and manifests (.m3u8/.mpd) and init segments are replaced in place, never dropped
+        void setMaxFiles(size_t maxFiles);
+        // Set completion callback (callback), returns once no call of the previous callback is running
+        void setCallback(FileCallback callback);
+        // Add completion listener (callback) >= listener id, called after the callback
+        int addListener(FileCallback callback);
+        // Remove listener (id), returns once no call of it is running; not from inside a callback
+        void removeListener(int id);
+
+        // Get published file (name), nullptr when unknown or already dropped
+        MemoryFilePtr get(const std::string& name) const;
+        // Names of all published files, oldest first
+        std::vector<std::string> list() const;
+        // Remove all files
+        void clear();
+
+        size_t fileCount() const;
+        int64_t bytes()    const;
+
+        // Route a muxer's file IO into the store (ctx) >= 0, before avformat_write_header
+        // The muxer's own names (url, hls_segment_filename, ...) become the store keys
+        int attach(AVFormatContext* ctx);
+        // True when ctx writes through a store
+        static bool isAttached(const AVFormatContext* ctx);
+
+    private:
+        struct Writer {
+            SegmentStore* store = nullptr;
+            std::shared_ptr<MemoryFile> file;
+            size_t position = 0;
+        };
+
+        static int ioOpen(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options);
+        static int ioClose(AVFormatContext* s, AVIOContext* pb);
+        static int writePacket(void* opaque, const uint8_t* buf, int size);
+        static int64_t seek(void* opaque, int64_t offset, int whence);
+
+        void publish(const std::shared_ptr<MemoryFile>& file);
+        static bool isPersistent(const std::string& name);
+
+    private:
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, MemoryFilePtr> files_;
+        std::deque<std::string> order_;
+        size_t maxFiles_;
+        int64_t bytes_;
+        int64_t sequence_;
+
+        // Held while callbacks run, so removal waits for calls in flight
+        std::mutex callbackMutex_;
+        FileCallback callback_;
+        std::vector<std::pair<int, FileCallback>> listeners_;
+        int nextListener_;
+    };
+
+} // namespace media
\ No newline at end of file
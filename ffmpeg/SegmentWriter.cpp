@@ -0,0 +1,382 @@
+#include <cstdio>
+#include "SegmentWriter.h"
+
+namespace media {
+
+    // How long late audio may keep the outgoing segment open, in video time after the cut
+    static const int64_t LATE_AUDIO_US = 1000000;
+
+    SegmentWriter::SegmentWriter()
+        : segmentUs_(0)
+        , maxSegments_(0)
+        , maxBytes_(0)
+        , index_(0)
+        , segmentStartUs_(AV_NOPTS_VALUE)
+        , previousStartUs_(AV_NOPTS_VALUE)
+        , current_(nullptr)
+        , previous_(nullptr)
+        , prepared_(nullptr)
+        , preparing_(false)
+        , stopping_(false)
+        , segments_(0)
+        , deleted_(0)
+        , diskBytes_(0)
+        , maxRotationUs_(0)
+        , error_(0) {
+    }
+
+    SegmentWriter::~SegmentWriter() {
+        close();
+    }
+
+    int SegmentWriter::open(const std::string& pattern,
+                            const std::string& format,
+                            AVCodecContext* videoEncoder,
+                            AVCodecContext* audioEncoder,
+                            int64_t segmentUs,
+                            int maxSegments,
+                            int64_t maxBytes) {
+        if (pattern.empty() || segmentUs <= 0 || (!videoEncoder && !audioEncoder)) {
+            return AVERROR(EINVAL);
+        }
+
+        char path[1024];
+        if (av_get_frame_filename(path, sizeof(path), pattern.c_str(), 0) < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        close();
+
+        format_ = format;
+        if (format_.empty()) {
+            const AVOutputFormat* guessed = av_guess_format(nullptr, path, nullptr);
+            if (!guessed) {
+                return AVERROR_MUXER_NOT_FOUND;
+            }
+            format_ = guessed->name;
+        }
+
+        int ret = MediaOutput::copyEncoderContext(videoEncoder, videoCodec_);
+        if (ret >= 0) {
+            ret = MediaOutput::copyEncoderContext(audioEncoder, audioCodec_);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+
+        pattern_ = pattern;
+        segmentUs_ = segmentUs;
+        maxSegments_ = maxSegments > 0 ? maxSegments : 0;
+        maxBytes_ = maxBytes > 0 ? maxBytes : 0;
+
+        ret = openSegment(0, 0, current_);
+        if (ret < 0) {
+            return ret;
+        }
+
+        index_ = 0;
+        segments_ = 1;
+        stopping_ = false;
+        worker_ = std::thread(&SegmentWriter::workerThread, this);
+        prepareNext(0);
+        return 0;
+    }
+
+    int SegmentWriter::writeVideoPacket(const AVPacket* pkt, AVRational timebase) {
+        return writePacket(pkt, timebase, true);
+    }
+
+    int SegmentWriter::writeAudioPacket(const AVPacket* pkt, AVRational timebase) {
+        return writePacket(pkt, timebase, false);
+    }
+
+    int SegmentWriter::close() {
+        retirePrevious();
+
+        {
+            // Queued opens and closes still run before the worker exits
+            std::lock_guard<std::mutex> locker(mutex_);
+            stopping_ = true;
+            cond_.notify_all();
+        }
+
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+
+        if (prepared_) {
+            // Holds only a header, nothing to keep
+            closeSegment(std::move(prepared_), false);
+        }
+
+        if (current_) {
+            closeSegment(std::move(current_), true);
+        }
+
+        videoCodec_.reset();
+        audioCodec_.reset();
+        segmentStartUs_ = AV_NOPTS_VALUE;
+        previousStartUs_ = AV_NOPTS_VALUE;
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        closed_.clear();
+        preparing_ = false;
+        segments_ = 0;
+        deleted_ = 0;
+        diskBytes_ = 0;
+        maxRotationUs_ = 0;
+
+        int ret = error_;
+        error_ = 0;
+        return ret;
+    }
+
+    SegmentWriterStats SegmentWriter::stats() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        SegmentWriterStats s;
+        s.segments = segments_;
+        s.deleted = deleted_;
+        s.diskBytes = diskBytes_;
+        s.maxRotationUs = maxRotationUs_;
+        s.error = error_;
+        return s;
+    }
+
+    int SegmentWriter::openSegment(int index, int64_t preallocate, std::unique_ptr<Segment>& segment) {
+        char path[1024];
+        if (av_get_frame_filename(path, sizeof(path), pattern_.c_str(), index) < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        std::unique_ptr<Segment> s(new Segment());
+        s->path = path;
+        s->sink.reset(new FileSink());
+        s->output.reset(new MediaOutput());
+
+        int ret = s->sink->open(s->path, FileSink::BUFFER_SIZE, false, preallocate);
+        if (ret < 0) {
+            return ret;
+        }
+
+        ret = s->output->writeIO(s->sink->ioContext(), format_, videoCodec_.get(), audioCodec_.get());
+        if (ret < 0) {
+            s->sink->close();
+            std::remove(s->path.c_str());
+            return ret;
+        }
+
+        segment = std::move(s);
+        return 0;
+    }
+
+    void SegmentWriter::prepareNext(int64_t preallocate) {
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            preparing_ = true;
+        }
+
+        int index = index_ + 1;
+        post([this, index, preallocate]() {
+            std::unique_ptr<Segment> segment;
+            int ret = openSegment(index, preallocate, segment);
+
+            std::lock_guard<std::mutex> locker(mutex_);
+            prepared_ = std::move(segment);
+            preparing_ = false;
+            if (ret < 0) {
+                // rotate() retries inline, the failure is still reported
+                error_ = ret;
+            }
+            cond_.notify_all();
+            });
+    }
+
+    int SegmentWriter::rotate(int64_t startUs) {
+        int64_t start = av_gettime_relative();
+
+        retirePrevious();
+
+        std::unique_ptr<Segment> next;
+        {
+            // Only waits when segments are shorter than opening a file takes
+            std::unique_lock<std::mutex> locker(mutex_);
+            cond_.wait(locker, [this]() {
+                return !preparing_;
+                });
+            next = std::move(prepared_);
+        }
+
+        if (!next) {
+            // Background open failed, retry inline rather than losing the segment boundary
+            int ret = openSegment(index_ + 1, 0, next);
+            if (ret < 0) {
+                std::lock_guard<std::mutex> locker(mutex_);
+                error_ = ret;
+                return ret;
+            }
+        }
+
+        previous_ = std::move(current_);
+        previousStartUs_ = segmentStartUs_;
+        current_ = std::move(next);
+        segmentStartUs_ = startUs;
+        ++index_;
+
+        // Size the next file like the one just finished, with some headroom
+        int64_t preallocate = previous_->output->stats().bytes;
+        preallocate += preallocate / 8;
+
+        if (!audioCodec_) {
+            retirePrevious();
+        }
+
+        prepareNext(preallocate);
+
+        int64_t elapsed = av_gettime_relative() - start;
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        ++segments_;
+        maxRotationUs_ = std::max(maxRotationUs_, elapsed);
+        return 0;
+    }
+
+    void SegmentWriter::retirePrevious() {
+        if (!previous_) {
+            return;
+        }
+
+        // Trailer and close run on the worker
+        Segment* closing = previous_.release();
+        post([this, closing]() {
+            closeSegment(std::unique_ptr<Segment>(closing), true);
+            });
+    }
+
+    void SegmentWriter::closeSegment(std::unique_ptr<Segment> segment, bool keep) {
+        segment->output->reset();
+        int ret = segment->sink->close();
+        int64_t bytes = segment->sink->stats().bytes;
+
+        std::lock_guard<std::mutex> locker(mutex_);
+
+        if (ret < 0) {
+            error_ = ret;
+        }
+
+        if (!keep) {
+            std::remove(segment->path.c_str());
+            return;
+        }
+
+        ClosedSegment closed;
+        closed.path = segment->path;
+        closed.bytes = bytes;
+        closed_.push_back(closed);
+        diskBytes_ += bytes;
+
+        // Disk quota ring, oldest first
+        while (!closed_.empty()
+            && ((maxSegments_ > 0 && static_cast<int>(closed_.size()) > maxSegments_)
+                || (maxBytes_ > 0 && diskBytes_ > maxBytes_))) {
+            std::remove(closed_.front().path.c_str());
+            diskBytes_ -= closed_.front().bytes;
+            closed_.pop_front();
+            ++deleted_;
+        }
+    }
+
+    int SegmentWriter::writePacket(const AVPacket* pkt, AVRational timebase, bool video) {
+        if (!pkt || !current_) {
+            return AVERROR(EINVAL);
+        }
+
+        int64_t ptsUs = pkt->pts != AV_NOPTS_VALUE ? av_rescale_q(pkt->pts, timebase, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+
+        if (segmentStartUs_ == AV_NOPTS_VALUE) {
+            segmentStartUs_ = ptsUs;
+        }
+
+        if (previous_) {
+            // Audio interleaved behind the cut belongs to the outgoing segment
+            if (!video && ptsUs != AV_NOPTS_VALUE && ptsUs < segmentStartUs_) {
+                return writeTo(*previous_, previousStartUs_, pkt, timebase, video);
+            }
+
+            // Audio caught up, or stopped arriving, the outgoing segment is complete
+            if (!video || (ptsUs != AV_NOPTS_VALUE && ptsUs - segmentStartUs_ >= LATE_AUDIO_US)) {
+                retirePrevious();
+            }
+        }
+
+        // Cut on video keyframes, or on any packet when there is no video
+        bool cut = video ? (pkt->flags & AV_PKT_FLAG_KEY) != 0 : !videoCodec_;
+        if (cut && ptsUs != AV_NOPTS_VALUE && segmentStartUs_ != AV_NOPTS_VALUE
+            && ptsUs - segmentStartUs_ >= segmentUs_) {
+            int ret = rotate(ptsUs);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        return writeTo(*current_, segmentStartUs_, pkt, timebase, video);
+    }
+
+    int SegmentWriter::writeTo(Segment& segment, int64_t startUs, const AVPacket* pkt, AVRational timebase, bool video) {
+        AVStream* stream = video ? segment.output->videoStream() : segment.output->audioStream();
+        if (!stream) {
+            return AVERROR(EINVAL);
+        }
+
+        AVPacket* clone = av_packet_clone(pkt);
+        if (!clone) {
+            return AVERROR(ENOMEM);
+        }
+
+        // Every segment starts at zero so it plays on its own
+        if (startUs != AV_NOPTS_VALUE) {
+            int64_t offset = av_rescale_q(startUs, AV_TIME_BASE_Q, timebase);
+            if (clone->pts != AV_NOPTS_VALUE) {
+                clone->pts -= offset;
+            }
+            if (clone->dts != AV_NOPTS_VALUE) {
+                clone->dts -= offset;
+            }
+        }
+
+        av_packet_rescale_ts(clone, timebase, stream->time_base);
+        clone->stream_index = stream->index;
+
+        int ret = segment.output->writePacket(clone);
+        av_packet_free(&clone);
+        return ret;
+    }
+
+    void SegmentWriter::post(std::function<void()> task) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        tasks_.push_back(std::move(task));
+        cond_.notify_all();
+    }
+
+    void SegmentWriter::workerThread() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> locker(mutex_);
+                cond_.wait(locker, [this]() {
+                    return !tasks_.empty() || stopping_;
+                    });
+
+                if (tasks_.empty()) {
+                    break;
+                }
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            task();
+        }
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+#include "FFmpeg.h"
+#include "FileSink.h"
+#include "MediaOutput.h"
+
+namespace media {
+
+    struct SegmentWriterStats {
+        int segments = 0;
+        int deleted = 0;
+        // Bytes of the closed segments still on disk
+        int64_t diskBytes = 0;
+        // Longest time a write spent switching segments
+        int64_t maxRotationUs = 0;
+        // Last background open/close error (0 = none)
+        int error = 0;
+    };
+
+    class SegmentWriter {
+    public:
+        SegmentWriter(const SegmentWriter&) = delete;
+        SegmentWriter& operator=(const SegmentWriter&) = delete;
+        SegmentWriter(SegmentWriter&&) = delete;
+        SegmentWriter& operator=(SegmentWriter&&) = delete;
+
+        SegmentWriter();
+        ~SegmentWriter();
+
+        // Open segment writer (pattern, format, videoEncoder, audioEncoder, segmentUs, maxSegments, maxBytes) >= 0
+        // pattern holds one %d field ("/rec/cam1_%06d.mp4"), format "" = guessed from pattern
+        // Segments are cut on the first video keyframe after segmentUs, the next file is opened and
+        // preallocated in the background, the oldest closed files are deleted past maxSegments/maxBytes
+        // Audio still behind the cut goes to the outgoing segment, which is closed in the background
+        // once audio catches up; a write only waits when the next file is not open yet
+        int open(const std::string& pattern,
+                 const std::string& format,
+                 AVCodecContext* videoEncoder,
+                 AVCodecContext* audioEncoder,
+                 int64_t segmentUs = 60000000,
+                 int maxSegments = 0,
+                 int64_t maxBytes = 0);
+
+        // Write video packet (pkt, timebase) >= 0, pkt is referenced, timebase = pkt time_base
+        int writeVideoPacket(const AVPacket* pkt, AVRational timebase);
+        // Write audio packet (pkt, timebase) >= 0
+        int writeAudioPacket(const AVPacket* pkt, AVRational timebase);
+
+        // Close segment writer >= 0, finishes the current segment
+        int close();
+
+        int segmentIndex()          const { return index_; }
+        SegmentWriterStats stats()  const;
+
+    private:
+        struct Segment {
+            std::string path;
+            std::unique_ptr<FileSink> sink;
+            std::unique_ptr<MediaOutput> output;
+        };
+
+        struct ClosedSegment {
+            std::string path;
+            int64_t bytes = 0;
+        };
+
+        int openSegment(int index, int64_t preallocate, std::unique_ptr<Segment>& segment);
+        void prepareNext(int64_t preallocate);
+        int rotate(int64_t startUs);
+        void retirePrevious();
+        void closeSegment(std::unique_ptr<Segment> segment, bool keep);
+        int writePacket(const AVPacket* pkt, AVRational timebase, bool video);
+        int writeTo(Segment& segment, int64_t startUs, const AVPacket* pkt, AVRational timebase, bool video);
+        void post(std::function<void()> task);
+        void workerThread();
+
+    private:
+        mutable std::mutex mutex_;
+        std::condition_variable cond_;
+
+        std::string pattern_;
+        std::string format_;
+        std::shared_ptr<AVCodecContext> videoCodec_;
+        std::shared_ptr<AVCodecContext> audioCodec_;
+        int64_t segmentUs_;
+        int maxSegments_;
+        int64_t maxBytes_;
+
+        int index_;
+        int64_t segmentStartUs_;
+        int64_t previousStartUs_;
+        std::unique_ptr<Segment> current_;
+        // Outgoing segment still taking late audio
+        std::unique_ptr<Segment> previous_;
+        // Opened by the worker, guarded by mutex_ while preparing_
+        std::unique_ptr<Segment> prepared_;
+        bool preparing_;
+
+        // Opens and closes segment files off the write path, in order
+        std::thread worker_;
+        std::deque<std::function<void()>> tasks_;
+        bool stopping_;
+
+        std::deque<ClosedSegment> closed_;
+        int segments_;
+        int deleted_;
+        int64_t diskBytes_;
+        int64_t maxRotationUs_;
+        int error_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,730 @@
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "SmartTrimmer.h"
+
+namespace media {
+
+    static std::string encoderProfileName(AVCodecID codecid, int profile) {
+        const char* name = avcodec_profile_name(codecid, profile);
+        if (!name) {
+            return "";
+        }
+
+        // "High 4:2:2" -> "high422", "Main 10" -> "main10", as libx264/libx265 expect
+        std::string value;
+        for (const char* p = name; *p; ++p) {
+            if (*p != ' ' && *p != ':') {
+                value += static_cast<char>(std::tolower(static_cast<unsigned char>(*p)));
+            }
+        }
+
+        if (value.compare(0, 11, "constrained") == 0) {
+            value.erase(0, 11);
+        }
+        if (value.compare(0, 7, "high444") == 0) {
+            value.resize(7);
+        }
+
+        return value;
+    }
+
+    static int64_t keyTimestamp(const AVPacket* pkt) {
+        int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        return ts != AV_NOPTS_VALUE ? ts : INT64_MAX;
+    }
+
+    // MP4/MOV sample entry that allows parameter sets in band, 0 = keep the stream's tag
+    static uint32_t inBandTag(const std::string& output, const std::string& format, AVCodecID codecid) {
+        const AVOutputFormat* muxer = av_guess_format(format.empty() ? nullptr : format.c_str(), output.c_str(), nullptr);
+        if (!muxer || (std::strstr(muxer->name, "mp4") == nullptr && std::strstr(muxer->name, "mov") == nullptr)) {
+            return 0;
+        }
+
+        return codecid == AV_CODEC_ID_H264 ? MKTAG('a', 'v', 'c', '3') : MKTAG('h', 'e', 'v', '1');
+    }
+
+    SmartTrimmer::SmartTrimmer()
+        : video_(nullptr)
+        , audio_(nullptr)
+        , bsf_(nullptr)
+        , pkt_(nullptr)
+        , out_(nullptr)
+        , startTs_(0)
+        , endTs_(INT64_MAX)
+        , startUs_(0)
+        , endUs_(INT64_MAX)
+        , delay_(AV_NOPTS_VALUE)
+        , lastVideoDts_(AV_NOPTS_VALUE)
+        , lastAudioDts_(AV_NOPTS_VALUE)
+        , prevCopied_(false)
+        , leadingEncoded_(false)
+        , stopped_(false)
+        , copiedGops_(0)
+        , encodedGops_(0)
+        , copiedPackets_(0)
+        , encodedFrames_(0)
+        , audioCount_(0)
+        , dropped_(0)
+        , error_(0) {
+    }
+
+    SmartTrimmer::~SmartTrimmer() {
+        stop();
+        cleanup();
+    }
+
+    int SmartTrimmer::trimFile(const std::string& input,
+                               const std::string& output,
+                               const std::string& format,
+                               int64_t startUs,
+                               int64_t endUs) {
+        if (input.empty() || output.empty() || startUs < 0 || endUs < 0 || (endUs > 0 && endUs <= startUs)) {
+            return AVERROR(EINVAL);
+        }
+
+        cleanup();
+
+        stopped_.store(false);
+        copiedGops_.store(0);
+        encodedGops_.store(0);
+        copiedPackets_.store(0);
+        encodedFrames_.store(0);
+        audioCount_.store(0);
+        dropped_.store(0);
+        error_.store(0);
+
+        int ret = input_.openFileStream(input);
+        if (ret < 0) {
+            error_.store(ret);
+            return ret;
+        }
+
+        if (!input_.hasVideoStream()) {
+            cleanup();
+            return AVERROR_STREAM_NOT_FOUND;
+        }
+
+        AVFormatContext* ctx = input_.inputContext();
+        video_ = ctx->streams[input_.videoParams().index];
+        audio_ = input_.hasAudioStream() ? ctx->streams[input_.audioParams().index] : nullptr;
+
+        const AVCodecParameters* params = video_->codecpar;
+        if (params->codec_id != AV_CODEC_ID_H264 && params->codec_id != AV_CODEC_ID_HEVC) {
+            cleanup();
+            return AVERROR(ENOSYS);
+        }
+
+        int64_t startTime = ctx->start_time != AV_NOPTS_VALUE ? ctx->start_time : 0;
+        startUs_ = startTime + startUs;
+        endUs_ = endUs > 0 ? startTime + endUs : INT64_MAX;
+        startTs_ = av_rescale_q(startUs_, AV_TIME_BASE_Q, video_->time_base);
+        endTs_ = endUs > 0 ? av_rescale_q(endUs_, AV_TIME_BASE_Q, video_->time_base) : INT64_MAX;
+
+        // MP4/MKV store length-prefixed NAL units; copied packets go to Annex B so they join the
+        // encoder output, and the filter repeats the source SPS/PPS on every copied IDR
+        if (params->extradata_size > 0 && params->extradata[0] == 1) {
+            const AVBitStreamFilter* filter = av_bsf_get_by_name(params->codec_id == AV_CODEC_ID_H264 ? "h264_mp4toannexb" : "hevc_mp4toannexb");
+            if (!filter) {
+                cleanup();
+                return AVERROR_BSF_NOT_FOUND;
+            }
+
+            ret = av_bsf_alloc(filter, &bsf_);
+            if (ret >= 0) {
+                ret = avcodec_parameters_copy(bsf_->par_in, params);
+            }
+            if (ret >= 0) {
+                bsf_->time_base_in = video_->time_base;
+                ret = av_bsf_init(bsf_);
+            }
+            if (ret < 0) {
+                cleanup();
+                error_.store(ret);
+                return ret;
+            }
+
+            params = bsf_->par_out;
+        }
+
+        // Copied and re-encoded GOPs carry different SPS/PPS in band, avc1/hvc1 would promise
+        // that the sample entry holds the only ones
+        AVCodecParameters* videoParams = avcodec_parameters_alloc();
+        ret = videoParams ? avcodec_parameters_copy(videoParams, params) : AVERROR(ENOMEM);
+        if (ret >= 0) {
+            uint32_t tag = inBandTag(output, format, videoParams->codec_id);
+            if (tag != 0) {
+                videoParams->codec_tag = tag;
+            }
+
+            ret = output_.writeFile(output, format, videoParams, video_->time_base,
+                                    audio_ ? audio_->codecpar : nullptr, audio_ ? audio_->time_base : AVRational{ 0, 1 });
+        }
+        avcodec_parameters_free(&videoParams);
+
+        if (ret < 0) {
+            cleanup();
+            error_.store(ret);
+            return ret;
+        }
+
+        if (startUs > 0) {
+            // Keyframe at or before the cut-in, the partial GOP is decoded from there
+            ret = avformat_seek_file(ctx, video_->index, INT64_MIN, startTs_, startTs_, 0);
+            if (ret < 0) {
+                cleanup();
+                error_.store(ret);
+                return ret;
+            }
+        }
+
+        pkt_ = av_packet_alloc();
+        out_ = av_packet_alloc();
+        if (!pkt_ || !out_) {
+            cleanup();
+            return AVERROR(ENOMEM);
+        }
+
+        // Each GOP is held until the GOP after it has been read: its end shows whether it lies wholly
+        // inside the range, and a re-encode also decodes that GOP's open-GOP leading pictures
+        bool eof = false;
+        int64_t endKeyPts = INT64_MAX;
+        while (!stopped_.load()) {
+            ret = av_read_frame(ctx, pkt_);
+            if (ret < 0) {
+                if (ret == AVERROR_EOF) {
+                    eof = true;
+                    ret = 0;
+                }
+                break;
+            }
+
+            if (pkt_->stream_index == video_->index) {
+                bool key = (pkt_->flags & AV_PKT_FLAG_KEY) != 0;
+
+                // Past the range only the leading pictures of the keyframe that ends it are read
+                if (endKeyPts != INT64_MAX && (key || pkt_->pts == AV_NOPTS_VALUE || pkt_->pts >= endKeyPts)) {
+                    av_packet_unref(pkt_);
+                    break;
+                }
+
+                if (key) {
+                    int64_t keyPts = keyTimestamp(pkt_);
+
+                    ret = advanceGop();
+                    if (ret < 0) {
+                        break;
+                    }
+
+                    if (keyPts != INT64_MAX && keyPts >= endTs_) {
+                        endKeyPts = keyPts;
+                    }
+
+                    if (delay_ == AV_NOPTS_VALUE && pkt_->pts != AV_NOPTS_VALUE && pkt_->dts != AV_NOPTS_VALUE) {
+                        delay_ = std::max<int64_t>(0, pkt_->pts - pkt_->dts);
+                    }
+                }
+
+                if (next_.empty() && !key) {
+                    av_packet_unref(pkt_);
+                    continue;
+                }
+
+                AVPacket* ref = av_packet_alloc();
+                if (!ref) {
+                    ret = AVERROR(ENOMEM);
+                    break;
+                }
+                av_packet_move_ref(ref, pkt_);
+                next_.push_back(ref);
+            }
+            else if (audio_ && pkt_->stream_index == audio_->index) {
+                int64_t ts = pkt_->pts != AV_NOPTS_VALUE ? pkt_->pts : pkt_->dts;
+                if (ts == AV_NOPTS_VALUE || av_rescale_q(ts, audio_->time_base, AV_TIME_BASE_Q) >= endUs_) {
+                    av_packet_unref(pkt_);
+                    continue;
+                }
+
+                AVPacket* ref = av_packet_alloc();
+                if (!ref) {
+                    ret = AVERROR(ENOMEM);
+                    break;
+                }
+                av_packet_move_ref(ref, pkt_);
+                audioPackets_.push_back(ref);
+            }
+            else {
+                av_packet_unref(pkt_);
+            }
+        }
+
+        // The last GOP in range ends at the keyframe that ended the range, whose GOP is never
+        // written, or at the end of the file
+        if (ret >= 0 && !stopped_.load() && endKeyPts != INT64_MAX) {
+            ret = advanceGop();
+        }
+        else if (ret >= 0 && !stopped_.load() && eof) {
+            ret = advanceGop();
+            if (ret >= 0 && !gop_.empty()) {
+                ret = processGop(INT64_MAX);
+            }
+        }
+
+        if (ret >= 0 && !stopped_.load()) {
+            ret = writeAudio(INT64_MAX);
+        }
+
+        if (ret >= 0 && stopped_.load()) {
+            ret = AVERROR_EXIT;
+        }
+
+        cleanup();
+
+        if (ret < 0) {
+            int expected = 0;
+            error_.compare_exchange_strong(expected, ret);
+        }
+
+        return ret;
+    }
+
+    void SmartTrimmer::stop() {
+        stopped_.store(true);
+    }
+
+    TrimStats SmartTrimmer::stats() const {
+        TrimStats s;
+        s.copiedGops = copiedGops_.load();
+        s.encodedGops = encodedGops_.load();
+        s.copiedPackets = copiedPackets_.load();
+        s.encodedFrames = encodedFrames_.load();
+        s.audioPackets = audioCount_.load();
+        s.dropped = dropped_.load();
+        s.error = error_.load();
+        return s;
+    }
+
+    int SmartTrimmer::advanceGop() {
+        if (next_.empty()) {
+            return 0;
+        }
+
+        int ret = 0;
+        if (!gop_.empty()) {
+            ret = processGop(keyTimestamp(next_.front()));
+        }
+
+        // processGop left gop_ empty
+        gop_.swap(next_);
+        return ret;
+    }
+
+    int SmartTrimmer::processGop(int64_t nextKeyPts) {
+        const AVPacket* first = gop_.front();
+        int64_t keyPts = first->pts != AV_NOPTS_VALUE ? first->pts : first->dts;
+
+        // A GOP ending exactly at the range end is copied only when no leading picture of the
+        // keyframe there falls inside the range, those have to be re-encoded with this GOP
+        bool leadingAtEnd = nextKeyPts == endTs_ && next_.size() > 1 && next_[1]->pts != AV_NOPTS_VALUE
+            && next_[1]->pts < nextKeyPts;
+
+        int ret = 0;
+        if (keyPts != AV_NOPTS_VALUE && keyPts >= startTs_ && nextKeyPts <= endTs_ && !leadingAtEnd) {
+            ret = copyGop(keyPts);
+        }
+        else {
+            int64_t from = keyPts != AV_NOPTS_VALUE ? std::max(startTs_, keyPts) : startTs_;
+            ret = encodeGop(from, std::min(endTs_, nextKeyPts));
+        }
+
+        for (AVPacket*& pkt : gop_) {
+            av_packet_free(&pkt);
+        }
+        gop_.clear();
+
+        if (ret < 0) {
+            return ret;
+        }
+
+        // Audio follows the video written so far, the muxer interleaves the rest
+        int64_t untilUs = nextKeyPts == INT64_MAX ? INT64_MAX : av_rescale_q(nextKeyPts, video_->time_base, AV_TIME_BASE_Q);
+        return writeAudio(std::min(untilUs, endUs_));
+    }
+
+    int SmartTrimmer::copyGop(int64_t keyPts) {
+        for (AVPacket* pkt : gop_) {
+            // Leading pictures of an open GOP reference the previous GOP: after a re-encode they were
+            // encoded with it, at the cut-in they lie before the range
+            if (!prevCopied_ && pkt != gop_.front() && pkt->pts != AV_NOPTS_VALUE && pkt->pts < keyPts) {
+                if (!leadingEncoded_) {
+                    dropped_.fetch_add(1);
+                }
+                continue;
+            }
+
+            int ret = filterPacket(pkt);
+            if (ret < 0) {
+                return ret;
+            }
+
+            copiedPackets_.fetch_add(1);
+        }
+
+        copiedGops_.fetch_add(1);
+        prevCopied_ = true;
+        leadingEncoded_ = false;
+        return 0;
+    }
+
+    int SmartTrimmer::encodeGop(int64_t fromPts, int64_t toPts) {
+        prevCopied_ = false;
+        leadingEncoded_ = false;
+
+        if (fromPts >= toPts) {
+            return 0;
+        }
+
+        MediaDecoder decoder;
+        int ret = decoder.openVideoDecoder(input_.inputContext(), false, 0, DecodeProfile::Throughput);
+        if (ret < 0) {
+            return ret;
+        }
+
+        AVCodecContext* codec = decoder.videoDecoder();
+        AVFrame* frame = av_frame_alloc();
+        if (!frame) {
+            return AVERROR(ENOMEM);
+        }
+
+        bool opened = false;
+        bool first = true;
+
+        // Frames outside [fromPts, toPts) are either before the cut or stream-copied
+        auto receive = [&]() -> int {
+            for (;;) {
+                int r = avcodec_receive_frame(codec, frame);
+                if (r == AVERROR(EAGAIN) || r == AVERROR_EOF) {
+                    return 0;
+                }
+                if (r < 0) {
+                    return r;
+                }
+
+                int64_t pts = frame->best_effort_timestamp;
+                if (pts == AV_NOPTS_VALUE || pts < fromPts || pts >= toPts) {
+                    av_frame_unref(frame);
+                    continue;
+                }
+
+                if (!opened) {
+                    r = openEncoder(frame);
+                    if (r < 0) {
+                        av_frame_unref(frame);
+                        return r;
+                    }
+                    opened = true;
+                }
+
+                frame->pts = pts;
+                frame->pict_type = AV_PICTURE_TYPE_NONE;
+                r = encoder_.sendVideoFrame(frame);
+                av_frame_unref(frame);
+                if (r < 0) {
+                    return r;
+                }
+
+                encodedFrames_.fetch_add(1);
+
+                r = receiveEncoded(first);
+                if (r < 0) {
+                    return r;
+                }
+            }
+            };
+
+        // The next GOP's keyframe and the leading pictures right after it in decode order display
+        // before that keyframe and reference this GOP; they are encoded here, the copy skips them
+        std::vector<AVPacket*> packets(gop_);
+        if (!next_.empty()) {
+            int64_t nextKeyPts = keyTimestamp(next_.front());
+            packets.push_back(next_.front());
+            for (size_t i = 1; i < next_.size() && next_[i]->pts != AV_NOPTS_VALUE && next_[i]->pts < nextKeyPts; ++i) {
+                packets.push_back(next_[i]);
+            }
+        }
+
+        for (AVPacket* pkt : packets) {
+            ret = avcodec_send_packet(codec, pkt);
+            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_INVALIDDATA) {
+                break;
+            }
+
+            ret = receive();
+            if (ret < 0) {
+                break;
+            }
+        }
+
+        if (ret >= 0) {
+            ret = avcodec_send_packet(codec, nullptr);
+            if (ret >= 0) {
+                ret = receive();
+            }
+        }
+
+        if (ret >= 0 && opened) {
+            ret = encoder_.sendVideoFrame(nullptr);
+            if (ret >= 0) {
+                ret = receiveEncoded(first);
+            }
+        }
+
+        // A fresh encoder per boundary GOP, each part starts on an IDR with its own parameter sets
+        encoder_.resetVideoEncoder();
+        av_frame_free(&frame);
+
+        if (ret < 0) {
+            return ret;
+        }
+
+        leadingEncoded_ = !next_.empty();
+        encodedGops_.fetch_add(1);
+        return 0;
+    }
+
+    int SmartTrimmer::openEncoder(const AVFrame* frame) {
+        const AVCodecParameters* params = video_->codecpar;
+
+        AVRational framerate = video_->avg_frame_rate;
+        if (framerate.num <= 0 || framerate.den <= 0) {
+            framerate = video_->r_frame_rate;
+        }
+        if (framerate.num <= 0 || framerate.den <= 0) {
+            framerate = { 25, 1 };
+        }
+
+        // Stream bitrate, else the container's, else roughly 3 bits per pixel per second
+        int64_t bitrate = params->bit_rate;
+        if (bitrate <= 0) {
+            bitrate = input_.inputContext()->bit_rate;
+        }
+        if (bitrate <= 0) {
+            bitrate = static_cast<int64_t>(frame->width) * frame->height * 3;
+        }
+
+        AVDictionary* opt = nullptr;
+
+        std::string profile = encoderProfileName(params->codec_id, params->profile);
+        if (!profile.empty()) {
+            av_dict_set(&opt, "profile", profile.c_str(), 0);
+        }
+
+        if (params->codec_id == AV_CODEC_ID_H264 && params->level > 0) {
+            char level[16];
+            std::snprintf(level, sizeof(level), "%d.%d", params->level / 10, params->level % 10);
+            av_dict_set(&opt, "level", level, 0);
+        }
+
+        // No B-frames: re-encoded dts is pts minus the source reorder delay, so the joins with
+        // copied GOPs stay monotonic
+        encoder_.setMaxBFrames(0);
+
+        int ret = encoder_.openVideoEncoder(params->codec_id, frame->width, frame->height, bitrate,
+                                            video_->time_base, framerate, static_cast<AVPixelFormat>(frame->format),
+                                            false, 0, opt, EncodeProfile::OfflineThroughput);
+        av_dict_free(&opt);
+        return ret;
+    }
+
+    int SmartTrimmer::receiveEncoded(bool& first) {
+        AVCodecContext* codec = encoder_.videoEncoder();
+
+        for (;;) {
+            int ret = encoder_.receiveVideoPacket(out_);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return 0;
+            }
+            if (ret < 0) {
+                return ret;
+            }
+
+            // Global-header encoders keep SPS/PPS out of band, put them in front of the first IDR
+            if (first && codec->extradata_size > 0 && codec->extradata[0] == 0) {
+                AVPacket* merged = av_packet_alloc();
+                if (!merged) {
+                    av_packet_unref(out_);
+                    return AVERROR(ENOMEM);
+                }
+
+                ret = av_new_packet(merged, codec->extradata_size + out_->size);
+                if (ret >= 0) {
+                    ret = av_packet_copy_props(merged, out_);
+                }
+                if (ret < 0) {
+                    av_packet_free(&merged);
+                    av_packet_unref(out_);
+                    return ret;
+                }
+
+                std::memcpy(merged->data, codec->extradata, codec->extradata_size);
+                std::memcpy(merged->data + codec->extradata_size, out_->data, out_->size);
+
+                av_packet_unref(out_);
+                av_packet_move_ref(out_, merged);
+                av_packet_free(&merged);
+            }
+            first = false;
+
+            if (out_->pts != AV_NOPTS_VALUE) {
+                out_->dts = out_->pts - (delay_ != AV_NOPTS_VALUE ? delay_ : 0);
+            }
+
+            ret = writeVideo(out_);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    int SmartTrimmer::filterPacket(AVPacket* pkt) {
+        if (!bsf_) {
+            return writeVideo(pkt);
+        }
+
+        int ret = av_bsf_send_packet(bsf_, pkt);
+        if (ret < 0) {
+            return ret;
+        }
+
+        for (;;) {
+            ret = av_bsf_receive_packet(bsf_, out_);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return 0;
+            }
+            if (ret < 0) {
+                return ret;
+            }
+
+            ret = writeVideo(out_);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    int SmartTrimmer::writeVideo(AVPacket* pkt) {
+        AVStream* stream = output_.videoStream();
+
+        // The output timeline starts at the cut-in
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts -= startTs_;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts -= startTs_;
+        }
+
+        av_packet_rescale_ts(pkt, video_->time_base, stream->time_base);
+
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            if (lastVideoDts_ != AV_NOPTS_VALUE && pkt->dts <= lastVideoDts_) {
+                pkt->dts = lastVideoDts_ + 1;
+                if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+                    pkt->pts = pkt->dts;
+                }
+            }
+            lastVideoDts_ = pkt->dts;
+        }
+
+        pkt->stream_index = stream->index;
+        pkt->pos = -1;
+        return output_.writePacket(pkt);
+    }
+
+    int SmartTrimmer::writeAudio(int64_t untilUs) {
+        while (!audioPackets_.empty()) {
+            AVPacket* pkt = audioPackets_.front();
+            int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            int64_t us = av_rescale_q(ts, audio_->time_base, AV_TIME_BASE_Q);
+            if (us >= untilUs) {
+                break;
+            }
+
+            audioPackets_.pop_front();
+
+            if (us < startUs_) {
+                av_packet_free(&pkt);
+                continue;
+            }
+
+            AVStream* stream = output_.audioStream();
+            int64_t offset = av_rescale_q(startUs_, AV_TIME_BASE_Q, audio_->time_base);
+            if (pkt->pts != AV_NOPTS_VALUE) {
+                pkt->pts -= offset;
+            }
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                pkt->dts -= offset;
+            }
+
+            av_packet_rescale_ts(pkt, audio_->time_base, stream->time_base);
+
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                if (lastAudioDts_ != AV_NOPTS_VALUE && pkt->dts <= lastAudioDts_) {
+                    pkt->dts = lastAudioDts_ + 1;
+                    if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+                        pkt->pts = pkt->dts;
+                    }
+                }
+                lastAudioDts_ = pkt->dts;
+            }
+
+            pkt->stream_index = stream->index;
+            pkt->pos = -1;
+
+            int ret = output_.writePacket(pkt);
+            av_packet_free(&pkt);
+            if (ret < 0) {
+                return ret;
+            }
+
+            audioCount_.fetch_add(1);
+        }
+
+        return 0;
+    }
+
+    void SmartTrimmer::cleanup() {
+        for (AVPacket*& pkt : gop_) {
+            av_packet_free(&pkt);
+        }
+        gop_.clear();
+
+        for (AVPacket*& pkt : next_) {
+            av_packet_free(&pkt);
+        }
+        next_.clear();
+
+        for (AVPacket*& pkt : audioPackets_) {
+            av_packet_free(&pkt);
+        }
+        audioPackets_.clear();
+
+        av_bsf_free(&bsf_);
+        av_packet_free(&pkt_);
+        av_packet_free(&out_);
+
+        // The trailer is written even after a failure, the output is valid up to there
+        encoder_.resetVideoEncoder();
+        output_.reset();
+        input_.reset();
+
+        video_ = nullptr;
+        audio_ = nullptr;
+        delay_ = AV_NOPTS_VALUE;
+        lastVideoDts_ = AV_NOPTS_VALUE;
+        lastAudioDts_ = AV_NOPTS_VALUE;
+        prevCopied_ = false;
+        leadingEncoded_ = false;
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "FFmpeg.h"
+#include "MediaInput.h"
+#include "MediaOutput.h"
+#include "MediaDecoder.h"
+#include "MediaEncoder.h"
+
+namespace media {
+
+    struct TrimStats {
+        // Whole GOPs stream-copied and boundary GOPs re-encoded
+        int64_t copiedGops = 0;
+        int64_t encodedGops = 0;
+        int64_t copiedPackets = 0;
+        int64_t encodedFrames = 0;
+        int64_t audioPackets = 0;
+        // Open-GOP leading pictures left out because they precede the cut-in; those after a
+        // re-encoded GOP are re-encoded with it and count as encoded frames
+        int64_t dropped = 0;
+        int error = 0;
+    };
+
+    class SmartTrimmer {
+    public:
+        SmartTrimmer(const SmartTrimmer&) = delete;
+        SmartTrimmer& operator=(const SmartTrimmer&) = delete;
+        SmartTrimmer(SmartTrimmer&&) = delete;
+        SmartTrimmer& operator=(SmartTrimmer&&) = delete;
+
+        SmartTrimmer();
+        ~SmartTrimmer();
+
+        // Trim file (input, output, format, startUs, endUs) >= 0, frame accurate, endUs = 0 trims to the end
+        // Only the GOPs cut by startUs/endUs are decoded and re-encoded with the source codec, profile and
+        // bitrate; whole GOPs in between are stream-copied. H.264/HEVC only: both parts are written as
+        // Annex B with in-band parameter sets so the joins decode with their own SPS/PPS; MP4/MOV
+        // outputs are tagged avc3/hev1, the sample entries that allow parameter sets in band
+        int trimFile(const std::string& input,
+                     const std::string& output,
+                     const std::string& format,
+                     int64_t startUs,
+                     int64_t endUs = 0);
+
+        // Stop a running trim, trimFile returns AVERROR_EXIT
+        void stop();
+
+        TrimStats stats() const;
+
+    private:
+        int advanceGop();
+        int processGop(int64_t nextKeyPts);
+        int copyGop(int64_t keyPts);
+        int encodeGop(int64_t fromPts, int64_t toPts);
+        int openEncoder(const AVFrame* frame);
+        int receiveEncoded(bool& first);
+        int filterPacket(AVPacket* pkt);
+        int writeVideo(AVPacket* pkt);
+        int writeAudio(int64_t untilUs);
+        void cleanup();
+
+    private:
+        MediaInput input_;
+        MediaOutput output_;
+        MediaEncoder encoder_;
+
+        AVStream* video_;
+        AVStream* audio_;
+        AVBSFContext* bsf_;
+        AVPacket* pkt_;
+        AVPacket* out_;
+
+        // GOP being processed and the one read after it, whose open-GOP leading pictures
+        // need the former's references
+        std::vector<AVPacket*> gop_;
+        std::vector<AVPacket*> next_;
+        std::deque<AVPacket*> audioPackets_;
+
+        int64_t startTs_;
+        int64_t endTs_;
+        int64_t startUs_;
+        int64_t endUs_;
+        int64_t delay_;
+        int64_t lastVideoDts_;
+        int64_t lastAudioDts_;
+        bool prevCopied_;
+        bool leadingEncoded_;
+
+        std::atomic<bool> stopped_;
+        std::atomic<int64_t> copiedGops_;
+        std::atomic<int64_t> encodedGops_;
+        std::atomic<int64_t> copiedPackets_;
+        std::atomic<int64_t> encodedFrames_;
+        std::atomic<int64_t> audioCount_;
+        std::atomic<int64_t> dropped_;
+        std::atomic<int> error_;
+    };
+
+} // namespace media
\ No newline at end of file
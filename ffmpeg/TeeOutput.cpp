@@ -0,0 +1,178 @@
+#include "TeeOutput.h"
+
+namespace media {
+
+    TeeOutput::TeeOutput() {
+    }
+
+    TeeOutput::~TeeOutput() {
+        close();
+    }
+
+    int TeeOutput::addSink(std::unique_ptr<MediaOutput> output, DropPolicy policy, size_t maxPackets, int64_t ioTimeoutUs) {
+        if (!output || !output->outputContext()) {
+            return AVERROR(EINVAL);
+        }
+
+        if (ioTimeoutUs > 0) {
+            output->setIOTimeout(ioTimeoutUs);
+        }
+
+        std::unique_ptr<Sink> sink(new Sink());
+        sink->output = std::move(output);
+        sink->policy = policy;
+        sink->queue.setLimit(0, std::max<size_t>(1, maxPackets));
+        sink->queue.setClearCallback([](AVPacket* pkt) {
+            av_packet_free(&pkt);
+            });
+
+        sink->thread = std::thread(&TeeOutput::writerThread, this, sink.get());
+        sinks_.push_back(std::move(sink));
+        return static_cast<int>(sinks_.size()) - 1;
+    }
+
+    int TeeOutput::writeVideoPacket(const AVPacket* pkt, AVRational timebase) {
+        return writePacket(pkt, timebase, true);
+    }
+
+    int TeeOutput::writeAudioPacket(const AVPacket* pkt, AVRational timebase) {
+        return writePacket(pkt, timebase, false);
+    }
+
+    int TeeOutput::close() {
+        int ret = 0;
+
+        for (auto& sink : sinks_) {
+            // A packet without data tells the writer to exit once the queue is drained; a dropping
+            // sink that is still full is not waited for, its queue is dropped instead
+            AVPacket* eos = av_packet_alloc();
+            bool queued = eos && (sink->policy == DropPolicy::Block
+                ? sink->queue.enqueue(eos)
+                : sink->queue.tryEnqueue(eos));
+
+            if (!queued) {
+                av_packet_free(&eos);
+                sink->queue.lock();
+                sink->queue.clear();
+            }
+        }
+
+        for (auto& sink : sinks_) {
+            if (sink->thread.joinable()) {
+                sink->thread.join();
+            }
+
+            sink->queue.lock();
+            sink->queue.clear();
+            sink->output->reset();
+
+            if (ret == 0 && sink->error.load() < 0) {
+                ret = sink->error.load();
+            }
+        }
+
+        sinks_.clear();
+        return ret;
+    }
+
+    TeeSinkStats TeeOutput::sinkStats(int i) const {
+        const Sink* sink = sinks_[i].get();
+
+        TeeSinkStats s;
+        s.packets = sink->packets.load();
+        s.bytes = sink->bytes.load();
+        s.dropped = sink->dropped.load();
+        s.queueDepth = sink->queue.size();
+        s.error = sink->error.load();
+        return s;
+    }
+
+    int TeeOutput::writePacket(const AVPacket* pkt, AVRational timebase, bool video) {
+        if (!pkt || sinks_.empty()) {
+            return AVERROR(EINVAL);
+        }
+
+        const bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+        int failed = 0;
+
+        for (auto& sink : sinks_) {
+            if (sink->error.load() < 0) {
+                // A failed sink is offline, the others keep going
+                ++failed;
+                continue;
+            }
+
+            AVStream* stream = video ? sink->output->videoStream() : sink->output->audioStream();
+            if (!stream) {
+                continue;
+            }
+
+            if (sink->policy == DropPolicy::DropUntilKeyframe && video && sink->waitKeyframe) {
+                if (!key) {
+                    sink->dropped.fetch_add(1);
+                    continue;
+                }
+                sink->waitKeyframe = false;
+            }
+
+            AVPacket* clone = av_packet_clone(pkt);
+            bool queued = false;
+
+            if (clone) {
+                av_packet_rescale_ts(clone, timebase, stream->time_base);
+                clone->stream_index = stream->index;
+
+                queued = sink->policy == DropPolicy::Block
+                    ? sink->queue.enqueue(clone)
+                    : sink->queue.tryEnqueue(clone);
+            }
+
+            if (!queued) {
+                av_packet_free(&clone);
+                sink->dropped.fetch_add(1);
+
+                // References after a dropped video packet are broken until the next keyframe
+                if (sink->policy == DropPolicy::DropUntilKeyframe && video) {
+                    sink->waitKeyframe = true;
+                }
+            }
+        }
+
+        // An allocation failure only drops the packet for that sink, like a full queue
+        if (failed == static_cast<int>(sinks_.size())) {
+            return sinks_[0]->error.load();
+        }
+
+        return 0;
+    }
+
+    void TeeOutput::writerThread(Sink* sink) {
+        for (;;) {
+            AVPacket* pkt = sink->queue.dequeue();
+            if (!pkt) {
+                break;
+            }
+
+            if (!pkt->data && !pkt->side_data_elems) {
+                av_packet_free(&pkt);
+                break;
+            }
+
+            int size = pkt->size;
+            int ret = sink->output->writePacket(pkt);
+            av_packet_free(&pkt);
+
+            if (ret < 0) {
+                // Take the sink offline, unblock a Block producer and drop what is queued
+                sink->error.store(ret);
+                sink->queue.lock();
+                sink->queue.clear();
+                break;
+            }
+
+            sink->packets.fetch_add(1);
+            sink->bytes.fetch_add(size);
+        }
+    }
+
+} // namespace media
\ No newline at end of file
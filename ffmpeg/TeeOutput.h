@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include "FFmpeg.h"
+#include "MediaOutput.h"
+#include "../queue/MediaQueue.h"
+
+namespace media {
+
+    enum class DropPolicy {
+        // Wait for queue space, the sink paces the encoder (local recording)
+        Block,
+        // When full, drop video up to the next keyframe and audio while full (network sinks)
+        DropUntilKeyframe
+    };
+
+    struct TeeSinkStats {
+        int64_t packets = 0;
+        int64_t bytes = 0;
+        int64_t dropped = 0;
+        size_t queueDepth = 0;
+        // Write error that took the sink offline (0 = none)
+        int error = 0;
+    };
+
+    class TeeOutput {
+    public:
+        TeeOutput(const TeeOutput&) = delete;
+        TeeOutput& operator=(const TeeOutput&) = delete;
+        TeeOutput(TeeOutput&&) = delete;
+        TeeOutput& operator=(TeeOutput&&) = delete;
+
+        using PacketQueue = MediaQueue<AVPacket>;
+
+        TeeOutput();
+        ~TeeOutput();
+
+        // Add sink (output, policy, maxPackets, ioTimeoutUs) >= sink index, output already opened (writeFile/writeNetwork/...)
+        // Sinks are added before the first packet; each gets its own writer thread
+        // Block is for local recording only, a stalled network sink with Block stalls every sink;
+        // ioTimeoutUs > 0 bounds each network write of the sink (MediaOutput::setIOTimeout), a write
+        // that expires takes the sink offline
+        int addSink(std::unique_ptr<MediaOutput> output,
+                    DropPolicy policy = DropPolicy::DropUntilKeyframe,
+                    size_t maxPackets = 256,
+                    int64_t ioTimeoutUs = 5000000);
+
+        // Write video packet (pkt, timebase) >= 0, pkt is referenced by every sink, timebase = pkt time_base
+        int writeVideoPacket(const AVPacket* pkt, AVRational timebase);
+        // Write audio packet (pkt, timebase) >= 0
+        int writeAudioPacket(const AVPacket* pkt, AVRational timebase);
+
+        // Close all sinks >= 0, drains the queues and writes trailers, returns the first sink error
+        int close();
+
+        int sinkCount()                   const { return static_cast<int>(sinks_.size()); }
+        MediaOutput* sinkOutput(int i)    const { return sinks_[i]->output.get(); }
+        TeeSinkStats sinkStats(int i)     const;
+
+    private:
+        struct Sink {
+            std::unique_ptr<MediaOutput> output;
+            DropPolicy policy = DropPolicy::Block;
+            PacketQueue queue;
+            std::thread thread;
+            bool waitKeyframe = false;
+            std::atomic<int64_t> packets{ 0 };
+            std::atomic<int64_t> bytes{ 0 };
+            std::atomic<int64_t> dropped{ 0 };
+            std::atomic<int> error{ 0 };
+        };
+
+        int writePacket(const AVPacket* pkt, AVRational timebase, bool video);
+        void writerThread(Sink* sink);
+
+    private:
+        std::vector<std::unique_ptr<Sink>> sinks_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -140,6 +140,37 @@ namespace media {
             return nullptr;
         }
 
+        // Non-blocking enqueue, false when full or locked
+        bool tryEnqueue(T* item) {
+            if (!item || locked_.load()) {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> locker(mutex_);
+
+            if (maxSize_ == 0 || queue_.size() >= maxSize_) {
+                return false;
+            }
+
+            queue_.push_back(item);
+            notEmpty_.notify_one();
+            return true;
+        }
+
+        // Non-blocking dequeue, nullptr when empty
+        T* tryDequeue() {
+            std::lock_guard<std::mutex> locker(mutex_);
+
+            if (queue_.empty()) {
+                return nullptr;
+            }
+
+            T* item = queue_.front();
+            queue_.pop_front();
+            notFull_.notify_one();
+            return item;
+        }
+
         size_t size() const {
             std::lock_guard<std::mutex> locker(mutex_);
             return queue_.size();
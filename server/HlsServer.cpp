@@ -0,0 +1,641 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#endif
+#include "HlsServer.h"
+
+namespace media {
+
+#if defined(__linux__)
+
+    static const size_t MAX_REQUEST_SIZE = 16 * 1024;
+    static const int MAX_EVENTS = 64;
+
+    static bool endsWith(const std::string& value, const char* suffix) {
+        size_t n = std::strlen(suffix);
+        return value.size() >= n && value.compare(value.size() - n, n, suffix) == 0;
+    }
+
+    static const char* contentType(const std::string& name) {
+        if (endsWith(name, ".m3u8")) {
+            return "application/vnd.apple.mpegurl";
+        }
+        if (endsWith(name, ".mpd")) {
+            return "application/dash+xml";
+        }
+        if (endsWith(name, ".ts")) {
+            return "video/mp2t";
+        }
+        if (endsWith(name, ".m4s") || endsWith(name, ".mp4") || endsWith(name, ".cmfv")) {
+            return "video/mp4";
+        }
+        if (endsWith(name, ".m4a") || endsWith(name, ".cmfa")) {
+            return "audio/mp4";
+        }
+        if (endsWith(name, ".aac")) {
+            return "audio/aac";
+        }
+        return "application/octet-stream";
+    }
+
+    static const char* statusText(int status) {
+        switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default:  return "Error";
+        }
+    }
+
+    static int64_t queryValue(const std::string& query, const char* key) {
+        size_t n = std::strlen(key);
+        size_t pos = 0;
+        while (pos < query.size()) {
+            size_t end = query.find('&', pos);
+            if (end == std::string::npos) {
+                end = query.size();
+            }
+            if (end - pos > n && query.compare(pos, n, key) == 0 && query[pos + n] == '=') {
+                return std::strtoll(query.c_str() + pos + n + 1, nullptr, 10);
+            }
+            pos = end + 1;
+        }
+        return -1;
+    }
+
+    struct PlaylistPosition {
+        // Last complete segment, parts published for the segment after it
+        int64_t lastMsn = -1;
+        int64_t parts = 0;
+        int64_t targetUs = 6000000;
+    };
+
+    static PlaylistPosition playlistPosition(const MemoryFile& file) {
+        PlaylistPosition position;
+        int64_t sequence = 0;
+        int64_t segments = 0;
+
+        const char* p = reinterpret_cast<const char*>(file.data.data());
+        const char* end = p + file.data.size();
+        while (p < end) {
+            const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!eol) {
+                eol = end;
+            }
+
+            std::string line(p, eol);
+            if (line.compare(0, 22, "#EXT-X-MEDIA-SEQUENCE:") == 0) {
+                sequence = std::strtoll(line.c_str() + 22, nullptr, 10);
+            }
+            else if (line.compare(0, 22, "#EXT-X-TARGETDURATION:") == 0) {
+                position.targetUs = std::strtoll(line.c_str() + 22, nullptr, 10) * 1000000;
+            }
+            else if (line.compare(0, 8, "#EXTINF:") == 0) {
+                // Parts listed before a segment line belong to that segment
+                ++segments;
+                position.parts = 0;
+            }
+            else if (line.compare(0, 12, "#EXT-X-PART:") == 0) {
+                ++position.parts;
+            }
+
+            p = eol + 1;
+        }
+
+        position.lastMsn = sequence + segments - 1;
+        return position;
+    }
+
+    HlsServer::HlsServer()
+        : store_(nullptr)
+        , listenerId_(-1)
+        , listenFd_(-1)
+        , epollFd_(-1)
+        , port_(0)
+        , eventFd_(-1)
+        , running_(false)
+        , connections_(0)
+        , requests_(0)
+        , bytes_(0)
+        , blocked_(0)
+        , timeouts_(0) {
+    }
+
+    HlsServer::~HlsServer() {
+        stop();
+    }
+
+    int HlsServer::start(SegmentStore* store, int port, const std::string& address) {
+        if (!store || port < 0 || port > 65535) {
+            return AVERROR(EINVAL);
+        }
+
+        stop();
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+            return AVERROR(EINVAL);
+        }
+
+        listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0) {
+            return AVERROR(errno);
+        }
+
+        int on = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd_, SOMAXCONN) < 0) {
+            int ret = AVERROR(errno);
+            stop();
+            return ret;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd_, reinterpret_cast<sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        {
+            std::lock_guard<std::mutex> locker(eventMutex_);
+            eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+        if (epollFd_ < 0 || eventFd_ < 0) {
+            int ret = AVERROR(errno);
+            stop();
+            return ret;
+        }
+
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = listenFd_;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+        ev.data.fd = eventFd_;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &ev);
+
+        listenerId_ = store->addListener([this](const MemoryFilePtr&) {
+            notify();
+            });
+        store_ = store;
+
+        running_.store(true);
+        thread_ = std::thread(&HlsServer::serverThread, this);
+        return 0;
+    }
+
+    void HlsServer::stop() {
+        // Waits for a wakeup in flight on the muxer thread, none follow
+        if (store_) {
+            store_->removeListener(listenerId_);
+            listenerId_ = -1;
+        }
+
+        if (running_.exchange(false)) {
+            notify();
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        store_ = nullptr;
+
+        for (auto& client : clients_) {
+            ::close(client.first);
+        }
+        clients_.clear();
+        connections_.store(0);
+
+        if (listenFd_ >= 0) {
+            ::close(listenFd_);
+            listenFd_ = -1;
+        }
+        if (epollFd_ >= 0) {
+            ::close(epollFd_);
+            epollFd_ = -1;
+        }
+        {
+            std::lock_guard<std::mutex> locker(eventMutex_);
+            if (eventFd_ >= 0) {
+                ::close(eventFd_);
+                eventFd_ = -1;
+            }
+        }
+        port_ = 0;
+    }
+
+    void HlsServer::notify() {
+        std::lock_guard<std::mutex> locker(eventMutex_);
+        if (eventFd_ >= 0) {
+            uint64_t one = 1;
+            ssize_t n = ::write(eventFd_, &one, sizeof(one));
+            (void)n;
+        }
+    }
+
+    HlsServerStats HlsServer::stats() const {
+        HlsServerStats s;
+        s.connections = connections_.load();
+        s.requests = requests_.load();
+        s.bytes = bytes_.load();
+        s.blocked = blocked_.load();
+        s.timeouts = timeouts_.load();
+        return s;
+    }
+
+    void HlsServer::serverThread() {
+        epoll_event events[MAX_EVENTS];
+
+        while (running_.load()) {
+            bool waiting = std::any_of(clients_.begin(), clients_.end(), [](const auto& client) {
+                return client.second->blocked;
+                });
+
+            // Blocked reloads need their deadlines checked even when nothing happens
+            int n = epoll_wait(epollFd_, events, MAX_EVENTS, waiting ? 100 : -1);
+            if (n < 0 && errno != EINTR) {
+                break;
+            }
+
+            bool changed = false;
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+
+                if (fd == listenFd_) {
+                    acceptClients();
+                    continue;
+                }
+
+                if (fd == eventFd_) {
+                    uint64_t count = 0;
+                    ssize_t r = ::read(eventFd_, &count, sizeof(count));
+                    (void)r;
+                    changed = true;
+                    continue;
+                }
+
+                auto it = clients_.find(fd);
+                if (it == clients_.end()) {
+                    continue;
+                }
+
+                Connection* c = it->second.get();
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    closeClient(c);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    readClient(c);
+                    if (clients_.find(fd) == clients_.end()) {
+                        continue;
+                    }
+                }
+                if (events[i].events & EPOLLOUT) {
+                    writeClient(c);
+                }
+            }
+
+            if (!waiting && !changed) {
+                continue;
+            }
+
+            int64_t now = av_gettime_relative();
+            std::vector<Connection*> ready;
+            for (auto& client : clients_) {
+                Connection* c = client.second.get();
+                if (c->blocked && serveBlocked(c, now >= c->deadlineUs)) {
+                    ready.push_back(c);
+                }
+            }
+
+            for (Connection* c : ready) {
+                writeClient(c);
+            }
+        }
+    }
+
+    void HlsServer::acceptClients() {
+        for (;;) {
+            int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+
+            // Playlists and small parts must not wait for Nagle
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            std::unique_ptr<Connection> c(new Connection());
+            c->fd = fd;
+
+            epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fd;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                ::close(fd);
+                continue;
+            }
+
+            clients_[fd] = std::move(c);
+            connections_.fetch_add(1);
+        }
+    }
+
+    void HlsServer::readClient(Connection* c) {
+        char buffer[4096];
+
+        for (;;) {
+            ssize_t n = ::recv(c->fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                c->input.append(buffer, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            closeClient(c);
+            return;
+        }
+
+        processRequests(c);
+    }
+
+    void HlsServer::processRequests(Connection* c) {
+        // One request at a time, pipelined ones wait for the previous response
+        while (!c->writing && !c->blocked) {
+            size_t end = c->input.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                if (c->input.size() > MAX_REQUEST_SIZE) {
+                    c->keepAlive = false;
+                    respond(c, 431, nullptr, false);
+                    break;
+                }
+                return;
+            }
+
+            std::string request = c->input.substr(0, end);
+            c->input.erase(0, end + 4);
+            requests_.fetch_add(1);
+            handleRequest(c, request);
+        }
+
+        if (c->writing) {
+            writeClient(c);
+        }
+    }
+
+    void HlsServer::handleRequest(Connection* c, const std::string& request) {
+        size_t lineEnd = request.find("\r\n");
+        std::string line = request.substr(0, lineEnd);
+
+        size_t s1 = line.find(' ');
+        size_t s2 = s1 == std::string::npos ? std::string::npos : line.find(' ', s1 + 1);
+        if (s2 == std::string::npos) {
+            c->keepAlive = false;
+            respond(c, 400, nullptr, false);
+            return;
+        }
+
+        std::string method = line.substr(0, s1);
+        std::string target = line.substr(s1 + 1, s2 - s1 - 1);
+        std::string version = line.substr(s2 + 1);
+
+        std::string headers = request.substr(lineEnd == std::string::npos ? request.size() : lineEnd);
+        std::transform(headers.begin(), headers.end(), headers.begin(), [](unsigned char ch) {
+            return static_cast<char>(std::tolower(ch));
+            });
+        c->keepAlive = version == "HTTP/1.1"
+            ? headers.find("\r\nconnection: close") == std::string::npos
+            : headers.find("\r\nconnection: keep-alive") != std::string::npos;
+
+        bool head = method == "HEAD";
+        if (method != "GET" && !head) {
+            respond(c, 405, nullptr, false);
+            return;
+        }
+
+        size_t question = target.find('?');
+        std::string path = target.substr(0, question);
+        std::string query = question == std::string::npos ? "" : target.substr(question + 1);
+
+        c->name = path.size() > 1 && path[0] == '/' ? path.substr(1) : path;
+        c->head = head;
+        c->msn = -1;
+        c->part = -1;
+
+        // Blocking playlist reload: hold the request until the playlist has the asked for segment/part
+        if (endsWith(c->name, ".m3u8")) {
+            c->msn = queryValue(query, "_HLS_msn");
+            c->part = c->msn >= 0 ? queryValue(query, "_HLS_part") : -1;
+        }
+
+        if (c->msn >= 0) {
+            MemoryFilePtr file = store_->get(c->name);
+            int64_t targetUs = file ? playlistPosition(*file).targetUs : 6000000;
+
+            c->blocked = true;
+            c->deadlineUs = av_gettime_relative() + 3 * targetUs;
+            blocked_.fetch_add(1);
+        }
+
+        if (c->blocked) {
+            serveBlocked(c, false);
+            return;
+        }
+
+        MemoryFilePtr file = store_->get(c->name);
+        respond(c, file ? 200 : 404, file, head);
+    }
+
+    bool HlsServer::serveBlocked(Connection* c, bool expired) {
+        MemoryFilePtr file = store_->get(c->name);
+
+        if (file) {
+            PlaylistPosition position = playlistPosition(*file);
+
+            // More than two segments ahead of the live edge can never be satisfied in time
+            if (c->msn > position.lastMsn + 2) {
+                c->blocked = false;
+                respond(c, 400, nullptr, false);
+                return true;
+            }
+
+            bool ready = c->part < 0
+                ? c->msn <= position.lastMsn
+                : c->msn <= position.lastMsn || (c->msn == position.lastMsn + 1 && c->part < position.parts);
+            if (ready) {
+                c->blocked = false;
+                respond(c, 200, file, c->head);
+                return true;
+            }
+        }
+
+        if (expired) {
+            c->blocked = false;
+            timeouts_.fetch_add(1);
+            respond(c, 503, nullptr, false);
+            return true;
+        }
+
+        return false;
+    }
+
+    void HlsServer::respond(Connection* c, int status, const MemoryFilePtr& file, bool head) {
+        size_t length = status == 200 && file ? file->data.size() : 0;
+
+        char header[512];
+        int n = std::snprintf(header, sizeof(header),
+                              "HTTP/1.1 %d %s\r\n"
+                              "Content-Type: %s\r\n"
+                              "Content-Length: %zu\r\n"
+                              "Cache-Control: %s\r\n"
+                              "Access-Control-Allow-Origin: *\r\n"
+                              "Connection: %s\r\n\r\n",
+                              status, statusText(status),
+                              status == 200 ? contentType(c->name) : "text/plain",
+                              length,
+                              status == 200 && !endsWith(c->name, ".m3u8") && !endsWith(c->name, ".mpd") ? "max-age=60" : "no-cache",
+                              c->keepAlive ? "keep-alive" : "close");
+
+        c->header.assign(header, static_cast<size_t>(std::max(0, std::min(n, static_cast<int>(sizeof(header) - 1)))));
+        c->body = status == 200 && !head ? file : nullptr;
+        c->sent = 0;
+        c->writing = true;
+    }
+
+    void HlsServer::writeClient(Connection* c) {
+        int fd = c->fd;
+
+        while (c->writing) {
+            size_t headerSize = c->header.size();
+            size_t bodySize = c->body ? c->body->data.size() : 0;
+
+            iovec iov[2];
+            int count = 0;
+            if (c->sent < headerSize) {
+                iov[count].iov_base = const_cast<char*>(c->header.data() + c->sent);
+                iov[count].iov_len = headerSize - c->sent;
+                ++count;
+            }
+            if (c->sent < headerSize + bodySize) {
+                size_t offset = c->sent > headerSize ? c->sent - headerSize : 0;
+                iov[count].iov_base = const_cast<uint8_t*>(c->body->data.data() + offset);
+                iov[count].iov_len = bodySize - offset;
+                ++count;
+            }
+
+            if (count == 0) {
+                // Response done
+                c->writing = false;
+                c->header.clear();
+                c->body.reset();
+
+                if (!c->keepAlive) {
+                    closeClient(c);
+                    return;
+                }
+
+                processRequests(c);
+                if (clients_.find(fd) == clients_.end()) {
+                    return;
+                }
+                break;
+            }
+
+            ssize_t n = ::writev(fd, iov, count);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                closeClient(c);
+                return;
+            }
+
+            c->sent += static_cast<size_t>(n);
+            bytes_.fetch_add(n);
+        }
+
+        updateEvents(c);
+    }
+
+    void HlsServer::updateEvents(Connection* c) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        if (c->writing) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = c->fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+
+    void HlsServer::closeClient(Connection* c) {
+        int fd = c->fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        clients_.erase(fd);
+        connections_.fetch_sub(1);
+    }
+
+#else
+
+    HlsServer::HlsServer()
+        : store_(nullptr)
+        , listenerId_(-1)
+        , listenFd_(-1)
+        , epollFd_(-1)
+        , port_(0)
+        , eventFd_(-1)
+        , running_(false)
+        , connections_(0)
+        , requests_(0)
+        , bytes_(0)
+        , blocked_(0)
+        , timeouts_(0) {
+    }
+
+    HlsServer::~HlsServer() {
+    }
+
+    int HlsServer::start(SegmentStore* store, int port, const std::string& address) {
+        // epoll based, Linux only
+        return AVERROR(ENOSYS);
+    }
+
+    void HlsServer::stop() {
+    }
+
+    void HlsServer::notify() {
+    }
+
+    HlsServerStats HlsServer::stats() const {
+        return HlsServerStats();
+    }
+
+#endif
+
+} // namespace media
\ No newline at end of file
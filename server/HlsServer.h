@@ -0,0 +1,100 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <memory>
+#include <unordered_map>
+#include "../ffmpeg/SegmentStore.h"
+
+namespace media {
+
+    struct HlsServerStats {
+        // Open client connections
+        int64_t connections = 0;
+        int64_t requests = 0;
+        int64_t bytes = 0;
+        // Playlist reloads held for _HLS_msn/_HLS_part, and those that ran out of time (503)
+        int64_t blocked = 0;
+        int64_t timeouts = 0;
+    };
+
+    class HlsServer {
+    public:
+        HlsServer(const HlsServer&) = delete;
+        HlsServer& operator=(const HlsServer&) = delete;
+        HlsServer(HlsServer&&) = delete;
+        HlsServer& operator=(HlsServer&&) = delete;
+
+        HlsServer();
+        ~HlsServer();
+
+        // Start server (store, port, address) >= 0, port 0 picks a free one (see port())
+        // Serves store files over HTTP/1.1 from one epoll thread; the request path without its
+        // leading '/' is the store name. Adds a store listener to wake blocked reloads, the store
+        // callback stays the caller's
+        int start(SegmentStore* store, int port = 8080, const std::string& address = "127.0.0.1");
+        // Stop server, closes every connection
+        void stop();
+
+        // Re-check blocked playlist reloads, safe from any thread
+        void notify();
+
+        int port()             const { return port_; }
+        bool isRunning()       const { return running_.load(); }
+        HlsServerStats stats() const;
+
+    private:
+        struct Connection {
+            int fd = -1;
+            std::string input;
+            // Pending response, the body is referenced from the store, not copied
+            std::string header;
+            MemoryFilePtr body;
+            size_t sent = 0;
+            bool keepAlive = true;
+            bool writing = false;
+            // Blocked playlist reload (LL-HLS)
+            bool blocked = false;
+            bool head = false;
+            std::string name;
+            int64_t msn = -1;
+            int64_t part = -1;
+            int64_t deadlineUs = 0;
+        };
+
+        void serverThread();
+        void acceptClients();
+        void readClient(Connection* c);
+        void writeClient(Connection* c);
+        void processRequests(Connection* c);
+        void handleRequest(Connection* c, const std::string& request);
+        bool serveBlocked(Connection* c, bool expired);
+        void respond(Connection* c, int status, const MemoryFilePtr& file, bool head);
+        void updateEvents(Connection* c);
+        void closeClient(Connection* c);
+
+    private:
+        SegmentStore* store_;
+        int listenerId_;
+        int listenFd_;
+        int epollFd_;
+        int port_;
+
+        // notify() may run on any thread while stop() closes the event fd
+        std::mutex eventMutex_;
+        int eventFd_;
+
+        std::thread thread_;
+        std::atomic<bool> running_;
+        std::unordered_map<int, std::unique_ptr<Connection>> clients_;
+
+        std::atomic<int64_t> connections_;
+        std::atomic<int64_t> requests_;
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> blocked_;
+        std::atomic<int64_t> timeouts_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,551 @@
+// media_encbench: encoder benchmark over Resolution_Preset x codecs x EncodeProfile
+//
+// Usage: media_encbench [-n frames] [-r preset]... [-c h264|hevc|vp9|av1|aac|opus|<encoder>]... [-t threads]
+// Prints one JSON document on stdout: fps, cpu time, output bitrate, (video) encode latency and
+// PSNR/SSIM of the decoded output against the synthetic source, plus the thread and slice count
+// each profile opened with. Every software encoder of a video codec is measured separately;
+// decoding and scoring run after the timed section.
+
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "../ffmpeg/FFmpeg.h"
+#include "../ffmpeg/MediaEncoder.h"
+
+namespace {
+
+    using namespace media;
+
+    struct CodecEntry {
+        const char* name;
+        AVCodecID id;
+        bool video;
+    };
+
+    static const CodecEntry Codecs[] = {
+        { "h264", AV_CODEC_ID_H264, true },
+        { "hevc", AV_CODEC_ID_HEVC, true },
+        { "vp9",  AV_CODEC_ID_VP9,  true },
+        { "av1",  AV_CODEC_ID_AV1,  true },
+        { "aac",  AV_CODEC_ID_AAC,  false },
+        { "opus", AV_CODEC_ID_OPUS, false },
+    };
+
+    static const struct {
+        const char* name;
+        EncodeProfile profile;
+    } Profiles[] = {
+        { "default",  EncodeProfile::Default },
+        { "realtime", EncodeProfile::RealtimeLowLatency },
+        { "live",     EncodeProfile::LiveBalanced },
+        { "offline",  EncodeProfile::OfflineThroughput },
+    };
+
+    struct Result {
+        std::string codec;
+        std::string encoder;
+        std::string profile;
+        std::string resolution;
+        int64_t frames = 0;
+        int64_t bytes = 0;
+        double wallSec = 0.0;
+        double cpuSec = 0.0;
+        double mediaSec = 0.0;
+        // Frames sent before the first packet came out, and mean send-to-packet time of the
+        // packets received while encoding (the flush at the end is not counted)
+        int64_t delayFrames = 0;
+        double latencyMs = 0.0;
+        int threads = 0;
+        int slices = 0;
+        // Luma quality of the decoded output, < 0 when not measured
+        double psnr = -1.0;
+        double ssim = -1.0;
+        int error = 0;
+    };
+
+    // Moving box over a diagonal gradient with fine texture, deterministic per index
+    void fillPattern(AVFrame* frame, int index) {
+        const int w = frame->width;
+        const int h = frame->height;
+        const int boxX = (index * 4) % std::max(1, w - 64);
+        const int boxY = (index * 2) % std::max(1, h - 64);
+
+        for (int y = 0; y < h; ++y) {
+            uint8_t* row = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < w; ++x) {
+                int v = (x + y + index * 3) & 0xbf;
+                v += ((x * 7) ^ (y * 13) ^ index) & 15;
+                if (x >= boxX && x < boxX + 64 && y >= boxY && y < boxY + 64) {
+                    v = 235;
+                }
+                row[x] = static_cast<uint8_t>(v);
+            }
+        }
+
+        for (int y = 0; y < h / 2; ++y) {
+            uint8_t* u = frame->data[1] + y * frame->linesize[1];
+            uint8_t* v = frame->data[2] + y * frame->linesize[2];
+            for (int x = 0; x < w / 2; ++x) {
+                u[x] = static_cast<uint8_t>(128 + ((x * 2 + index) & 63) - 32);
+                v[x] = static_cast<uint8_t>(128 + ((y * 2 + index) & 63) - 32);
+            }
+        }
+    }
+
+    double planeMse(const uint8_t* a, int strideA, const uint8_t* b, int strideB, int w, int h) {
+        double sum = 0.0;
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                double d = static_cast<double>(a[y * strideA + x]) - b[y * strideB + x];
+                sum += d * d;
+            }
+        }
+        return sum / (static_cast<double>(w) * h);
+    }
+
+    // Mean SSIM over non-overlapping 8x8 windows
+    double planeSsim(const uint8_t* a, int strideA, const uint8_t* b, int strideB, int w, int h) {
+        const double c1 = (0.01 * 255) * (0.01 * 255);
+        const double c2 = (0.03 * 255) * (0.03 * 255);
+        double total = 0.0;
+        int windows = 0;
+
+        for (int by = 0; by + 8 <= h; by += 8) {
+            for (int bx = 0; bx + 8 <= w; bx += 8) {
+                double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+                for (int y = by; y < by + 8; ++y) {
+                    for (int x = bx; x < bx + 8; ++x) {
+                        double pa = a[y * strideA + x];
+                        double pb = b[y * strideB + x];
+                        sa += pa;
+                        sb += pb;
+                        saa += pa * pa;
+                        sbb += pb * pb;
+                        sab += pa * pb;
+                    }
+                }
+
+                double ma = sa / 64, mb = sb / 64;
+                double va = saa / 64 - ma * ma;
+                double vb = sbb / 64 - mb * mb;
+                double cov = sab / 64 - ma * mb;
+                total += ((2 * ma * mb + c1) * (2 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+                ++windows;
+            }
+        }
+
+        return windows > 0 ? total / windows : 1.0;
+    }
+
+    double cpuSeconds() {
+        // Process CPU time, includes the encoder's worker threads
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+    }
+
+    // Software encoders registered for the codec that take yuv420p input, e.g. libaom-av1 and libsvtav1 for AV1
+    std::vector<std::string> videoEncoders(AVCodecID id) {
+        std::vector<std::string> names;
+        void* it = nullptr;
+        while (const AVCodec* codec = av_codec_iterate(&it)) {
+            if (codec->id != id || !av_codec_is_encoder(codec) || (codec->capabilities & AV_CODEC_CAP_HARDWARE)) {
+                continue;
+            }
+
+            bool yuv420p = !codec->pix_fmts;
+            for (const AVPixelFormat* fmt = codec->pix_fmts; fmt && *fmt != AV_PIX_FMT_NONE; ++fmt) {
+                yuv420p = yuv420p || *fmt == AV_PIX_FMT_YUV420P;
+            }
+
+            if (yuv420p) {
+                names.push_back(codec->name);
+            }
+        }
+        return names;
+    }
+
+    Result benchVideo(const CodecEntry& codec, const std::string& encoderName, EncodeProfile profile,
+                      const Resolution& res, int frames, unsigned int threads) {
+        Result r;
+        r.codec = codec.name;
+        r.encoder = encoderName;
+        r.resolution = res.name;
+
+        MediaEncoder encoder;
+        AVRational timebase = { 1, res.framerate };
+        AVRational framerate = { res.framerate, 1 };
+
+        encoder.setVideoEncoderName(encoderName);
+        r.error = encoder.openVideoEncoder(codec.id, res.width, res.height, res.bitrate, timebase, framerate,
+                                           AV_PIX_FMT_YUV420P, false, threads, nullptr, profile);
+        if (r.error < 0) {
+            return r;
+        }
+
+        AVCodecContext* enc = encoder.videoEncoder();
+        r.threads = enc->thread_count;
+        r.slices = enc->slices;
+
+        AVFrame* src = av_frame_alloc();
+        AVFrame* ref = av_frame_alloc();
+        AVFrame* out = av_frame_alloc();
+        AVPacket* pkt = av_packet_alloc();
+        if (!src || !ref || !out || !pkt) {
+            r.error = AVERROR(ENOMEM);
+        }
+
+        if (r.error == 0) {
+            src->format = ref->format = AV_PIX_FMT_YUV420P;
+            src->width = ref->width = res.width;
+            src->height = ref->height = res.height;
+            r.error = av_frame_get_buffer(src, 0);
+            if (r.error == 0) {
+                r.error = av_frame_get_buffer(ref, 0);
+            }
+        }
+
+        // Timed section only encodes, packets are kept by reference and scored afterwards
+        std::vector<AVPacket*> packets;
+        packets.reserve(static_cast<size_t>(frames) + 16);
+
+        auto consume = [&](AVPacket* p) {
+            r.bytes += p->size;
+            AVPacket* copy = av_packet_clone(p);
+            if (copy) {
+                packets.push_back(copy);
+            }
+            };
+
+        // Send time per frame index, packets carry the pts of the frame they encode
+        std::vector<int64_t> sendTime(static_cast<size_t>(frames), 0);
+        int64_t latencyUs = 0;
+        int64_t latencyPackets = 0;
+
+        double wall = static_cast<double>(av_gettime_relative());
+        double cpu = cpuSeconds();
+
+        for (int i = 0; i < frames && r.error == 0; ++i) {
+            r.error = av_frame_make_writable(src);
+            if (r.error < 0) {
+                break;
+            }
+
+            fillPattern(src, i);
+            src->pts = i;
+
+            sendTime[i] = av_gettime_relative();
+            r.error = encoder.sendVideoFrame(src);
+            ++r.frames;
+
+            while (r.error == 0 && encoder.receiveVideoPacket(pkt) >= 0) {
+                if (packets.empty()) {
+                    r.delayFrames = r.frames;
+                }
+                if (pkt->pts >= 0 && pkt->pts < frames) {
+                    latencyUs += av_gettime_relative() - sendTime[pkt->pts];
+                    ++latencyPackets;
+                }
+                consume(pkt);
+                av_packet_unref(pkt);
+            }
+        }
+
+        if (packets.empty()) {
+            // Nothing came out before the flush
+            r.delayFrames = r.frames;
+        }
+
+        if (r.error == 0) {
+            r.error = encoder.flushVideoEncoder(consume);
+        }
+
+        r.cpuSec = cpuSeconds() - cpu;
+        r.wallSec = (av_gettime_relative() - wall) / 1000000.0;
+        r.mediaSec = static_cast<double>(r.frames) / res.framerate;
+        r.latencyMs = latencyPackets > 0 ? latencyUs / 1000.0 / latencyPackets : 0.0;
+
+        // Decode the output again to score it against the source
+        AVCodecContext* dec = nullptr;
+        const AVCodec* decoder = avcodec_find_decoder(codec.id);
+        if (decoder && (dec = avcodec_alloc_context3(decoder))) {
+            AVCodecParameters* par = avcodec_parameters_alloc();
+            if (!par || avcodec_parameters_from_context(par, enc) < 0
+                || avcodec_parameters_to_context(dec, par) < 0) {
+                avcodec_free_context(&dec);
+            }
+            avcodec_parameters_free(&par);
+
+            if (dec) {
+                dec->pkt_timebase = timebase;
+                if (avcodec_open2(dec, decoder, nullptr) < 0) {
+                    avcodec_free_context(&dec);
+                }
+            }
+        }
+
+        double mse = 0.0;
+        double ssim = 0.0;
+        int64_t scored = 0;
+
+        auto score = [&]() {
+            while (dec && avcodec_receive_frame(dec, out) >= 0) {
+                if (out->pts != AV_NOPTS_VALUE && out->width == res.width && out->height == res.height) {
+                    fillPattern(ref, static_cast<int>(out->pts));
+                    mse += planeMse(ref->data[0], ref->linesize[0], out->data[0], out->linesize[0], res.width, res.height);
+                    ssim += planeSsim(ref->data[0], ref->linesize[0], out->data[0], out->linesize[0], res.width, res.height);
+                    ++scored;
+                }
+                av_frame_unref(out);
+            }
+            };
+
+        for (AVPacket* p : packets) {
+            if (dec && avcodec_send_packet(dec, p) >= 0) {
+                score();
+            }
+            av_packet_free(&p);
+        }
+
+        if (dec) {
+            avcodec_send_packet(dec, nullptr);
+            score();
+        }
+
+        if (scored > 0) {
+            double avg = mse / scored;
+            r.psnr = avg > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / avg) : 100.0;
+            r.ssim = ssim / scored;
+        }
+
+        av_packet_free(&pkt);
+        av_frame_free(&out);
+        av_frame_free(&ref);
+        av_frame_free(&src);
+        avcodec_free_context(&dec);
+        return r;
+    }
+
+    Result benchAudio(const CodecEntry& codec, int seconds, unsigned int threads) {
+        Result r;
+        r.codec = codec.name;
+        r.resolution = "audio";
+
+        const AVCodec* found = avcodec_find_encoder(codec.id);
+        if (!found) {
+            r.error = AVERROR_ENCODER_NOT_FOUND;
+            return r;
+        }
+
+        const int samplerate = 48000;
+        AVSampleFormat fmt = found->sample_fmts ? found->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+        AVChannelLayout layout = AV_CHANNEL_LAYOUT_STEREO;
+
+        MediaEncoder encoder;
+        r.error = encoder.openAudioEncoder(codec.id, 1024, samplerate, Resolution_Preset[4].bitrate,
+                                           { 1, samplerate }, layout, fmt, threads);
+        if (r.error < 0) {
+            return r;
+        }
+
+        AVCodecContext* enc = encoder.audioEncoder();
+        r.encoder = enc->codec->name;
+
+        const int framesize = enc->frame_size > 0 ? enc->frame_size : 1024;
+        const int64_t total = static_cast<int64_t>(seconds) * samplerate;
+
+        AVFrame* frame = av_frame_alloc();
+        AVPacket* pkt = av_packet_alloc();
+        if (!frame || !pkt) {
+            r.error = AVERROR(ENOMEM);
+        }
+
+        if (r.error == 0) {
+            frame->format = enc->sample_fmt;
+            frame->sample_rate = samplerate;
+            frame->nb_samples = framesize;
+            r.error = av_channel_layout_copy(&frame->ch_layout, &enc->ch_layout);
+            if (r.error == 0) {
+                r.error = av_frame_get_buffer(frame, 0);
+            }
+        }
+
+        MediaEncoder::PacketCallback consume = [&r](AVPacket* p) {
+            r.bytes += p->size;
+            };
+
+        double wall = static_cast<double>(av_gettime_relative());
+        double cpu = cpuSeconds();
+
+        for (int64_t pos = 0; pos < total && r.error == 0; pos += framesize) {
+            r.error = av_frame_make_writable(frame);
+            if (r.error < 0) {
+                break;
+            }
+
+            // 440 Hz tone in every channel
+            const int channels = frame->ch_layout.nb_channels;
+            const bool planar = av_sample_fmt_is_planar(enc->sample_fmt) != 0;
+            for (int i = 0; i < framesize; ++i) {
+                double s = 0.5 * std::sin(2.0 * 3.14159265358979323846 * 440.0 * (pos + i) / samplerate);
+                for (int c = 0; c < channels; ++c) {
+                    int plane = planar ? c : 0;
+                    int index = planar ? i : i * channels + c;
+                    switch (enc->sample_fmt) {
+                    case AV_SAMPLE_FMT_S16:
+                    case AV_SAMPLE_FMT_S16P:
+                        reinterpret_cast<int16_t*>(frame->extended_data[plane])[index] = static_cast<int16_t>(s * 32767);
+                        break;
+                    case AV_SAMPLE_FMT_FLT:
+                    case AV_SAMPLE_FMT_FLTP:
+                        reinterpret_cast<float*>(frame->extended_data[plane])[index] = static_cast<float>(s);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+
+            frame->pts = pos;
+            r.error = encoder.sendAudioFrame(frame);
+            while (r.error == 0 && encoder.receiveAudioPacket(pkt) >= 0) {
+                consume(pkt);
+                av_packet_unref(pkt);
+            }
+            ++r.frames;
+        }
+
+        if (r.error == 0) {
+            r.error = encoder.flushAudioEncoder(consume);
+        }
+
+        r.cpuSec = cpuSeconds() - cpu;
+        r.wallSec = (av_gettime_relative() - wall) / 1000000.0;
+        r.mediaSec = static_cast<double>(r.frames) * framesize / samplerate;
+
+        av_packet_free(&pkt);
+        av_frame_free(&frame);
+        return r;
+    }
+
+    void printResult(const Result& r, bool last) {
+        char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+        if (r.error < 0) {
+            av_strerror(r.error, err, sizeof(err));
+        }
+
+        std::printf("    {\"codec\": \"%s\", \"encoder\": \"%s\", \"profile\": \"%s\", \"resolution\": \"%s\", ",
+                    r.codec.c_str(), r.encoder.c_str(), r.profile.c_str(), r.resolution.c_str());
+        std::printf("\"frames\": %lld, \"fps\": %.2f, \"wall_sec\": %.3f, \"cpu_sec\": %.3f, \"bitrate\": %.0f, ",
+                    static_cast<long long>(r.frames),
+                    r.wallSec > 0.0 ? r.frames / r.wallSec : 0.0,
+                    r.wallSec, r.cpuSec,
+                    r.mediaSec > 0.0 ? r.bytes * 8.0 / r.mediaSec : 0.0);
+
+        if (r.resolution != "audio") {
+            std::printf("\"threads\": %d, \"slices\": %d, \"delay_frames\": %lld, \"latency_ms\": %.3f, ",
+                        r.threads, r.slices, static_cast<long long>(r.delayFrames), r.latencyMs);
+        }
+
+        if (r.psnr >= 0.0) {
+            std::printf("\"psnr_y\": %.3f, \"ssim_y\": %.5f, ", r.psnr, r.ssim);
+        }
+        else {
+            std::printf("\"psnr_y\": null, \"ssim_y\": null, ");
+        }
+
+        std::printf("\"error\": \"%s\"}%s\n", err, last ? "" : ",");
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int frames = 120;
+    unsigned int threads = 0;
+    std::vector<int> presets;
+    std::vector<std::string> codecs;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool known = arg == "-n" || arg == "-r" || arg == "-c" || arg == "-t";
+        if (!known || i + 1 >= argc) {
+            std::fprintf(stderr, "usage: %s [-n frames] [-r preset]... [-c codec|encoder]... [-t threads]\n", argv[0]);
+            return 1;
+        }
+
+        if (arg == "-n") {
+            frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "-r") {
+            presets.push_back(std::atoi(argv[++i]));
+        }
+        else if (arg == "-c") {
+            codecs.push_back(argv[++i]);
+        }
+        else if (arg == "-t") {
+            threads = static_cast<unsigned int>(std::max(0, std::atoi(argv[++i])));
+        }
+    }
+
+    if (presets.empty()) {
+        presets = { 0, 1, 2, 3 };
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    std::vector<Result> results;
+
+    for (const CodecEntry& codec : Codecs) {
+        if (!codec.video) {
+            bool selected = codecs.empty();
+            for (const std::string& name : codecs) {
+                selected = selected || name == codec.name;
+            }
+
+            if (!selected || !avcodec_find_encoder(codec.id)) {
+                continue;
+            }
+
+            Result r = benchAudio(codec, std::max(1, frames / 30), threads);
+            r.profile = "default";
+            results.push_back(r);
+            continue;
+        }
+
+        for (int preset : presets) {
+            if (preset < 0 || preset >= 4) {
+                continue;
+            }
+
+            for (const std::string& encoderName : videoEncoders(codec.id)) {
+                // -c selects a codec (all its encoders) or a single encoder by name
+                bool selected = codecs.empty();
+                for (const std::string& name : codecs) {
+                    selected = selected || name == codec.name || name == encoderName;
+                }
+
+                if (!selected) {
+                    continue;
+                }
+
+                for (const auto& profile : Profiles) {
+                    Result r = benchVideo(codec, encoderName, profile.profile, Resolution_Preset[preset], frames, threads);
+                    r.profile = profile.name;
+                    results.push_back(r);
+                    std::fprintf(stderr, "%s %s %s done\n", r.encoder.c_str(), r.resolution.c_str(), r.profile.c_str());
+                }
+            }
+        }
+    }
+
+    std::printf("{\n  \"frames\": %d,\n  \"threads\": %u,\n  \"results\": [\n", frames, threads);
+    for (size_t i = 0; i < results.size(); ++i) {
+        printResult(results[i], i + 1 == results.size());
+    }
+    std::printf("  ]\n}\n");
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,581 @@
+// media_loopback: end-to-end checks of the network outputs against a local ffmpeg/ffprobe
+//
+// Usage: media_loopback hls|adaptive|udp [-s seconds] [-b bitrate]
+//   hls:      SegmentStore + HlsServer origin, played back by ffprobe/ffmpeg over HTTP, plus one
+//             blocking playlist reload (_HLS_msn) that must be answered when the next segment lands
+//   adaptive: AdaptiveSender pushing MPEG-TS over TCP into a local sink that reads at -b bits/s
+//             (default 800k), it must step down and bring the send backlog back under its limit
+//   udp:      paced MPEG-TS over UDP (rate derived from the encoder) into a local ffprobe listener,
+//             which must read back nearly every packet that was sent
+// Linux only, needs ffmpeg and ffprobe in PATH. Prints one JSON document on stdout, exits 0 when every check passed.
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "../ffmpeg/FFmpeg.h"
+#include "../ffmpeg/MediaEncoder.h"
+#include "../ffmpeg/MediaOutput.h"
+#include "../ffmpeg/SegmentStore.h"
+#include "../ffmpeg/AdaptiveSender.h"
+#include "../ffmpeg/EncoderSwitcher.h"
+#include "../server/HlsServer.h"
+
+namespace {
+
+    using namespace media;
+
+    struct Check {
+        std::string name;
+        bool passed = false;
+        std::string detail;
+    };
+
+    using FrameCallback = std::function<int(AVFrame* frame)>;
+
+    std::string errorString(int error) {
+        char buffer[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+        av_strerror(error, buffer, sizeof(buffer));
+        return buffer;
+    }
+
+    // Moving gradient, enough motion to keep the encoder busy
+    void fillPattern(AVFrame* frame, int index) {
+        for (int y = 0; y < frame->height; ++y) {
+            uint8_t* row = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < frame->width; ++x) {
+                row[x] = static_cast<uint8_t>((x + y * 2 + index * 4) & 0xff);
+            }
+        }
+
+        for (int y = 0; y < frame->height / 2; ++y) {
+            std::memset(frame->data[1] + y * frame->linesize[1], 128 + (index & 31), frame->width / 2);
+            std::memset(frame->data[2] + y * frame->linesize[2], 128 - (index & 31), frame->width / 2);
+        }
+    }
+
+    // Feed synthetic frames (res, seconds, stop, callback) >= 0, paced at the frame rate like a live source
+    int runSource(const Resolution& res, double seconds, const std::atomic<bool>& stop, const FrameCallback& callback) {
+        AVFrame* frame = av_frame_alloc();
+        if (!frame) {
+            return AVERROR(ENOMEM);
+        }
+
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = res.width;
+        frame->height = res.height;
+
+        int ret = av_frame_get_buffer(frame, 0);
+        const int frames = static_cast<int>(seconds * res.framerate);
+        auto next = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < frames && ret >= 0 && !stop.load(); ++i) {
+            ret = av_frame_make_writable(frame);
+            if (ret < 0) {
+                break;
+            }
+
+            fillPattern(frame, i);
+            frame->pts = i;
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            ret = callback(frame);
+
+            next += std::chrono::microseconds(1000000 / res.framerate);
+            std::this_thread::sleep_until(next);
+        }
+
+        av_frame_free(&frame);
+        return ret < 0 ? ret : 0;
+    }
+
+    // Encode a frame into output (encoder, output, frame, nullptr = drain) >= 0
+    int encodeTo(MediaEncoder& encoder, MediaOutput& output, const AVFrame* frame) {
+        AVCodecContext* enc = encoder.videoEncoder();
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        int ret = encoder.sendVideoFrame(frame);
+        while (ret >= 0) {
+            ret = encoder.receiveVideoPacket(pkt);
+            if (ret < 0) {
+                break;
+            }
+
+            av_packet_rescale_ts(pkt, enc->time_base, output.videoStream()->time_base);
+            pkt->stream_index = output.videoIndex();
+            ret = output.writePacket(pkt);
+        }
+
+        av_packet_free(&pkt);
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+    }
+
+    // Run a shell command (command, output) >= exit status, stdout in output, -1 when it did not run
+    int runCommand(const std::string& command, std::string& output) {
+        output.clear();
+
+        FILE* pipe = popen(command.c_str(), "r");
+        if (!pipe) {
+            return -1;
+        }
+
+        char buffer[4096];
+        size_t n = 0;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            output.append(buffer, n);
+        }
+
+        int status = pclose(pipe);
+        return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    // Plain HTTP/1.0 GET on 127.0.0.1 (port, path, body) >= status code
+    int httpGet(int port, const std::string& path, std::string& body) {
+        body.clear();
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return AVERROR(errno);
+        }
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            int ret = AVERROR(errno);
+            ::close(fd);
+            return ret;
+        }
+
+        std::string request = "GET " + path + " HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n";
+        if (::send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size())) {
+            ::close(fd);
+            return AVERROR(EIO);
+        }
+
+        std::string response;
+        char buffer[4096];
+        ssize_t n = 0;
+        while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, static_cast<size_t>(n));
+        }
+        ::close(fd);
+
+        int status = 0;
+        if (std::sscanf(response.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+            return AVERROR_INVALIDDATA;
+        }
+
+        size_t header = response.find("\r\n\r\n");
+        if (header != std::string::npos) {
+            body = response.substr(header + 4);
+        }
+        return status;
+    }
+
+    // Listen on 127.0.0.1 (port, receiveBuffer) >= socket, port 0 picks a free one, written back
+    int listenLoopback(int& port, int receiveBuffer = 0) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return AVERROR(errno);
+        }
+
+        // Inherited by the accepted socket, a small window makes the sender feel the rate limit sooner
+        if (receiveBuffer > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+        }
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t len = sizeof(addr);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 1) < 0
+            || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            int ret = AVERROR(errno);
+            ::close(fd);
+            return ret;
+        }
+
+        port = ntohs(addr.sin_port);
+        return fd;
+    }
+
+    // Free UDP port on 127.0.0.1 >= port, released again for the listener to bind
+    int freeUdpPort() {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            return AVERROR(errno);
+        }
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t len = sizeof(addr);
+        int ret = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0 ? AVERROR(errno) : ntohs(addr.sin_port);
+        ::close(fd);
+        return ret;
+    }
+
+    // Accept one connection and read it at no more than bitrate until the peer closes
+    void rateLimitedSink(int listenFd, int64_t bitrate, std::atomic<int64_t>& received) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+
+        // 20 ms worth of data per read
+        std::vector<char> buffer(static_cast<size_t>(std::max<int64_t>(188, bitrate / 8 / 50)));
+        auto start = std::chrono::steady_clock::now();
+
+        for (;;) {
+            ssize_t n = ::recv(fd, buffer.data(), buffer.size(), 0);
+            if (n <= 0) {
+                break;
+            }
+
+            int64_t total = received.fetch_add(n) + n;
+            std::this_thread::sleep_until(start + std::chrono::microseconds(total * 8000000 / bitrate));
+        }
+
+        ::close(fd);
+    }
+
+    // Media sequence number of the last segment in a playlist, -1 when it lists none
+    int64_t lastSequence(const std::string& playlist) {
+        int64_t sequence = 0;
+        const char* tag = "#EXT-X-MEDIA-SEQUENCE:";
+        size_t pos = playlist.find(tag);
+        if (pos != std::string::npos) {
+            sequence = std::strtoll(playlist.c_str() + pos + std::strlen(tag), nullptr, 10);
+        }
+
+        int64_t segments = 0;
+        for (pos = playlist.find("#EXTINF"); pos != std::string::npos; pos = playlist.find("#EXTINF", pos + 1)) {
+            ++segments;
+        }
+        return segments > 0 ? sequence + segments - 1 : -1;
+    }
+
+    std::vector<Check> checkHls(double seconds) {
+        std::vector<Check> checks;
+        const Resolution& res = Resolution_Preset[0];
+
+        MediaEncoder encoder;
+        int ret = encoder.openVideoEncoder(AV_CODEC_ID_H264, res.width, res.height, res.bitrate,
+                                           { 1, res.framerate }, { res.framerate, 1 }, AV_PIX_FMT_YUV420P,
+                                           false, 0, nullptr, EncodeProfile::RealtimeLowLatency);
+
+        SegmentStore store;
+        store.setMaxFiles(8);
+
+        MediaOutput output;
+        if (ret >= 0) {
+            AVDictionary* opt = nullptr;
+            av_dict_set(&opt, "hls_time", "1", 0);
+            av_dict_set(&opt, "hls_list_size", "6", 0);
+            ret = output.writeStore(&store, "live.m3u8", "hls", encoder.videoEncoder(), nullptr, opt);
+            av_dict_free(&opt);
+        }
+
+        HlsServer server;
+        if (ret >= 0) {
+            ret = server.start(&store, 0);
+        }
+
+        Check setup;
+        setup.name = "hls.setup";
+        setup.passed = ret >= 0;
+        setup.detail = setup.passed ? "" : errorString(ret);
+        checks.push_back(setup);
+        if (!setup.passed) {
+            return checks;
+        }
+
+        std::atomic<bool> stop(false);
+        std::thread source([&]() {
+            runSource(res, seconds, stop, [&](AVFrame* frame) {
+                return encodeTo(encoder, output, frame);
+                });
+            encodeTo(encoder, output, nullptr);
+            });
+
+        // Wait for a playlist with three segments before the players connect
+        const std::string url = "http://127.0.0.1:" + std::to_string(server.port()) + "/live.m3u8";
+        std::string playlist;
+        for (int i = 0; i < 100 && lastSequence(playlist) < 2; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            httpGet(server.port(), "/live.m3u8", playlist);
+        }
+
+        std::string out;
+        Check probe;
+        probe.name = "hls.ffprobe";
+        int status = runCommand("ffprobe -v error -select_streams v:0 -show_entries stream=codec_name,width,height "
+                                "-of csv=p=0 " + url, out);
+        probe.passed = status == 0 && out.find("h264," + std::to_string(res.width) + "," + std::to_string(res.height)) != std::string::npos;
+        probe.detail = out.substr(0, out.find('\n'));
+        checks.push_back(probe);
+
+        Check play;
+        play.name = "hls.ffmpeg";
+        status = runCommand("ffmpeg -nostdin -v error -i " + url + " -t 2 -f null - 2>&1", out);
+        play.passed = status == 0;
+        play.detail = out.substr(0, out.find('\n'));
+        checks.push_back(play);
+
+        // A reload for the next segment is held by the server until the muxer publishes it
+        Check reload;
+        reload.name = "hls.blocking_reload";
+        httpGet(server.port(), "/live.m3u8", playlist);
+        int64_t next = lastSequence(playlist) + 1;
+        int64_t start = av_gettime_relative();
+        status = httpGet(server.port(), "/live.m3u8?_HLS_msn=" + std::to_string(next), playlist);
+        int64_t waitedMs = (av_gettime_relative() - start) / 1000;
+        reload.passed = next > 0 && status == 200 && lastSequence(playlist) >= next;
+        reload.detail = "status " + std::to_string(status) + ", waited " + std::to_string(waitedMs) + " ms";
+        checks.push_back(reload);
+
+        stop.store(true);
+        source.join();
+        server.stop();
+        output.reset();
+        return checks;
+    }
+
+    std::vector<Check> checkAdaptive(double seconds, int64_t linkBitrate) {
+        std::vector<Check> checks;
+        const int preset = 2;
+        const Resolution& res = Resolution_Preset[preset];
+
+        int port = 0;
+        int listenFd = listenLoopback(port, 16 * 1024);
+
+        // LiveBalanced has B-frames, so the ladder starts with the drop level
+        EncoderSwitcher switcher;
+        int ret = listenFd < 0 ? listenFd
+            : switcher.open(AV_CODEC_ID_H264, res.width, res.height, res.bitrate, { 1, res.framerate },
+                            { res.framerate, 1 }, AV_PIX_FMT_YUV420P, false, 0, EncodeProfile::LiveBalanced);
+
+        std::atomic<int64_t> received(0);
+        std::thread sink;
+        if (ret >= 0) {
+            sink = std::thread(rateLimitedSink, listenFd, linkBitrate, std::ref(received));
+        }
+
+        MediaOutput output;
+        if (ret >= 0) {
+            PacingOptions pacing;
+            pacing.flushPackets = false;
+            ret = output.writeNetwork("tcp://127.0.0.1:" + std::to_string(port), "mpegts",
+                                      switcher.encoder()->videoEncoder(), nullptr, pacing);
+        }
+        if (ret >= 0) {
+            output.setIOTimeout(5000000);
+            ret = output.startAsync(128);
+        }
+
+        AdaptivePolicy policy;
+        policy.upWindows = 1000;
+        AdaptiveSender sender;
+        if (ret >= 0) {
+            ret = sender.open(&switcher, &output, preset, policy);
+        }
+
+        Check setup;
+        setup.name = "adaptive.setup";
+        setup.passed = ret >= 0;
+        setup.detail = setup.passed ? "" : errorString(ret);
+        checks.push_back(setup);
+
+        LinkStats last;
+        int64_t sentUs = 0;
+        if (ret >= 0) {
+            std::atomic<bool> stop(false);
+            int64_t start = av_gettime_relative();
+            ret = runSource(res, seconds, stop, [&](AVFrame* frame) {
+                return sender.sendVideoFrame(frame);
+                });
+            sentUs = av_gettime_relative() - start;
+            last = sender.linkStats();
+            sender.flush();
+        }
+
+        if (setup.passed) {
+            Check down;
+            down.name = "adaptive.downgrade";
+            down.passed = ret >= 0 && last.downgrades > 0;
+            down.detail = "level " + std::to_string(last.level) + ", preset " + std::to_string(last.preset)
+                + ", bitrate " + std::to_string(last.bitrate) + ", dropped " + std::to_string(last.droppedPackets)
+                + (ret < 0 ? ", " + errorString(ret) : "");
+            checks.push_back(down);
+
+            // Once adapted the queue must not keep growing behind the link
+            Check backlog;
+            backlog.name = "adaptive.backlog";
+            backlog.passed = ret >= 0 && last.backlogUs <= 2 * policy.maxBacklogUs;
+            backlog.detail = "backlog " + std::to_string(last.backlogUs / 1000) + " ms, throughput "
+                + std::to_string(static_cast<int64_t>(last.throughputBps)) + " bps, link "
+                + std::to_string(linkBitrate) + " bps, sink average "
+                + std::to_string(sentUs > 0 ? received.load() * 8000000 / sentUs : 0) + " bps";
+            checks.push_back(backlog);
+        }
+
+        sender.reset();
+        output.reset();
+        if (listenFd >= 0) {
+            // Wakes a sink still waiting in accept when the output never connected
+            shutdown(listenFd, SHUT_RDWR);
+        }
+        if (sink.joinable()) {
+            sink.join();
+        }
+        if (listenFd >= 0) {
+            ::close(listenFd);
+        }
+        return checks;
+    }
+
+    std::vector<Check> checkUdp(double seconds) {
+        std::vector<Check> checks;
+        const Resolution& res = Resolution_Preset[1];
+
+        MediaEncoder encoder;
+        int ret = encoder.openVideoEncoder(AV_CODEC_ID_H264, res.width, res.height, res.bitrate,
+                                           { 1, res.framerate }, { res.framerate, 1 }, AV_PIX_FMT_YUV420P,
+                                           false, 0, nullptr, EncodeProfile::RealtimeLowLatency);
+        int port = ret < 0 ? ret : freeUdpPort();
+        if (port < 0) {
+            ret = port;
+        }
+
+        // The listener has to be bound before the first datagram, UDP does not wait for it;
+        // the read timeout ends it once the sender has gone quiet
+        std::string out;
+        int status = -1;
+        std::thread listener;
+        if (ret >= 0) {
+            const std::string url = "\"udp://127.0.0.1:" + std::to_string(port) + "?timeout=3000000\"";
+            listener = std::thread([&, url]() {
+                status = runCommand("ffprobe -v error -select_streams v:0 -count_packets "
+                                    "-show_entries stream=codec_name,nb_read_packets -of csv=p=0 " + url, out);
+                });
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+
+        MediaOutput output;
+        if (ret >= 0) {
+            // Default options: 1316 byte datagrams paced at the encoder rate plus headroom
+            ret = output.writeNetwork("udp://127.0.0.1:" + std::to_string(port), "mpegts",
+                                      encoder.videoEncoder(), nullptr, PacingOptions());
+        }
+
+        Check setup;
+        setup.name = "udp.setup";
+        setup.passed = ret >= 0;
+        setup.detail = setup.passed ? "" : errorString(ret);
+        checks.push_back(setup);
+
+        int64_t sent = 0;
+        if (ret >= 0) {
+            std::atomic<bool> stop(false);
+            ret = runSource(res, seconds, stop, [&](AVFrame* frame) {
+                ++sent;
+                return encodeTo(encoder, output, frame);
+                });
+            if (ret >= 0) {
+                ret = encodeTo(encoder, output, nullptr);
+            }
+        }
+        output.reset();
+
+        if (listener.joinable()) {
+            listener.join();
+        }
+
+        if (setup.passed) {
+            // Loopback does not lose datagrams unless they arrive in bursts the socket buffer cannot hold
+            Check received;
+            received.name = "udp.ffprobe";
+            size_t comma = out.find(',');
+            int64_t packets = comma == std::string::npos ? 0 : std::strtoll(out.c_str() + comma + 1, nullptr, 10);
+            received.passed = ret >= 0 && out.compare(0, 5, "h264,") == 0 && packets * 100 >= sent * 95;
+            received.detail = "read " + std::to_string(packets) + " of " + std::to_string(sent) + " packets, ffprobe status "
+                + std::to_string(status) + (ret < 0 ? ", " + errorString(ret) : "");
+            checks.push_back(received);
+        }
+        return checks;
+    }
+
+    void printCheck(const Check& c, bool last) {
+        std::string detail;
+        for (char ch : c.detail) {
+            if (ch == '"' || ch == '\\') {
+                detail += '\\';
+            }
+            detail += ch >= 0x20 ? ch : ' ';
+        }
+
+        std::printf("    {\"check\": \"%s\", \"passed\": %s, \"detail\": \"%s\"}%s\n",
+                    c.name.c_str(), c.passed ? "true" : "false", detail.c_str(), last ? "" : ",");
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double seconds = 20.0;
+    int64_t bitrate = 800000;
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    bool usage = mode != "hls" && mode != "adaptive" && mode != "udp";
+    for (int i = 2; i < argc && !usage; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-s" && i + 1 < argc) {
+            seconds = std::max(5.0, std::atof(argv[++i]));
+        }
+        else if (arg == "-b" && i + 1 < argc) {
+            bitrate = std::max<int64_t>(64000, std::atoll(argv[++i]));
+        }
+        else {
+            usage = true;
+        }
+    }
+
+    if (usage) {
+        std::fprintf(stderr, "usage: %s hls|adaptive|udp [-s seconds] [-b bitrate]\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    std::vector<Check> checks = mode == "hls" ? checkHls(seconds)
+        : mode == "udp" ? checkUdp(seconds) : checkAdaptive(seconds, bitrate);
+
+    bool passed = true;
+    std::printf("{\n  \"mode\": \"%s\",\n  \"checks\": [\n", mode.c_str());
+    for (size_t i = 0; i < checks.size(); ++i) {
+        printCheck(checks[i], i + 1 == checks.size());
+        passed = passed && checks[i].passed;
+    }
+    std::printf("  ]\n}\n");
+
+    return passed ? 0 : 2;
+}
\ No newline at end of file
@@ -0,0 +1,994 @@
+// media_pipebench: measurements of the decode and mux pipeline building blocks
+//
+// Usage: media_pipebench decode|pool|parallel|ladder|remux|sink [-i input] [-n frames] [-r preset] [-t threads] [-m MB]
+//   decode: per DecodeProfile, packets fed at the stream frame rate like a live source; latency from
+//           sending a packet to receiving its frame (first frame, mean, p95, max) and CPU time
+//   pool:   full speed decode with the libavcodec allocator, a FramePool and a huge page FramePool;
+//           page faults (getrusage), resident set after decoding (Linux) and fps
+//   parallel: ParallelDecoder at 1, 2, 4 and all-core workers, ordered and unordered, against one
+//             frame-threaded decoder over the whole file; fps, CPU time and speedup
+//   ladder:   LadderEncoder (one decode, every preset up to the source height) against one
+//             decode + scale + encode pipeline per preset running concurrently; wall and CPU time
+//   remux:    Remuxer stream copy of the whole file against a video-only decode + H.264 encode at the source
+//             size and bitrate, both into MP4 in the temp directory; wall and CPU time and speedup
+//   sink:     the video packets muxed to MP4 over and over until -m MB (default 512) through the default
+//             avio file protocol, FileSink and FileSink with O_DIRECT; MB/s and CPU time, close included
+// Without -i a synthetic H.264 MP4 (-n frames at Resolution_Preset -r, 1 s GOP, no B-frames) is
+// encoded to the temp directory first. Prints one JSON document on stdout.
+
+#include <map>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "../ffmpeg/FFmpeg.h"
+#include "../ffmpeg/Remuxer.h"
+#include "../ffmpeg/FileSink.h"
+#include "../ffmpeg/MediaInput.h"
+#include "../ffmpeg/MediaOutput.h"
+#include "../ffmpeg/MediaDecoder.h"
+#include "../ffmpeg/MediaEncoder.h"
+#include "../ffmpeg/LadderEncoder.h"
+#include "../ffmpeg/MediaResampler.h"
+#include "../ffmpeg/ParallelDecoder.h"
+
+namespace {
+
+    using namespace media;
+
+    struct Options {
+        std::string input;
+        int frames = 300;
+        int preset = 2;
+        unsigned int threads = 0;
+        int64_t megabytes = 512;
+    };
+
+    // One JSON object per result, fields in output order
+    struct Result {
+        std::string name;
+        std::vector<std::pair<std::string, double>> values;
+        int error = 0;
+    };
+
+    static const struct {
+        const char* name;
+        DecodeProfile profile;
+    } DecodeProfiles[] = {
+        { "default",     DecodeProfile::Default },
+        { "lowlatency",  DecodeProfile::LowLatency },
+        { "throughput",  DecodeProfile::Throughput },
+    };
+
+    std::string errorString(int error) {
+        char buffer[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+        av_strerror(error, buffer, sizeof(buffer));
+        return buffer;
+    }
+
+    double cpuSeconds() {
+        // Process CPU time, includes the codec worker threads
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+    }
+
+    // File in the temp directory (name)
+    std::string tempPath(const char* name) {
+        const char* tmp = std::getenv("TMPDIR");
+        return std::string(tmp && *tmp ? tmp : "/tmp") + "/" + name;
+    }
+
+    // Resident set size in bytes, 0 where /proc is not available
+    int64_t residentBytes() {
+        long pages = 0;
+        FILE* file = std::fopen("/proc/self/statm", "r");
+        if (file) {
+            if (std::fscanf(file, "%*s %ld", &pages) != 1) {
+                pages = 0;
+            }
+            std::fclose(file);
+        }
+        return static_cast<int64_t>(pages) * sysconf(_SC_PAGESIZE);
+    }
+
+    // Moving gradient with fine texture, deterministic per index
+    void fillPattern(AVFrame* frame, int index) {
+        for (int y = 0; y < frame->height; ++y) {
+            uint8_t* row = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < frame->width; ++x) {
+                row[x] = static_cast<uint8_t>(((x + y * 2 + index * 4) & 0xbf) + (((x * 7) ^ (y * 13) ^ index) & 15));
+            }
+        }
+
+        for (int y = 0; y < frame->height / 2; ++y) {
+            std::memset(frame->data[1] + y * frame->linesize[1], 128 + (index & 31), frame->width / 2);
+            std::memset(frame->data[2] + y * frame->linesize[2], 128 - (index & 31), frame->width / 2);
+        }
+    }
+
+    // Encode a synthetic clip (path, res, frames) >= 0
+    int makeClip(const std::string& path, const Resolution& res, int frames) {
+        MediaEncoder encoder;
+        int ret = encoder.openVideoEncoder(AV_CODEC_ID_H264, res.width, res.height, res.bitrate,
+                                           { 1, res.framerate }, { res.framerate, 1 }, AV_PIX_FMT_YUV420P);
+
+        MediaOutput output;
+        if (ret >= 0) {
+            ret = output.writeFile(path, "mp4", encoder.videoEncoder());
+        }
+
+        AVFrame* frame = av_frame_alloc();
+        AVPacket* pkt = av_packet_alloc();
+        if (ret >= 0 && (!frame || !pkt)) {
+            ret = AVERROR(ENOMEM);
+        }
+
+        if (ret >= 0) {
+            frame->format = AV_PIX_FMT_YUV420P;
+            frame->width = res.width;
+            frame->height = res.height;
+            ret = av_frame_get_buffer(frame, 0);
+        }
+
+        AVCodecContext* enc = encoder.videoEncoder();
+        MediaEncoder::PacketCallback write = [&](AVPacket* p) {
+            av_packet_rescale_ts(p, enc->time_base, output.videoStream()->time_base);
+            p->stream_index = output.videoIndex();
+            int error = output.writePacket(p);
+            ret = ret < 0 ? ret : error;
+            };
+
+        for (int i = 0; i < frames && ret >= 0; ++i) {
+            ret = av_frame_make_writable(frame);
+            if (ret < 0) {
+                break;
+            }
+
+            fillPattern(frame, i);
+            frame->pts = i;
+            ret = encoder.sendVideoFrame(frame);
+            while (ret >= 0 && encoder.receiveVideoPacket(pkt) >= 0) {
+                write(pkt);
+                av_packet_unref(pkt);
+            }
+        }
+
+        if (ret >= 0) {
+            int error = encoder.flushVideoEncoder(write);
+            ret = ret < 0 ? ret : error;
+        }
+
+        output.reset();
+        av_packet_free(&pkt);
+        av_frame_free(&frame);
+        return ret;
+    }
+
+    // Read every video packet of an open input (input, packets) >= 0, caller frees them
+    int readVideoPackets(MediaInput& input, std::vector<AVPacket*>& packets) {
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        int ret = 0;
+        while ((ret = av_read_frame(input.inputContext(), pkt)) >= 0) {
+            if (pkt->stream_index == input.videoParams().index) {
+                packets.push_back(av_packet_clone(pkt));
+            }
+            av_packet_unref(pkt);
+        }
+
+        av_packet_free(&pkt);
+        return ret == AVERROR_EOF ? 0 : ret;
+    }
+
+    void freePackets(std::vector<AVPacket*>& packets) {
+        for (AVPacket*& p : packets) {
+            av_packet_free(&p);
+        }
+        packets.clear();
+    }
+
+    double percentile(std::vector<double> values, double p) {
+        if (values.empty()) {
+            return 0.0;
+        }
+
+        std::sort(values.begin(), values.end());
+        size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+        return values[std::min(index, values.size() - 1)];
+    }
+
+    Result benchDecodeLatency(MediaInput& input, const std::vector<AVPacket*>& packets, DecodeProfile profile,
+                              unsigned int threads) {
+        Result r;
+
+        MediaDecoder decoder;
+        r.error = decoder.openVideoDecoder(input.inputContext(), false, threads, profile);
+        AVFrame* frame = av_frame_alloc();
+        if (r.error >= 0 && !frame) {
+            r.error = AVERROR(ENOMEM);
+        }
+        if (r.error < 0) {
+            av_frame_free(&frame);
+            return r;
+        }
+
+        AVRational framerate = input.videoParams().framerate;
+        const int64_t intervalUs = framerate.num > 0 ? av_rescale(1000000, framerate.den, framerate.num) : 40000;
+
+        // Send time per pts, a frame's latency is measured against the packet that carried it
+        std::map<int64_t, int64_t> sent;
+        std::vector<double> latencies;
+        latencies.reserve(packets.size());
+
+        auto receive = [&]() {
+            while (decoder.receiveVideoFrame(frame) >= 0) {
+                int64_t now = av_gettime_relative();
+                auto it = sent.find(frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp);
+                if (it != sent.end()) {
+                    latencies.push_back((now - it->second) / 1000.0);
+                    sent.erase(it);
+                }
+                av_frame_unref(frame);
+            }
+            };
+
+        double cpu = cpuSeconds();
+        auto next = std::chrono::steady_clock::now();
+
+        for (const AVPacket* p : packets) {
+            sent[p->pts] = av_gettime_relative();
+            r.error = decoder.sendVideoPacket(p);
+            if (r.error < 0) {
+                break;
+            }
+            receive();
+
+            next += std::chrono::microseconds(intervalUs);
+            std::this_thread::sleep_until(next);
+        }
+
+        if (r.error >= 0) {
+            decoder.sendVideoPacket(nullptr);
+            receive();
+        }
+
+        double cpuSec = cpuSeconds() - cpu;
+        double mean = 0.0;
+        for (double l : latencies) {
+            mean += l;
+        }
+        mean = latencies.empty() ? 0.0 : mean / latencies.size();
+
+        r.values = {
+            { "threads", static_cast<double>(decoder.videoDecoder()->thread_count) },
+            { "frames", static_cast<double>(latencies.size()) },
+            { "first_frame_ms", latencies.empty() ? 0.0 : latencies.front() },
+            { "mean_ms", mean },
+            { "p95_ms", percentile(latencies, 0.95) },
+            { "max_ms", percentile(latencies, 1.0) },
+            { "cpu_sec", cpuSec },
+        };
+
+        av_frame_free(&frame);
+        return r;
+    }
+
+    Result benchDecodePool(MediaInput& input, const std::vector<AVPacket*>& packets,
+                           std::shared_ptr<FramePool> pool, unsigned int threads) {
+        Result r;
+
+        MediaDecoder decoder;
+        decoder.setFramePool(pool);
+        r.error = decoder.openVideoDecoder(input.inputContext(), false, threads, DecodeProfile::Throughput);
+        AVFrame* frame = av_frame_alloc();
+        if (r.error >= 0 && !frame) {
+            r.error = AVERROR(ENOMEM);
+        }
+        if (r.error < 0) {
+            av_frame_free(&frame);
+            return r;
+        }
+
+        int64_t frames = 0;
+        auto receive = [&]() {
+            while (decoder.receiveVideoFrame(frame) >= 0) {
+                ++frames;
+                av_frame_unref(frame);
+            }
+            };
+
+        rusage before = {};
+        getrusage(RUSAGE_SELF, &before);
+        int64_t start = av_gettime_relative();
+
+        for (const AVPacket* p : packets) {
+            r.error = decoder.sendVideoPacket(p);
+            if (r.error < 0) {
+                break;
+            }
+            receive();
+        }
+
+        if (r.error >= 0) {
+            decoder.sendVideoPacket(nullptr);
+            receive();
+        }
+
+        double wallSec = (av_gettime_relative() - start) / 1000000.0;
+        rusage after = {};
+        getrusage(RUSAGE_SELF, &after);
+
+        // Measured while the decoder and its buffers are still alive
+        const int64_t minor = after.ru_minflt - before.ru_minflt;
+        FramePoolStats stats = pool ? pool->stats() : FramePoolStats();
+        r.values = {
+            { "frames", static_cast<double>(frames) },
+            { "fps", wallSec > 0.0 ? frames / wallSec : 0.0 },
+            { "minor_faults", static_cast<double>(minor) },
+            { "minor_faults_per_frame", frames > 0 ? static_cast<double>(minor) / frames : 0.0 },
+            { "major_faults", static_cast<double>(after.ru_majflt - before.ru_majflt) },
+            { "rss_mb", residentBytes() / 1048576.0 },
+            { "pool_slabs", static_cast<double>(stats.slabs) },
+            { "pool_huge_slabs", static_cast<double>(stats.hugeSlabs) },
+            { "pool_mb", stats.bytes / 1048576.0 },
+            { "pool_fallbacks", static_cast<double>(stats.fallbacks) },
+        };
+
+        av_frame_free(&frame);
+        return r;
+    }
+
+    // Open the input and read its video packets (o, input, packets) >= 0
+    int loadInput(const Options& o, MediaInput& input, std::vector<AVPacket*>& packets) {
+        int ret = input.openFileStream(o.input);
+        return ret < 0 ? ret : readVideoPackets(input, packets);
+    }
+
+    std::vector<Result> runDecode(const Options& o) {
+        std::vector<Result> results;
+
+        MediaInput input;
+        std::vector<AVPacket*> packets;
+        int ret = loadInput(o, input, packets);
+
+        for (const auto& p : DecodeProfiles) {
+            Result r;
+            if (ret >= 0) {
+                r = benchDecodeLatency(input, packets, p.profile, o.threads);
+            }
+            else {
+                r.error = ret;
+            }
+            r.name = p.name;
+            results.push_back(r);
+            std::fprintf(stderr, "decode %s done\n", p.name);
+        }
+
+        freePackets(packets);
+        return results;
+    }
+
+    std::vector<Result> runPool(const Options& o) {
+        std::vector<Result> results;
+
+        MediaInput input;
+        std::vector<AVPacket*> packets;
+        int ret = loadInput(o, input, packets);
+
+        // The allocator runs first so the pools cannot reuse pages it already faulted in
+        static const struct {
+            const char* name;
+            bool pooled;
+            bool hugePages;
+        } Allocators[] = {
+            { "libavcodec",       false, false },
+            { "framepool",        true,  false },
+            { "framepool_huge",   true,  true },
+        };
+
+        for (const auto& a : Allocators) {
+            Result r;
+            if (ret >= 0) {
+                std::shared_ptr<FramePool> pool = a.pooled ? std::make_shared<FramePool>(a.hugePages) : nullptr;
+                r = benchDecodePool(input, packets, pool, o.threads);
+            }
+            else {
+                r.error = ret;
+            }
+            r.name = a.name;
+            results.push_back(r);
+            std::fprintf(stderr, "pool %s done\n", a.name);
+        }
+
+        freePackets(packets);
+        return results;
+    }
+
+    std::vector<Result> runParallel(const Options& o) {
+        std::vector<Result> results;
+
+        // Baseline: a single decoder over the whole file, what ParallelDecoder replaces
+        Result base;
+        base.name = "single";
+        int64_t frames = 0;
+        double cpu = cpuSeconds();
+        int64_t start = av_gettime_relative();
+        base.error = ParallelDecoder::decodeSegment(o.input, ParallelDecoder::Segment(), o.threads, [&frames](AVFrame*) {
+            ++frames;
+            return 0;
+            });
+        double baseSec = (av_gettime_relative() - start) / 1000000.0;
+        base.values = {
+            { "frames", static_cast<double>(frames) },
+            { "fps", baseSec > 0.0 ? frames / baseSec : 0.0 },
+            { "cpu_sec", cpuSeconds() - cpu },
+            { "speedup", 1.0 },
+        };
+        results.push_back(base);
+        std::fprintf(stderr, "parallel single done\n");
+
+        const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned int> workers = { 1u, 2u, 4u, cores };
+        std::sort(workers.begin(), workers.end());
+        workers.erase(std::unique(workers.begin(), workers.end()), workers.end());
+
+        for (bool ordered : { true, false }) {
+            for (unsigned int w : workers) {
+                Result r;
+                r.name = std::string(ordered ? "ordered_" : "unordered_") + std::to_string(w);
+
+                ParallelDecoder decoder;
+                frames = 0;
+                cpu = cpuSeconds();
+                start = av_gettime_relative();
+                r.error = decoder.decodeFile(o.input, [&frames](AVFrame*, int) {
+                    ++frames;
+                    }, w, ordered);
+                double sec = (av_gettime_relative() - start) / 1000000.0;
+
+                r.values = {
+                    { "workers", static_cast<double>(w) },
+                    { "segments", static_cast<double>(decoder.segmentCount()) },
+                    { "frames", static_cast<double>(frames) },
+                    { "fps", sec > 0.0 ? frames / sec : 0.0 },
+                    { "cpu_sec", cpuSeconds() - cpu },
+                    { "speedup", sec > 0.0 ? baseSec / sec : 0.0 },
+                };
+                results.push_back(r);
+                std::fprintf(stderr, "parallel %s done\n", r.name.c_str());
+            }
+        }
+
+        return results;
+    }
+
+    // Decode, scale and encode one rendition on its own (url, res, framerate, threads, bytes) >= 0
+    int runPipeline(const std::string& url, const Resolution& res, AVRational framerate, unsigned int threads,
+                    int64_t& bytes) {
+        MediaEncoder encoder;
+        MediaResampler scaler;
+        AVFrame* dst = av_frame_alloc();
+        AVPacket* pkt = av_packet_alloc();
+        if (!dst || !pkt) {
+            av_packet_free(&pkt);
+            av_frame_free(&dst);
+            return AVERROR(ENOMEM);
+        }
+
+        int64_t index = 0;
+        int ret = ParallelDecoder::decodeSegment(url, ParallelDecoder::Segment(), threads, [&](AVFrame* src) {
+            int error = 0;
+            if (!encoder.videoEncoder()) {
+                error = scaler.configSwsContext(src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                                res.width, res.height, AV_PIX_FMT_YUV420P);
+                if (error >= 0) {
+                    error = encoder.openVideoEncoder(AV_CODEC_ID_H264, res.width, res.height, res.bitrate,
+                                                     av_inv_q(framerate), framerate, AV_PIX_FMT_YUV420P, false, threads);
+                }
+                if (error >= 0) {
+                    dst->format = AV_PIX_FMT_YUV420P;
+                    dst->width = res.width;
+                    dst->height = res.height;
+                    error = av_frame_get_buffer(dst, 0);
+                }
+            }
+
+            if (error >= 0) {
+                error = av_frame_make_writable(dst);
+            }
+            if (error >= 0) {
+                error = sws_scale(scaler.swsContext(), src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+            }
+            if (error < 0) {
+                return error;
+            }
+
+            dst->pts = index++;
+            error = encoder.sendVideoFrame(dst);
+            while (error >= 0 && encoder.receiveVideoPacket(pkt) >= 0) {
+                bytes += pkt->size;
+                av_packet_unref(pkt);
+            }
+            return error;
+            });
+
+        if (ret >= 0 && encoder.videoEncoder()) {
+            ret = encoder.flushVideoEncoder([&bytes](AVPacket* p) {
+                bytes += p->size;
+                });
+        }
+
+        av_packet_free(&pkt);
+        av_frame_free(&dst);
+        return ret;
+    }
+
+    std::vector<Result> runLadder(const Options& o) {
+        std::vector<Result> results;
+
+        MediaInput input;
+        int ret = input.openFileStream(o.input);
+        const VideoParams params = input.videoParams();
+        input.reset();
+
+        AVRational framerate = params.framerate.num > 0 && params.framerate.den > 0 ? params.framerate : AVRational{ 25, 1 };
+        std::vector<int> presets;
+        for (int p = 0; p < 4; ++p) {
+            if (Resolution_Preset[p].height <= params.height || p == 0) {
+                presets.push_back(p);
+            }
+        }
+
+        // One decode feeding every rendition, packets are only counted
+        Result ladderResult;
+        ladderResult.name = "ladder";
+        LadderEncoder ladder;
+        if (ret >= 0) {
+            ret = ladder.open(AV_CODEC_ID_H264, params.width, params.height, params.pixfmt, av_inv_q(framerate), framerate,
+                              presets, false, o.threads);
+        }
+
+        std::vector<std::thread> drains;
+        for (int i = 0; ret >= 0 && i < ladder.renditionCount(); ++i) {
+            drains.emplace_back([&ladder, i]() {
+                while (AVPacket* pkt = ladder.renditionPackets(i)->dequeue()) {
+                    av_packet_free(&pkt);
+                }
+                });
+        }
+
+        int64_t frames = 0;
+        double cpu = cpuSeconds();
+        int64_t start = av_gettime_relative();
+
+        if (ret >= 0) {
+            ret = ParallelDecoder::decodeSegment(o.input, ParallelDecoder::Segment(), o.threads, [&](AVFrame* frame) {
+                frame->pts = frames++;
+                return ladder.addFrame(frame);
+                });
+        }
+        if (ret >= 0) {
+            ret = ladder.finish();
+        }
+
+        double ladderSec = (av_gettime_relative() - start) / 1000000.0;
+        double ladderCpu = cpuSeconds() - cpu;
+
+        int64_t bytes = 0;
+        for (int i = 0; i < ladder.renditionCount(); ++i) {
+            bytes += ladder.renditionStats(i).bytes;
+            // The stages have drained, wakes the drain thread out of dequeue
+            ladder.renditionPackets(i)->lock();
+        }
+        for (std::thread& t : drains) {
+            t.join();
+        }
+        ladder.reset();
+
+        ladderResult.error = ret;
+        std::fprintf(stderr, "ladder done\n");
+
+        // The same renditions as independent pipelines, each decoding the file itself
+        Result pipeResult;
+        pipeResult.name = "pipelines";
+        std::vector<int> errors(presets.size(), 0);
+        std::vector<int64_t> pipeBytes(presets.size(), 0);
+        std::vector<std::thread> pipelines;
+
+        cpu = cpuSeconds();
+        start = av_gettime_relative();
+        for (size_t i = 0; ret >= 0 && i < presets.size(); ++i) {
+            pipelines.emplace_back([&, i]() {
+                errors[i] = runPipeline(o.input, Resolution_Preset[presets[i]], framerate, o.threads, pipeBytes[i]);
+                });
+        }
+        for (std::thread& t : pipelines) {
+            t.join();
+        }
+
+        double pipeSec = (av_gettime_relative() - start) / 1000000.0;
+        double pipeCpu = cpuSeconds() - cpu;
+        pipeResult.error = ret;
+        for (size_t i = 0; i < presets.size(); ++i) {
+            pipeResult.error = pipeResult.error < 0 ? pipeResult.error : errors[i];
+        }
+
+        int64_t totalBytes = 0;
+        for (int64_t b : pipeBytes) {
+            totalBytes += b;
+        }
+
+        const double renditions = static_cast<double>(presets.size());
+        ladderResult.values = {
+            { "renditions", renditions },
+            { "frames", static_cast<double>(frames) },
+            { "fps", ladderSec > 0.0 ? frames / ladderSec : 0.0 },
+            { "wall_sec", ladderSec },
+            { "cpu_sec", ladderCpu },
+            { "output_mb", bytes / 1048576.0 },
+            { "speedup", ladderSec > 0.0 ? pipeSec / ladderSec : 0.0 },
+            { "cpu_ratio", pipeCpu > 0.0 ? ladderCpu / pipeCpu : 0.0 },
+        };
+        pipeResult.values = {
+            { "renditions", renditions },
+            { "frames", static_cast<double>(frames) },
+            { "fps", pipeSec > 0.0 ? frames / pipeSec : 0.0 },
+            { "wall_sec", pipeSec },
+            { "cpu_sec", pipeCpu },
+            { "output_mb", totalBytes / 1048576.0 },
+        };
+        std::fprintf(stderr, "pipelines done\n");
+
+        results.push_back(ladderResult);
+        results.push_back(pipeResult);
+
+        return results;
+    }
+
+    // Decode and re-encode the video of a file to MP4 (url, output, threads) >= 0
+    int transcodeFile(const std::string& url, const std::string& output, unsigned int threads) {
+        MediaInput input;
+        int ret = input.openFileStream(url);
+        const VideoParams params = input.videoParams();
+        input.reset();
+        if (ret < 0) {
+            return ret;
+        }
+
+        AVRational framerate = params.framerate.num > 0 && params.framerate.den > 0 ? params.framerate : AVRational{ 25, 1 };
+        int64_t bitrate = params.bitrate > 0 ? params.bitrate : Resolution_Preset[2].bitrate;
+
+        MediaEncoder encoder;
+        MediaOutput out;
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+
+        auto write = [&](AVPacket* p) {
+            av_packet_rescale_ts(p, encoder.videoEncoder()->time_base, out.videoStream()->time_base);
+            p->stream_index = out.videoIndex();
+            return out.writePacket(p);
+            };
+
+        int64_t index = 0;
+        ret = ParallelDecoder::decodeSegment(url, ParallelDecoder::Segment(), threads, [&](AVFrame* frame) {
+            int error = 0;
+            if (!encoder.videoEncoder()) {
+                error = encoder.openVideoEncoder(AV_CODEC_ID_H264, frame->width, frame->height, bitrate,
+                                                 av_inv_q(framerate), framerate, static_cast<AVPixelFormat>(frame->format),
+                                                 false, threads);
+                if (error >= 0) {
+                    error = out.writeFile(output, "mp4", encoder.videoEncoder());
+                }
+                if (error < 0) {
+                    return error;
+                }
+            }
+
+            frame->pts = index++;
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            error = encoder.sendVideoFrame(frame);
+            while (error >= 0 && encoder.receiveVideoPacket(pkt) >= 0) {
+                error = write(pkt);
+            }
+            return error == AVERROR(EAGAIN) ? 0 : error;
+            });
+
+        if (ret >= 0 && encoder.videoEncoder()) {
+            ret = encoder.flushVideoEncoder([&](AVPacket* p) {
+                int error = write(p);
+                ret = ret < 0 ? ret : error;
+                });
+        }
+
+        out.reset();
+        av_packet_free(&pkt);
+        return ret;
+    }
+
+    std::vector<Result> runRemux(const Options& o) {
+        std::vector<Result> results;
+        const std::string remuxed = tempPath("media_pipebench_remux.mp4");
+        const std::string transcoded = tempPath("media_pipebench_transcode.mp4");
+
+        Result remux;
+        remux.name = "remux";
+        Remuxer remuxer;
+        double cpu = cpuSeconds();
+        int64_t start = av_gettime_relative();
+        remux.error = remuxer.remuxFile(o.input, remuxed, "mp4");
+        double remuxSec = (av_gettime_relative() - start) / 1000000.0;
+        double remuxCpu = cpuSeconds() - cpu;
+        RemuxStats stats = remuxer.stats();
+        std::fprintf(stderr, "remux done\n");
+
+        Result transcode;
+        transcode.name = "transcode";
+        cpu = cpuSeconds();
+        start = av_gettime_relative();
+        transcode.error = transcodeFile(o.input, transcoded, o.threads);
+        double transcodeSec = (av_gettime_relative() - start) / 1000000.0;
+        double transcodeCpu = cpuSeconds() - cpu;
+        std::fprintf(stderr, "transcode done\n");
+
+        remux.values = {
+            { "packets", static_cast<double>(stats.packets) },
+            { "mb", stats.bytes / 1048576.0 },
+            { "wall_sec", remuxSec },
+            { "cpu_sec", remuxCpu },
+            { "speedup", remuxSec > 0.0 ? transcodeSec / remuxSec : 0.0 },
+            { "cpu_ratio", remuxCpu > 0.0 ? transcodeCpu / remuxCpu : 0.0 },
+        };
+        transcode.values = {
+            { "wall_sec", transcodeSec },
+            { "cpu_sec", transcodeCpu },
+        };
+        results.push_back(remux);
+        results.push_back(transcode);
+
+        std::remove(remuxed.c_str());
+        std::remove(transcoded.c_str());
+        return results;
+    }
+
+    Result benchSink(MediaInput& input, const std::vector<AVPacket*>& packets, const std::string& path,
+                     int64_t targetBytes, bool useSink, bool direct) {
+        Result r;
+        if (packets.empty()) {
+            r.error = AVERROR_INVALIDDATA;
+            return r;
+        }
+
+        // The muxer takes stream settings from a codec context, filled from the input stream
+        AVStream* stream = input.inputContext()->streams[input.videoParams().index];
+        AVCodecContext* params = avcodec_alloc_context3(nullptr);
+        AVPacket* pkt = av_packet_alloc();
+        if (!params || !pkt) {
+            r.error = AVERROR(ENOMEM);
+        }
+        if (r.error >= 0) {
+            r.error = avcodec_parameters_to_context(params, stream->codecpar);
+            params->time_base = stream->time_base;
+        }
+
+        // Timeline span of one pass, later passes are shifted by it
+        int64_t first = INT64_MAX;
+        int64_t end = INT64_MIN;
+        for (const AVPacket* p : packets) {
+            int64_t ts = p->dts != AV_NOPTS_VALUE ? p->dts : p->pts;
+            if (ts != AV_NOPTS_VALUE) {
+                first = std::min(first, ts);
+                end = std::max(end, (p->pts != AV_NOPTS_VALUE ? p->pts : ts) + std::max<int64_t>(1, p->duration));
+            }
+        }
+        const int64_t span = end > first ? end - first : 1;
+
+        FileSink sink;
+        MediaOutput output;
+        int64_t written = 0;
+        double cpu = cpuSeconds();
+        int64_t start = av_gettime_relative();
+
+        if (r.error >= 0) {
+            if (useSink) {
+                r.error = sink.open(path, FileSink::BUFFER_SIZE, direct);
+                if (r.error >= 0) {
+                    r.error = output.writeIO(sink.ioContext(), "mp4", params);
+                }
+            }
+            else {
+                r.error = output.writeFile(path, "mp4", params);
+            }
+        }
+
+        for (int64_t pass = 0; r.error >= 0 && written < targetBytes; ++pass) {
+            for (const AVPacket* p : packets) {
+                r.error = av_packet_ref(pkt, p);
+                if (r.error < 0) {
+                    break;
+                }
+
+                if (pkt->pts != AV_NOPTS_VALUE) {
+                    pkt->pts += pass * span;
+                }
+                if (pkt->dts != AV_NOPTS_VALUE) {
+                    pkt->dts += pass * span;
+                }
+
+                av_packet_rescale_ts(pkt, stream->time_base, output.videoStream()->time_base);
+                pkt->stream_index = output.videoIndex();
+                written += pkt->size;
+
+                r.error = output.writePacket(pkt);
+                if (r.error < 0) {
+                    break;
+                }
+            }
+        }
+
+        // Trailer and the last buffers are part of the cost
+        output.reset();
+        if (useSink) {
+            int error = sink.close();
+            r.error = r.error < 0 ? r.error : error;
+        }
+
+        double sec = (av_gettime_relative() - start) / 1000000.0;
+        double cpuSec = cpuSeconds() - cpu;
+        FileSinkStats stats = sink.stats();
+
+        r.values = {
+            { "mb", written / 1048576.0 },
+            { "mb_per_sec", sec > 0.0 ? written / 1048576.0 / sec : 0.0 },
+            { "wall_sec", sec },
+            { "cpu_sec", cpuSec },
+            { "writes", static_cast<double>(stats.writes) },
+            { "ring_writes", static_cast<double>(stats.ringWrites) },
+            { "direct_writes", static_cast<double>(stats.directWrites) },
+            { "wait_ms", stats.waitUs / 1000.0 },
+        };
+
+        std::remove(path.c_str());
+        av_packet_free(&pkt);
+        avcodec_free_context(&params);
+        return r;
+    }
+
+    std::vector<Result> runSink(const Options& o) {
+        std::vector<Result> results;
+
+        MediaInput input;
+        std::vector<AVPacket*> packets;
+        int ret = loadInput(o, input, packets);
+
+        static const struct {
+            const char* name;
+            bool sink;
+            bool direct;
+        } Sinks[] = {
+            { "avio",            false, false },
+            { "filesink",        true,  false },
+            { "filesink_direct", true,  true },
+        };
+
+        const std::string path = tempPath("media_pipebench_sink.mp4");
+        for (const auto& k : Sinks) {
+            Result r;
+            if (ret >= 0) {
+                r = benchSink(input, packets, path, o.megabytes * 1048576, k.sink, k.direct);
+            }
+            else {
+                r.error = ret;
+            }
+            r.name = k.name;
+            results.push_back(r);
+            std::fprintf(stderr, "sink %s done\n", k.name);
+        }
+
+        freePackets(packets);
+        return results;
+    }
+
+    void printResult(const Result& r, bool last) {
+        std::printf("    {\"name\": \"%s\", ", r.name.c_str());
+        for (const auto& v : r.values) {
+            // Counts print as integers, times with millisecond precision
+            bool integral = v.second == static_cast<double>(static_cast<int64_t>(v.second));
+            std::printf(integral ? "\"%s\": %.0f, " : "\"%s\": %.3f, ", v.first.c_str(), v.second);
+        }
+        std::printf("\"error\": \"%s\"}%s\n", r.error < 0 ? errorString(r.error).c_str() : "", last ? "" : ",");
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options o;
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    bool usage = mode != "decode" && mode != "pool" && mode != "parallel" && mode != "ladder" && mode != "remux" && mode != "sink";
+    for (int i = 2; i < argc && !usage; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage = true;
+        }
+        else if (arg == "-i") {
+            o.input = argv[++i];
+        }
+        else if (arg == "-n") {
+            o.frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "-r") {
+            o.preset = std::atoi(argv[++i]);
+            usage = o.preset < 0 || o.preset >= 4;
+        }
+        else if (arg == "-m") {
+            o.megabytes = std::max<int64_t>(1, std::atoll(argv[++i]));
+        }
+        else if (arg == "-t") {
+            o.threads = static_cast<unsigned int>(std::max(0, std::atoi(argv[++i])));
+        }
+        else {
+            usage = true;
+        }
+    }
+
+    if (usage) {
+        std::fprintf(stderr, "usage: %s decode|pool|parallel|ladder|remux|sink [-i input] [-n frames] [-r preset] [-t threads] [-m MB]\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    std::string clip;
+    if (o.input.empty()) {
+        clip = tempPath("media_pipebench_clip.mp4");
+        int ret = makeClip(clip, Resolution_Preset[o.preset], o.frames);
+        if (ret < 0) {
+            std::fprintf(stderr, "clip: %s\n", errorString(ret).c_str());
+            return 1;
+        }
+        o.input = clip;
+    }
+
+    std::vector<Result> results;
+    if (mode == "decode") {
+        results = runDecode(o);
+    }
+    else if (mode == "pool") {
+        results = runPool(o);
+    }
+    else if (mode == "parallel") {
+        results = runParallel(o);
+    }
+    else if (mode == "ladder") {
+        results = runLadder(o);
+    }
+    else if (mode == "remux") {
+        results = runRemux(o);
+    }
+    else if (mode == "sink") {
+        results = runSink(o);
+    }
+
+    std::printf("{\n  \"mode\": \"%s\",\n  \"input\": \"%s\",\n  \"results\": [\n", mode.c_str(),
+                clip.empty() ? o.input.c_str() : "synthetic");
+    for (size_t i = 0; i < results.size(); ++i) {
+        printResult(results[i], i + 1 == results.size());
+    }
+    std::printf("  ]\n}\n");
+
+    if (!clip.empty()) {
+        std::remove(clip.c_str());
+    }
+    return 0;
+}
\ No newline at end of file